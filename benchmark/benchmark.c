@@ -0,0 +1,991 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tny/tny.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define RECORDS 100000
+#define WIDE_KEYS 10000
+#define DEPTH 1000
+#define BLOBS 64
+#define BLOB_SIZE (1024 * 1024)
+#define NUMBERS 1000000
+#define LOOKUPS 1000000
+#define FINDS 1000
+#define MESSAGES 10000
+#define BENCH_FILE "tny-bench.tny"
+
+typedef struct {
+	Tny *doc;			/* Document the workload operates on. */
+	void *dump;			/* Serialized form of doc. */
+	size_t size;		/* Size in bytes of dump. */
+	size_t raw;			/* Size in bytes of dump before compression, 0 if it is not compressed. */
+	char **keys;		/* Keys of doc if it is a dictionary. */
+	size_t count;		/* Number of keys or elements. */
+	Tny *other;			/* Changed version of doc for the diff workloads. */
+	TnyFrozen *frozen;	/* Frozen form of doc. */
+} State;
+
+typedef struct {
+	const char *name;				/* Name of the workload in the report. */
+	void (*setup)(State *state);	/* Prepares the state, not timed. */
+	void* (*run)(State *state);		/* The timed part, returns something to dispose of. */
+	void (*dispose)(void *result);	/* Frees the result of run, not timed. */
+	void (*teardown)(State *state);	/* Frees the state, not timed. */
+} Benchmark;
+
+typedef struct {
+	const char *name;
+	size_t repetitions;
+	double min;
+	double median;
+	double p99;
+	double mean;
+	size_t bytes;
+	size_t raw;
+} Result;
+
+static uint32_t seed = 12345;
+
+static uint32_t random32(void)
+{
+	/* xorshift keeps the workloads random but reproducible. */
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+
+	return seed;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1E9 + ts.tv_nsec;
+}
+
+static int compare(const void *left, const void *right)
+{
+	double l = *(const double*)left;
+	double r = *(const double*)right;
+
+	return (l > r) - (l < r);
+}
+
+static void disposeDoc(void *result)
+{
+	Tny_free(result);
+}
+
+static void disposeData(void *result)
+{
+	free(result);
+}
+
+static void dumpDoc(State *state)
+{
+	state->size = Tny_dumps(state->doc, &state->dump);
+}
+
+static void dumpDocIndexed(State *state)
+{
+	free(state->dump);
+	state->size = Tny_dumpsEx(state->doc, &state->dump, TNY_DUMP_INDEX);
+}
+
+static void dumpDocCompact(State *state)
+{
+	free(state->dump);
+	state->size = Tny_dumpsEx(state->doc, &state->dump, TNY_DUMP_COMPACT);
+}
+
+static void dumpDocCompressed(State *state, int flags)
+{
+	free(state->dump);
+	state->raw = state->doc->docSize;
+	state->size = Tny_dumpsEx(state->doc, &state->dump, flags);
+}
+
+static void teardownState(State *state)
+{
+	size_t i = 0;
+
+	if (state->keys != NULL) {
+		for (i = 0; i < state->count; i++) {
+			free(state->keys[i]);
+		}
+		free(state->keys);
+	}
+	free(state->dump);
+	Tny_free(state->doc);
+	Tny_free(state->other);
+	TnyFrozen_free(state->frozen);
+}
+
+/* Small messages: a handful of fields, built, serialized and parsed again. */
+
+static Tny* buildMessage(uint32_t id)
+{
+	Tny *msg = NULL;
+	uint64_t timestamp = 1400000000000ull + id;
+	double value = id * 0.5;
+	char *topic = "sensors/temperature";
+
+	msg = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	msg = Tny_add(msg, TNY_INT32, "id", &id, 0);
+	msg = Tny_add(msg, TNY_INT64, "timestamp", &timestamp, 0);
+	msg = Tny_add(msg, TNY_BIN, "topic", topic, strlen(topic));
+	msg = Tny_add(msg, TNY_DOUBLE, "value", &value, 0);
+
+	return msg->root;
+}
+
+static void* runSmallMessages(State *state)
+{
+	Tny *msg = NULL;
+	Tny *copy = NULL;
+	void *dump = NULL;
+	size_t size = 0;
+	uint32_t i = 0;
+
+	for (i = 0; i < MESSAGES; i++) {
+		msg = buildMessage(i);
+		size = Tny_dumps(msg, &dump);
+		copy = Tny_loads(dump, size);
+		Tny_free(copy);
+		Tny_free(msg);
+		free(dump);
+	}
+
+	return NULL;
+}
+
+/* The same messages as structs, encoded and decoded through a codec. */
+
+typedef struct {
+	uint32_t id;
+	uint64_t timestamp;
+	char topic[32];
+	double value;
+} Message;
+
+static const TnyField messageFields[] = {
+	{"id", TNY_INT32, offsetof(Message, id), 0},
+	{"timestamp", TNY_INT64, offsetof(Message, timestamp), 0},
+	{"topic", TNY_BIN, offsetof(Message, topic), sizeof(((Message*)0)->topic)},
+	{"value", TNY_DOUBLE, offsetof(Message, value), 0}
+};
+
+static void* runSmallMessagesCodec(State *state)
+{
+	TnyCodec *codec = TnyCodec_create(messageFields, 4);
+	Message msg;
+	Message copy;
+	char buffer[128];
+	size_t size = 0;
+	uint32_t i = 0;
+
+	memset(&msg, 0, sizeof(msg));
+	strcpy(msg.topic, "sensors/temperature");
+	for (i = 0; i < MESSAGES; i++) {
+		msg.id = i;
+		msg.timestamp = 1400000000000ull + i;
+		msg.value = i * 0.5;
+		size = TnyCodec_encodeInto(codec, &msg, buffer, sizeof(buffer), TNY_DUMP_DEFAULT);
+		TnyCodec_decode(codec, buffer, size, &copy);
+	}
+	TnyCodec_free(codec);
+
+	return NULL;
+}
+
+/* Records: the array of address dictionaries. */
+
+static Tny* buildRecords(Tny *array, int owned)
+{
+	Tny *dict = NULL;
+	char *name = "John Doe";
+	char *street = "Some street name";
+	uint32_t streetnr = 10;
+	uint32_t i = 0;
+
+	for (i = 0; i < RECORDS; i++) {
+		dict = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+		dict = Tny_add(dict, TNY_BIN, "Name", name, strlen(name));
+		dict = Tny_add(dict, TNY_BIN, "Street", street, strlen(street));
+		dict = Tny_add(dict, TNY_INT32, "Nr", &streetnr, 0);
+		if (owned) {
+			array = Tny_addOwned(array, NULL, dict);
+		} else {
+			array = Tny_add(array, TNY_OBJ, NULL, dict, 0);
+			Tny_free(dict);
+		}
+	}
+
+	return array->root;
+}
+
+static void* runRecordsCreate(State *state)
+{
+	return buildRecords(Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0), 0);
+}
+
+static void* runRecordsCreateOwned(State *state)
+{
+	return buildRecords(Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0), 1);
+}
+
+static void* runRecordsCreateArena(State *state)
+{
+	return buildRecords(Tny_newArena(TNY_ARRAY, 0), 0);
+}
+
+static void setupRecords(State *state)
+{
+	state->doc = buildRecords(Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0), 1);
+	dumpDoc(state);
+}
+
+static void setupRecordsCompact(State *state)
+{
+	setupRecords(state);
+	dumpDocCompact(state);
+}
+
+static void setupRecordsCompressed(State *state)
+{
+	setupRecords(state);
+	dumpDocCompressed(state, TNY_DUMP_COMPRESS);
+}
+
+static void setupRecordsKeys(State *state)
+{
+	setupRecords(state);
+	dumpDocCompressed(state, TNY_DUMP_KEYS);
+}
+
+static void setupRecordsDiff(State *state)
+{
+	Tny *patch = NULL;
+	void *data = NULL;
+	uint32_t streetnr = 11;
+
+	setupRecords(state);
+	state->raw = state->size;
+	free(state->dump);
+	/* A typical edit: one field of one record changes and a record is added. */
+	state->other = Tny_copy(NULL, state->doc);
+	Tny_add(Tny_at(state->other, RECORDS / 2)->value.tny, TNY_INT32, "Nr", &streetnr, 0);
+	Tny_append(state->other, TNY_OBJ, NULL, Tny_at(state->other, 0)->value.tny, 0);
+	patch = Tny_diff(state->doc, state->other);
+	state->size = Tny_dumps(patch, &data);
+	state->dump = data;
+	Tny_free(patch);
+}
+
+static void setupRecordsFrozen(State *state)
+{
+	setupRecords(state);
+	state->frozen = Tny_freeze(state->doc);
+}
+
+static void setupRecordsCached(State *state)
+{
+	setupRecords(state);
+	free(state->dump);
+	state->size = Tny_dumpsEx(state->doc, &state->dump, TNY_DUMP_CACHE);
+}
+
+static void setupRecordsFile(State *state)
+{
+	FILE *file = NULL;
+
+	setupRecords(state);
+	file = fopen(BENCH_FILE, "wb");
+	if (file != NULL) {
+		fwrite(state->dump, 1, state->size, file);
+		fclose(file);
+	}
+}
+
+static void teardownFile(State *state)
+{
+	remove(BENCH_FILE);
+	teardownState(state);
+}
+
+/* Wide dictionaries: thousands of keys. */
+
+static void setupWideDict(State *state)
+{
+	char key[32];
+	uint32_t i = 0;
+
+	state->count = WIDE_KEYS;
+	state->keys = malloc(WIDE_KEYS * sizeof(char*));
+	state->doc = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < WIDE_KEYS; i++) {
+		snprintf(key, sizeof(key), "feature.flag.%u", i);
+		state->keys[i] = malloc(strlen(key) + 1);
+		strcpy(state->keys[i], key);
+		Tny_append(state->doc, TNY_INT32, key, &i, 0);
+	}
+	dumpDoc(state);
+}
+
+static void* runWideDictCreate(State *state)
+{
+	Tny *dict = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	uint32_t i = 0;
+
+	for (i = 0; i < state->count; i++) {
+		Tny_append(dict, TNY_INT32, state->keys[i], &i, 0);
+	}
+
+	return dict;
+}
+
+static void* runGet(State *state)
+{
+	Tny *tmp = NULL;
+	uint64_t sum = 0;
+	uint32_t i = 0;
+
+	for (i = 0; i < LOOKUPS; i++) {
+		tmp = Tny_get(state->doc, state->keys[random32() % state->count]);
+		sum += tmp->value.num;
+	}
+
+	return sum == 0 ? state : NULL;
+}
+
+static void setupWideDictIndexed(State *state)
+{
+	setupWideDict(state);
+	dumpDocIndexed(state);
+}
+
+static void* runFind(State *state)
+{
+	TnyReader reader;
+	uint64_t sum = 0;
+	uint32_t i = 0;
+
+	TnyReader_init(&reader, state->dump, state->size);
+	for (i = 0; i < FINDS; i++) {
+		if (TnyReader_find(&reader, state->keys[random32() % state->count])) {
+			sum += TnyReader_int32(&reader);
+		}
+	}
+
+	return sum == 0 ? state : NULL;
+}
+
+/* Deep nesting: a chain of dictionaries. */
+
+static Tny* buildDeep(void)
+{
+	Tny *doc = NULL;
+	Tny *child = NULL;
+	uint32_t i = 0;
+
+	for (i = 0; i < DEPTH; i++) {
+		child = doc;
+		doc = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+		doc = Tny_add(doc, TNY_INT32, "Depth", &i, 0);
+		if (child != NULL) {
+			doc = Tny_addOwned(doc, "Child", child);
+		}
+	}
+
+	return doc->root;
+}
+
+static void* runDeepCreate(State *state)
+{
+	return buildDeep();
+}
+
+static void setupDeep(State *state)
+{
+	state->doc = buildDeep();
+	dumpDoc(state);
+}
+
+/* Large blobs. */
+
+static void setupBlobs(State *state)
+{
+	char *blob = malloc(BLOB_SIZE);
+	uint32_t i = 0;
+
+	for (i = 0; i < BLOB_SIZE; i++) {
+		blob[i] = random32();
+	}
+
+	state->doc = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	for (i = 0; i < BLOBS; i++) {
+		Tny_append(state->doc, TNY_BIN, NULL, blob, BLOB_SIZE);
+	}
+	free(blob);
+	dumpDoc(state);
+}
+
+/* Text blobs: compressible values such as logs or JSON. */
+
+static void setupText(State *state)
+{
+	char *text = malloc(BLOB_SIZE);
+	size_t pos = 0;
+	uint32_t i = 0;
+
+	for (pos = 0; pos < BLOB_SIZE - 128; i++) {
+		pos += snprintf(text + pos, 128, "{\"id\": %u, \"level\": \"%s\", \"value\": %u}\n",
+				i, random32() % 4 == 0 ? "warning" : "info", random32() % 1000);
+	}
+	memset(text + pos, ' ', BLOB_SIZE - pos);
+
+	state->doc = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	for (i = 0; i < BLOBS / 8; i++) {
+		Tny_append(state->doc, TNY_BIN, NULL, text, BLOB_SIZE);
+	}
+	free(text);
+	dumpDocCompressed(state, TNY_DUMP_COMPRESS_BIN);
+}
+
+/* Numeric arrays. */
+
+static Tny* buildNumbers(void)
+{
+	Tny *array = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	double value = 0.0;
+	uint32_t i = 0;
+
+	for (i = 0; i < NUMBERS; i++) {
+		value = i * 0.25;
+		Tny_append(array, TNY_DOUBLE, NULL, &value, 0);
+	}
+
+	return array;
+}
+
+static void* runNumbersCreate(State *state)
+{
+	return buildNumbers();
+}
+
+static void setupNumbers(State *state)
+{
+	state->doc = buildNumbers();
+	state->count = NUMBERS;
+	dumpDoc(state);
+}
+
+static void setupNumbersIndexed(State *state)
+{
+	setupNumbers(state);
+	dumpDocIndexed(state);
+}
+
+static Tny* buildPacked(void)
+{
+	Tny *array = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	double *values = malloc(NUMBERS * sizeof(double));
+	uint32_t i = 0;
+
+	for (i = 0; i < NUMBERS; i++) {
+		values[i] = i * 0.25;
+	}
+	Tny_append(array, TNY_PACKED_DOUBLE, NULL, values, NUMBERS);
+	free(values);
+
+	return array;
+}
+
+static void* runPackedCreate(State *state)
+{
+	return buildPacked();
+}
+
+static void setupPacked(State *state)
+{
+	state->doc = buildPacked();
+	dumpDoc(state);
+}
+
+static void* runAt(State *state)
+{
+	Tny *tmp = NULL;
+	double sum = 0.0;
+	uint32_t i = 0;
+
+	for (i = 0; i < LOOKUPS; i++) {
+		tmp = Tny_at(state->doc, random32() % state->count);
+		sum += tmp->value.flt;
+	}
+
+	return sum < 0.0 ? state : NULL;
+}
+
+/* Generic workloads on the serialized state. */
+
+static void* runDumps(State *state)
+{
+	void *dump = NULL;
+
+	Tny_dumps(state->doc, &dump);
+
+	return dump;
+}
+
+static void* runDumpsThreads1(State *state)
+{
+	void *dump = NULL;
+
+	Tny_dumpsParallel(state->doc, &dump, TNY_DUMP_DEFAULT, 1);
+
+	return dump;
+}
+
+static void* runDumpsThreads2(State *state)
+{
+	void *dump = NULL;
+
+	Tny_dumpsParallel(state->doc, &dump, TNY_DUMP_DEFAULT, 2);
+
+	return dump;
+}
+
+static void* runDumpsThreads4(State *state)
+{
+	void *dump = NULL;
+
+	Tny_dumpsParallel(state->doc, &dump, TNY_DUMP_DEFAULT, 4);
+
+	return dump;
+}
+
+static void* runDumpsThreads8(State *state)
+{
+	void *dump = NULL;
+
+	Tny_dumpsParallel(state->doc, &dump, TNY_DUMP_DEFAULT, 8);
+
+	return dump;
+}
+
+static void* runDumpsThreads16(State *state)
+{
+	void *dump = NULL;
+
+	Tny_dumpsParallel(state->doc, &dump, TNY_DUMP_DEFAULT, 16);
+
+	return dump;
+}
+
+static void* runDumpsCompact(State *state)
+{
+	void *dump = NULL;
+
+	Tny_dumpsEx(state->doc, &dump, TNY_DUMP_COMPACT);
+
+	return dump;
+}
+
+static void* runDumpsCompressed(State *state)
+{
+	void *dump = NULL;
+
+	Tny_dumpsEx(state->doc, &dump, TNY_DUMP_COMPRESS);
+
+	return dump;
+}
+
+static void* runDumpsKeys(State *state)
+{
+	void *dump = NULL;
+
+	Tny_dumpsEx(state->doc, &dump, TNY_DUMP_KEYS);
+
+	return dump;
+}
+
+static void* runDumpsCompressedBin(State *state)
+{
+	void *dump = NULL;
+
+	Tny_dumpsEx(state->doc, &dump, TNY_DUMP_COMPRESS_BIN);
+
+	return dump;
+}
+
+static void* runLoads(State *state)
+{
+	return Tny_loads(state->dump, state->size);
+}
+
+static void* runLoadsArena(State *state)
+{
+	return Tny_loadsEx(state->dump, state->size, TNY_LOAD_ARENA);
+}
+
+static void* runLoadsView(State *state)
+{
+	return Tny_loadsView(state->dump, state->size);
+}
+
+static void* runLoadsThreads1(State *state)
+{
+	return Tny_loadsParallel(state->dump, state->size, TNY_LOAD_DEFAULT, 1);
+}
+
+static void* runLoadsThreads2(State *state)
+{
+	return Tny_loadsParallel(state->dump, state->size, TNY_LOAD_DEFAULT, 2);
+}
+
+static void* runLoadsThreads4(State *state)
+{
+	return Tny_loadsParallel(state->dump, state->size, TNY_LOAD_DEFAULT, 4);
+}
+
+static void* runLoadsThreads8(State *state)
+{
+	return Tny_loadsParallel(state->dump, state->size, TNY_LOAD_DEFAULT, 8);
+}
+
+static void* runLoadsThreads16(State *state)
+{
+	return Tny_loadsParallel(state->dump, state->size, TNY_LOAD_DEFAULT, 16);
+}
+
+static void* runLoadsArenaThreads8(State *state)
+{
+	return Tny_loadsParallel(state->dump, state->size, TNY_LOAD_ARENA, 8);
+}
+
+static void* runLoadFile(State *state)
+{
+	return Tny_loadFile(BENCH_FILE, TNY_LOAD_DEFAULT);
+}
+
+static void* runLoadFileView(State *state)
+{
+	return Tny_loadFile(BENCH_FILE, TNY_LOAD_VIEW);
+}
+
+static void* runValidate(State *state)
+{
+	return Tny_validate(state->dump, state->size, NULL) ? NULL : state;
+}
+
+static void* runLoadsValidate(State *state)
+{
+	return Tny_loadsEx(state->dump, state->size, TNY_LOAD_VALIDATE);
+}
+
+static void* runReader(State *state)
+{
+	TnyReader reader;
+	size_t count = 0;
+
+	if (TnyReader_init(&reader, state->dump, state->size)) {
+		while (TnyReader_next(&reader)) {
+			count++;
+		}
+	}
+
+	return count == 0 ? state : NULL;
+}
+
+static void* runPath(State *state)
+{
+	TnyPath *path = Tny_compilePath("[99999].Nr");
+	TnyReader reader;
+	uint32_t nr = 0;
+
+	if (TnyReader_init(&reader, state->dump, state->size) && TnyPath_evaluate(path, &reader)) {
+		nr = TnyReader_int32(&reader);
+	}
+	TnyPath_free(path);
+
+	return nr == 0 ? state : NULL;
+}
+
+static void* runDiff(State *state)
+{
+	return Tny_diff(state->doc, state->other);
+}
+
+static void* runDumpsCached(State *state)
+{
+	uint32_t nr = random32();
+	void *data = NULL;
+
+	/* A small edit between two dumps. */
+	Tny_add(Tny_at(state->doc, nr % RECORDS)->value.tny, TNY_INT32, "Nr", &nr, 0);
+	Tny_dumpsEx(state->doc, &data, TNY_DUMP_CACHE);
+
+	return data;
+}
+
+static void* runFreeze(State *state)
+{
+	return Tny_freeze(state->doc);
+}
+
+static void disposeFrozen(void *result)
+{
+	TnyFrozen_free(result);
+}
+
+static void* runIterate(State *state)
+{
+	Tny *next = NULL;
+	uint64_t sum = 0;
+
+	for (next = state->doc->next; next != NULL; next = next->next) {
+		sum += Tny_get(next->value.tny, "Nr")->value.num;
+	}
+
+	return sum == 0 ? state : NULL;
+}
+
+static void* runIterateFrozen(State *state)
+{
+	uint64_t sum = 0;
+	uint32_t count = TnyFrozen_size(state->frozen, TNY_FROZEN_ROOT);
+	uint32_t i = 0;
+
+	for (i = 0; i < count; i++) {
+		sum += TnyFrozen_int32(state->frozen, TnyFrozen_get(state->frozen, TnyFrozen_at(state->frozen, TNY_FROZEN_ROOT, i), "Nr"));
+	}
+
+	return sum == 0 ? state : NULL;
+}
+
+static void* runSeek(State *state)
+{
+	TnyReader reader;
+	double sum = 0.0;
+	uint32_t i = 0;
+
+	TnyReader_init(&reader, state->dump, state->size);
+	for (i = 0; i < FINDS; i++) {
+		if (TnyReader_seek(&reader, random32() % state->count)) {
+			sum += TnyReader_double(&reader);
+		}
+	}
+
+	return sum < 0.0 ? state : NULL;
+}
+
+static const Benchmark benchmarks[] = {
+	{"small_messages", NULL, runSmallMessages, NULL, NULL},
+	{"small_messages_codec", NULL, runSmallMessagesCodec, NULL, NULL},
+	{"records_create", NULL, runRecordsCreate, disposeDoc, NULL},
+	{"records_create_owned", NULL, runRecordsCreateOwned, disposeDoc, NULL},
+	{"records_create_arena", NULL, runRecordsCreateArena, disposeDoc, NULL},
+	{"records_dumps", setupRecords, runDumps, disposeData, teardownState},
+	{"records_dumps_cached", setupRecordsCached, runDumpsCached, disposeData, teardownState},
+	{"records_dumps_threads_1", setupRecords, runDumpsThreads1, disposeData, teardownState},
+	{"records_dumps_threads_2", setupRecords, runDumpsThreads2, disposeData, teardownState},
+	{"records_dumps_threads_4", setupRecords, runDumpsThreads4, disposeData, teardownState},
+	{"records_dumps_threads_8", setupRecords, runDumpsThreads8, disposeData, teardownState},
+	{"records_dumps_threads_16", setupRecords, runDumpsThreads16, disposeData, teardownState},
+	{"records_loads", setupRecords, runLoads, disposeDoc, teardownState},
+	{"records_loads_arena", setupRecords, runLoadsArena, disposeDoc, teardownState},
+	{"records_loads_view", setupRecords, runLoadsView, disposeDoc, teardownState},
+	{"records_reader", setupRecords, runReader, NULL, teardownState},
+	{"records_path", setupRecords, runPath, NULL, teardownState},
+	{"records_diff", setupRecordsDiff, runDiff, disposeDoc, teardownState},
+	{"records_freeze", setupRecords, runFreeze, disposeFrozen, teardownState},
+	{"records_iterate", setupRecords, runIterate, NULL, teardownState},
+	{"records_iterate_frozen", setupRecordsFrozen, runIterateFrozen, NULL, teardownState},
+	{"records_validate", setupRecords, runValidate, NULL, teardownState},
+	{"records_loads_validate", setupRecords, runLoadsValidate, disposeDoc, teardownState},
+	{"records_loads_threads_1", setupRecords, runLoadsThreads1, disposeDoc, teardownState},
+	{"records_loads_threads_2", setupRecords, runLoadsThreads2, disposeDoc, teardownState},
+	{"records_loads_threads_4", setupRecords, runLoadsThreads4, disposeDoc, teardownState},
+	{"records_loads_threads_8", setupRecords, runLoadsThreads8, disposeDoc, teardownState},
+	{"records_loads_threads_16", setupRecords, runLoadsThreads16, disposeDoc, teardownState},
+	{"records_loads_arena_threads_8", setupRecords, runLoadsArenaThreads8, disposeDoc, teardownState},
+	{"records_load_file", setupRecordsFile, runLoadFile, disposeDoc, teardownFile},
+	{"records_load_file_view", setupRecordsFile, runLoadFileView, disposeDoc, teardownFile},
+	{"records_dumps_compact", setupRecordsCompact, runDumpsCompact, disposeData, teardownState},
+	{"records_loads_compact", setupRecordsCompact, runLoads, disposeDoc, teardownState},
+	{"records_dumps_compressed", setupRecordsCompressed, runDumpsCompressed, disposeData, teardownState},
+	{"records_loads_compressed", setupRecordsCompressed, runLoads, disposeDoc, teardownState},
+	{"records_dumps_keys", setupRecordsKeys, runDumpsKeys, disposeData, teardownState},
+	{"records_loads_keys", setupRecordsKeys, runLoads, disposeDoc, teardownState},
+	{"records_loads_keys_arena", setupRecordsKeys, runLoadsArena, disposeDoc, teardownState},
+	{"wide_dict_create", setupWideDict, runWideDictCreate, disposeDoc, teardownState},
+	{"wide_dict_loads", setupWideDict, runLoads, disposeDoc, teardownState},
+	{"wide_dict_get", setupWideDict, runGet, NULL, teardownState},
+	{"wide_dict_find", setupWideDict, runFind, NULL, teardownState},
+	{"wide_dict_find_indexed", setupWideDictIndexed, runFind, NULL, teardownState},
+	{"deep_create", NULL, runDeepCreate, disposeDoc, NULL},
+	{"deep_dumps", setupDeep, runDumps, disposeData, teardownState},
+	{"deep_loads", setupDeep, runLoads, disposeDoc, teardownState},
+	{"blobs_dumps", setupBlobs, runDumps, disposeData, teardownState},
+	{"blobs_loads", setupBlobs, runLoads, disposeDoc, teardownState},
+	{"blobs_loads_view", setupBlobs, runLoadsView, disposeDoc, teardownState},
+	{"text_dumps_compressed", setupText, runDumpsCompressedBin, disposeData, teardownState},
+	{"text_loads_compressed", setupText, runLoads, disposeDoc, teardownState},
+	{"numbers_create", NULL, runNumbersCreate, disposeDoc, NULL},
+	{"numbers_dumps", setupNumbers, runDumps, disposeData, teardownState},
+	{"numbers_loads", setupNumbers, runLoads, disposeDoc, teardownState},
+	{"numbers_validate", setupNumbers, runValidate, NULL, teardownState},
+	{"numbers_at", setupNumbers, runAt, NULL, teardownState},
+	{"numbers_packed_create", NULL, runPackedCreate, disposeDoc, NULL},
+	{"numbers_packed_dumps", setupPacked, runDumps, disposeData, teardownState},
+	{"numbers_packed_loads", setupPacked, runLoads, disposeDoc, teardownState},
+	{"numbers_seek_indexed", setupNumbersIndexed, runSeek, NULL, teardownState},
+};
+
+static void measure(const Benchmark *benchmark, size_t warmups, size_t repetitions, Result *result)
+{
+	State state;
+	double *times = malloc(repetitions * sizeof(double));
+	double start = 0.0;
+	void *tmp = NULL;
+	size_t i = 0;
+
+	memset(&state, 0, sizeof(State));
+	if (benchmark->setup != NULL) {
+		benchmark->setup(&state);
+	}
+
+	for (i = 0; i < warmups + repetitions; i++) {
+		start = now();
+		tmp = benchmark->run(&state);
+		if (i >= warmups) {
+			times[i - warmups] = now() - start;
+		}
+		if (benchmark->dispose != NULL) {
+			benchmark->dispose(tmp);
+		}
+	}
+
+	qsort(times, repetitions, sizeof(double), compare);
+	result->name = benchmark->name;
+	result->repetitions = repetitions;
+	result->min = times[0];
+	result->median = times[repetitions / 2];
+	result->p99 = times[(repetitions * 99 + 99) / 100 - 1];
+	result->bytes = state.size;
+	result->raw = state.raw > 0 ? state.raw : state.size;
+	result->mean = 0.0;
+	for (i = 0; i < repetitions; i++) {
+		result->mean += times[i] / repetitions;
+	}
+
+	if (benchmark->teardown != NULL) {
+		benchmark->teardown(&state);
+	}
+	free(times);
+}
+
+static void report(FILE *out, const Result *results, size_t count, size_t warmups)
+{
+	size_t i = 0;
+
+	fprintf(out, "{\n  \"warmups\": %lu,\n  \"benchmarks\": [\n", (unsigned long)warmups);
+	for (i = 0; i < count; i++) {
+		/* Throughput is measured on the uncompressed size, ratio is uncompressed / serialized. */
+		fprintf(out, "    {\"name\": \"%s\", \"repetitions\": %lu, \"bytes\": %lu, "
+				"\"min_ns\": %.0f, \"median_ns\": %.0f, \"p99_ns\": %.0f, \"mean_ns\": %.0f, "
+				"\"ratio\": %.3f, \"mb_per_s\": %.1f}%s\n",
+				results[i].name, (unsigned long)results[i].repetitions, (unsigned long)results[i].bytes,
+				results[i].min, results[i].median, results[i].p99, results[i].mean,
+				results[i].bytes > 0 ? (double)results[i].raw / results[i].bytes : 0.0,
+				results[i].raw / (results[i].median / 1E9) / 1E6,
+				i + 1 < count ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-w warmups] [-r repetitions] [-o file.json] [name...]\n", name);
+	fprintf(stderr, "Runs every benchmark whose name starts with one of the given names.\n");
+}
+
+int main(int argc, char **argv)
+{
+	size_t count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+	Result *results = malloc(count * sizeof(Result));
+	const char *output = NULL;
+	size_t warmups = 2;
+	size_t repetitions = 15;
+	size_t done = 0;
+	size_t i = 0;
+	int selected = 0;
+	int names = 0;
+	int arg = 0;
+	FILE *out = stdout;
+
+	for (arg = 1; arg < argc; arg++) {
+		if (strcmp(argv[arg], "-w") == 0 && arg + 1 < argc) {
+			warmups = strtoul(argv[++arg], NULL, 10);
+		} else if (strcmp(argv[arg], "-r") == 0 && arg + 1 < argc) {
+			repetitions = strtoul(argv[++arg], NULL, 10);
+		} else if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc) {
+			output = argv[++arg];
+		} else if (argv[arg][0] == '-') {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		} else {
+			names++;
+		}
+	}
+
+	if (repetitions == 0) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < count; i++) {
+		selected = names == 0;
+		for (arg = 1; arg < argc && !selected; arg++) {
+			if (argv[arg][0] == '-') {
+				arg++;
+			} else if (strncmp(benchmarks[i].name, argv[arg], strlen(argv[arg])) == 0) {
+				selected = 1;
+			}
+		}
+
+		if (selected) {
+			measure(&benchmarks[i], warmups, repetitions, &results[done]);
+			fprintf(stderr, "%-30s median %12.3f ms   p99 %12.3f ms", results[done].name,
+					results[done].median / 1E6, results[done].p99 / 1E6);
+			if (results[done].raw != results[done].bytes) {
+				fprintf(stderr, "   ratio %6.2f   %8.1f MB/s", (double)results[done].raw / results[done].bytes,
+						results[done].raw / (results[done].median / 1E9) / 1E6);
+			}
+			fprintf(stderr, "\n");
+			done++;
+		}
+	}
+
+	if (output != NULL) {
+		out = fopen(output, "w");
+		if (out == NULL) {
+			fprintf(stderr, "Can not open %s\n", output);
+			return EXIT_FAILURE;
+		}
+	}
+	report(out, results, done, warmups);
+	if (out != stdout) {
+		fclose(out);
+	}
+	free(results);
+
+	return EXIT_SUCCESS;
+}
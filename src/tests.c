@@ -1,10 +1,19 @@
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include "tny/tny.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
 void printObj(Tny *tny, int level);
 
 int printElement(Tny *tny, int level)
@@ -76,6 +85,7 @@ int Tny_cmp(Tny *left, Tny *right)
 	Tny *lnext = left->root;
 	Tny *rnext = right->root;
 	TnyType type = TNY_NULL;
+	size_t width = 0;
 
 	if (lnext->type == rnext->type) {
 		type = lnext->type;
@@ -105,7 +115,20 @@ int Tny_cmp(Tny *left, Tny *right)
 				if (memcmp(lnext->value.ptr, rnext->value.ptr, lnext->size) != 0) {
 					return 1;
 				}
-			} else if (lnext->value.num != lnext->value.num) {
+			} else if (lnext->type == TNY_PACKED_INT32 || lnext->type == TNY_PACKED_INT64 || lnext->type == TNY_PACKED_DOUBLE) {
+				width = lnext->type == TNY_PACKED_INT32 ? sizeof(uint32_t) : sizeof(uint64_t);
+				if (lnext->size != rnext->size) {
+					return 1;
+				}
+
+				if (lnext->size > 0 && memcmp(lnext->value.ptr, rnext->value.ptr, lnext->size * width) != 0) {
+					return 1;
+				}
+			} else if (lnext->type == TNY_CHAR) {
+				if (lnext->value.chr != rnext->value.chr) {
+					return 1;
+				}
+			} else if (lnext->value.num != rnext->value.num) {
 				return 1;
 			}
 
@@ -123,6 +146,115 @@ int Tny_cmp(Tny *left, Tny *right)
 	}
 }
 
+struct buffer {
+	char *data;
+	size_t size;
+};
+
+typedef struct {
+	char name[16];
+	char street[32];
+	uint32_t nr;
+	uint64_t stamp;
+	double position[3];
+	char flag;
+} Address;
+
+static const TnyField addressFields[] = {
+	{"Name", TNY_BIN, offsetof(Address, name), sizeof(((Address*)0)->name)},
+	{"Street", TNY_BIN, offsetof(Address, street), sizeof(((Address*)0)->street)},
+	{"Nr", TNY_INT32, offsetof(Address, nr), 0},
+	{"Stamp", TNY_INT64, offsetof(Address, stamp), 0},
+	{"Position", TNY_PACKED_DOUBLE, offsetof(Address, position), 3},
+	{"Flag", TNY_CHAR, offsetof(Address, flag), 0}
+};
+
+int collect(void *userData, const void *data, size_t size)
+{
+	struct buffer *buffer = userData;
+	char *tmp = realloc(buffer->data, buffer->size + size);
+
+	if (tmp == NULL) {
+		return 0;
+	}
+	memcpy(tmp + buffer->size, data, size);
+	buffer->data = tmp;
+	buffer->size += size;
+
+	return 1;
+}
+
+struct usage {
+	size_t calls;
+	long live;
+	size_t nulls;
+	size_t largest;
+};
+
+void* countAllocate(void *context, size_t size)
+{
+	struct usage *usage = context;
+	void *ptr = malloc(size);
+
+	if (ptr != NULL) {
+		usage->calls++;
+		usage->live++;
+		if (size > usage->largest) {
+			usage->largest = size;
+		}
+	}
+
+	return ptr;
+}
+
+void* countReallocate(void *context, void *ptr, size_t size)
+{
+	struct usage *usage = context;
+	void *tmp = realloc(ptr, size);
+
+	if (tmp != NULL) {
+		usage->calls++;
+		if (ptr == NULL) {
+			usage->live++;
+		}
+		if (size > usage->largest) {
+			usage->largest = size;
+		}
+	}
+
+	return tmp;
+}
+
+void countRelease(void *context, void *ptr)
+{
+	struct usage *usage = context;
+
+	if (ptr == NULL) {
+		usage->nulls++;
+	}
+	usage->live--;
+	free(ptr);
+}
+
+FILE* createTempFile(char *path)
+{
+#if defined(__unix__) || defined(__APPLE__)
+	int fd = -1;
+	FILE *file = NULL;
+
+	strcpy(path, "/tmp/tny-test-XXXXXX");
+	fd = mkstemp(path);
+	if (fd >= 0 && (file = fdopen(fd, "wb")) == NULL) {
+		close(fd);
+		remove(path);
+	}
+
+	return file;
+#else
+	return tmpnam(path) != NULL ? fopen(path, "wb") : NULL;
+#endif
+}
+
 int serialize_deserialize(Tny *tny)
 {
 	void *dump = NULL;
@@ -172,6 +304,41 @@ int main(void)
 	int errors = 0;
 	uint32_t counter = 0;
 	uint32_t i = 0;
+	void *dump = NULL;
+	size_t size = 0;
+	char key[16];
+	const char *order = NULL;
+	TnyReader reader;
+	uint32_t len = 0;
+	TnyWriter writer;
+	struct buffer sink;
+	void *data = NULL;
+	char blob[4096];
+	TnyIovec *iov = NULL;
+	size_t count = 0;
+	FILE *file = NULL;
+	char filename[FILENAME_MAX];
+	TnyParser parser;
+	int flags = 0;
+	double samples[1000];
+	uint32_t ids[1000];
+	uint64_t stamps[1000];
+	TnyLimits limits;
+	TnyCodec *codec = NULL;
+	Address address;
+	Address decoded;
+	TnyPath *path = NULL;
+	Tny *patch = NULL;
+	Tny *changed = NULL;
+	TnyFrozen *frozen = NULL;
+	uint32_t node = 0;
+	void *cached = NULL;
+	struct usage usage;
+	TnyAllocator allocator = { countAllocate, countReallocate, countRelease, &usage };
+	TnyMemory memory;
+	TnyStats stats;
+	uint64_t nodes = 0;
+	void *block = NULL;
 
 	/****************************************************
 	 *  WARNING: BEHAVIOUR CHANGED!                     *
@@ -374,6 +541,1640 @@ int main(void)
 	}
 	Tny_free(root);
 
+	/* Building and loading documents on an arena. */
+	root = Tny_newArena(TNY_ARRAY, 64);
+	for (i = 0; i < 6; i++) {
+		root = Tny_add(root, types[i], NULL, values[i], sizes[i]);
+	}
+	embedded = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < 6; i++) {
+		embedded = Tny_add(embedded, types[i], keys[i], values[i], sizes[i]);
+	}
+	root = Tny_add(root, TNY_OBJ, NULL, embedded, 0);
+	Tny_free(embedded);
+	if (root == NULL || root->root->arena == NULL || Tny_at(root, 6)->value.tny->arena != root->root->arena) {
+		printf("Creating an arena document failed!\n");
+		errors++;
+	} else {
+		root = root->root;
+		Tny_remove(Tny_at(root, 2));
+		ui32 = 5;
+		Tny_add(Tny_get(Tny_at(root, 5)->value.tny, "Key1"), TNY_INT32, "Key1", &ui32, 0);
+		if (serialize_deserialize(root)) {
+			printf("Serializing an arena document failed!\n");
+			errors++;
+		}
+
+		size = Tny_dumps(root, &dump);
+		tmp = Tny_loadsEx(dump, size, TNY_LOAD_ARENA);
+		if (tmp == NULL || tmp->arena == NULL || Tny_cmp(root, tmp) != 0 || tmp->docSize != size) {
+			printf("Loading a document into an arena failed!\n");
+			errors++;
+		}
+		Tny_free(tmp);
+		free(dump);
+	}
+	Tny_free(root);
+
+	/* Looking up, overwriting and removing keys in a large dictionary. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < 1000; i++) {
+		snprintf(key, sizeof(key), "Key%u", i);
+		root = Tny_add(root, TNY_INT32, key, &i, 0);
+	}
+	for (i = 0; i < 1000; i += 2) {
+		snprintf(key, sizeof(key), "Key%u", i);
+		ui32 = i * 2;
+		root = Tny_add(root, TNY_INT32, key, &ui32, 0);
+	}
+	root = root->root;
+	for (i = 0; i < 1000; i += 3) {
+		snprintf(key, sizeof(key), "Key%u", i);
+		Tny_remove(Tny_get(root, key));
+	}
+	counter = 0;
+	for (i = 0; i < 1000; i++) {
+		snprintf(key, sizeof(key), "Key%u", i);
+		tmp = Tny_get(root, key);
+		if ((i % 3 == 0 && tmp != NULL) || (i % 3 != 0 && (tmp == NULL || tmp->value.num != (i % 2 ? i : i * 2)))) {
+			counter++;
+		}
+	}
+	if (root->index == NULL || root->size != 666 || counter != 0) {
+		printf("Looking up keys in a large dictionary failed!\n");
+		errors++;
+	}
+	if (serialize_deserialize(root)) {
+		printf("Serializing a large dictionary failed!\n");
+		errors++;
+	}
+
+	/* Loading trusted input skips the duplicate key check. */
+	size = Tny_dumps(root, &dump);
+	tmp = Tny_loadsEx(dump, size, TNY_LOAD_TRUSTED);
+	if (tmp == NULL || Tny_cmp(root, tmp) != 0 || Tny_get(tmp, "Key998") == NULL) {
+		printf("Loading a trusted dictionary failed!\n");
+		errors++;
+	}
+	/* The index exists before the first lookup, so lookups from several threads only read. */
+	embedded = Tny_loads(dump, size);
+	if (embedded == NULL || embedded->index == NULL || Tny_get(embedded, "Key998") == NULL) {
+		printf("Loading a large dictionary did not build its index!\n");
+		errors++;
+	}
+	Tny_free(embedded);
+	Tny_free(tmp);
+	free(dump);
+	Tny_free(root);
+
+	/* Loading a document which borrows its keys and binary values. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < 6; i++) {
+		root = Tny_add(root, types[i], keys[i], values[i], sizes[i]);
+	}
+	embedded = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	embedded = Tny_add(embedded, TNY_BIN, NULL, message, strlen(message));
+	root = Tny_add(root, TNY_OBJ, "Sub", embedded, 0);
+	Tny_free(embedded);
+	size = Tny_dumps(root, &dump);
+	tmp = Tny_loadsView(dump, size);
+	if (tmp == NULL || Tny_cmp(root, tmp) != 0 || tmp->docSize != size) {
+		printf("Loading a view of a document failed!\n");
+		errors++;
+	} else {
+		embedded = Tny_get(tmp, keys[0]);
+		if (!(embedded->flags & TNY_BORROWED_KEY) || !(embedded->flags & TNY_BORROWED_VALUE)
+			|| (char*)embedded->value.ptr < (char*)dump || (char*)embedded->value.ptr >= (char*)dump + size
+			|| Tny_at(Tny_get(tmp, "Sub")->value.tny, 0)->flags != TNY_BORROWED_VALUE) {
+			printf("Elements of a view do not point into the data!\n");
+			errors++;
+		}
+
+		/* Overwriting a borrowed value copies the new value. */
+		Tny_add(tmp, TNY_BIN, keys[0], "Other", 5);
+		Tny_remove(Tny_get(tmp, keys[1]));
+		embedded = Tny_get(tmp, keys[0]);
+		if (embedded->flags != TNY_BORROWED_KEY || memcmp(embedded->value.ptr, "Other", 5) != 0
+			|| serialize_deserialize(tmp)) {
+			printf("Modifying a view of a document failed!\n");
+			errors++;
+		}
+	}
+	Tny_free(tmp);
+	free(dump);
+	Tny_free(root);
+
+	/* Walking through a serialized document with a reader. */
+	ui32 = 0xB16B00B5;
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < 6; i++) {
+		root = Tny_add(root, types[i], keys[i], values[i], sizes[i]);
+	}
+	embedded = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	embedded = Tny_add(embedded, TNY_INT32, NULL, &ui32, 0);
+	embedded = Tny_add(embedded, TNY_OBJ, NULL, root, 0);
+	embedded = Tny_add(embedded, TNY_CHAR, NULL, &c, 0);
+	root = Tny_add(root, TNY_OBJ, "Sub", embedded, 0);
+	root = Tny_add(root, TNY_INT64, "Last", &ui64, 0);
+	Tny_free(embedded);
+	size = Tny_dumps(root, &dump);
+
+	counter = 0;
+	if (TnyReader_init(&reader, dump, size) && TnyReader_documentType(&reader) == TNY_DICT) {
+		for (i = 0; TnyReader_next(&reader); i++) {
+			if (i < 6 && (TnyReader_type(&reader) != types[i] || strcmp(TnyReader_key(&reader, NULL), keys[i]) != 0)) {
+				counter++;
+			} else if (i == 7 && (TnyReader_type(&reader) != TNY_INT64 || TnyReader_int64(&reader) != ui64)) {
+				counter++;
+			}
+		}
+		if (i != 8 || reader.error) {
+			counter++;
+		}
+	} else {
+		counter++;
+	}
+
+	/* Entering and leaving sub documents. */
+	if (TnyReader_init(&reader, dump, size)) {
+		while (TnyReader_next(&reader) && strcmp(TnyReader_key(&reader, NULL), "Sub") != 0) {
+			if (TnyReader_type(&reader) == TNY_BIN) {
+				if (TnyReader_bin(&reader, &len) == NULL || len != strlen(message)
+					|| memcmp(TnyReader_bin(&reader, NULL), message, len) != 0) {
+					counter++;
+				}
+			} else if (TnyReader_type(&reader) == TNY_DOUBLE && TnyReader_double(&reader) != flt) {
+				counter++;
+			}
+		}
+		if (!TnyReader_enter(&reader) || TnyReader_documentType(&reader) != TNY_ARRAY
+			|| !TnyReader_next(&reader) || TnyReader_int32(&reader) != ui32
+			|| !TnyReader_next(&reader) || !TnyReader_skip(&reader)
+			|| !TnyReader_next(&reader) || TnyReader_char(&reader) != c
+			|| TnyReader_next(&reader) || !TnyReader_leave(&reader)
+			|| !TnyReader_next(&reader) || strcmp(TnyReader_key(&reader, NULL), "Last") != 0) {
+			counter++;
+		}
+	} else {
+		counter++;
+	}
+
+	/* Leaving a sub document early and reading truncated data. */
+	if (TnyReader_init(&reader, dump, size)) {
+		while (TnyReader_next(&reader) && TnyReader_type(&reader) != TNY_OBJ);
+		if (!TnyReader_enter(&reader) || !TnyReader_leave(&reader) || !TnyReader_next(&reader)
+			|| TnyReader_int64(&reader) != ui64) {
+			counter++;
+		}
+	}
+	if (TnyReader_init(&reader, dump, size - 4)) {
+		while (TnyReader_next(&reader));
+	}
+	if (!reader.error) {
+		counter++;
+	}
+
+	if (counter != 0) {
+		printf("Walking through a document with a reader failed!\n");
+		errors++;
+	}
+	free(dump);
+	Tny_free(root);
+
+	/* Writing a document directly and comparing it with Tny_dumps. */
+	root = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	TnyWriter_init(&writer, NULL, NULL);
+	TnyWriter_begin(&writer, TNY_ARRAY, NULL, TNY_COUNT_UNKNOWN);
+	for (i = 0; i < 6; i++) {
+		root = Tny_add(root, types[i], NULL, values[i], sizes[i]);
+		TnyWriter_add(&writer, types[i], NULL, values[i], sizes[i]);
+	}
+	embedded = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	TnyWriter_begin(&writer, TNY_DICT, NULL, 6);
+	for (i = 0; i < 6; i++) {
+		embedded = Tny_add(embedded, types[i], keys[i], values[i], sizes[i]);
+		TnyWriter_add(&writer, types[i], keys[i], values[i], sizes[i]);
+	}
+	root = Tny_add(root, TNY_OBJ, NULL, embedded, 0);
+	TnyWriter_end(&writer);
+	TnyWriter_end(&writer);
+	Tny_free(embedded);
+	size = Tny_dumps(root, &dump);
+	len = TnyWriter_finish(&writer, &data);
+	if (len != size || memcmp(dump, data, size) != 0) {
+		printf("Writing a document with a writer failed!\n");
+		errors++;
+	}
+	free(data);
+	free(dump);
+	Tny_free(root);
+
+	/* Writing a large document into a sink. */
+	sink.data = NULL;
+	sink.size = 0;
+	TnyWriter_init(&writer, collect, &sink);
+	TnyWriter_begin(&writer, TNY_ARRAY, NULL, 2);
+	TnyWriter_begin(&writer, TNY_ARRAY, NULL, 10000);
+	for (i = 0; i < 10000; i++) {
+		TnyWriter_add(&writer, TNY_INT64, NULL, &ui64, 0);
+	}
+	TnyWriter_end(&writer);
+	counter = sink.size;
+	TnyWriter_begin(&writer, TNY_DICT, NULL, TNY_COUNT_UNKNOWN);
+	for (i = 0; i < 10000; i++) {
+		snprintf(key, sizeof(key), "Key%u", i);
+		TnyWriter_add(&writer, TNY_BIN, key, message, strlen(message));
+	}
+	TnyWriter_end(&writer);
+	TnyWriter_end(&writer);
+	size = TnyWriter_finish(&writer, NULL);
+	root = Tny_loads(sink.data, sink.size);
+	if (counter == 0 || size != sink.size || root == NULL || root->docSize != size
+		|| Tny_at(root, 0)->value.tny->size != 10000 || Tny_get(Tny_at(root, 1)->value.tny, "Key9999") == NULL) {
+		printf("Writing a document into a sink failed!\n");
+		errors++;
+	}
+	Tny_free(root);
+	free(sink.data);
+
+	/* Announcing the wrong number of elements fails. */
+	TnyWriter_init(&writer, NULL, NULL);
+	TnyWriter_begin(&writer, TNY_DICT, NULL, 2);
+	TnyWriter_add(&writer, TNY_INT32, "Key", &ui32, 0);
+	if (TnyWriter_end(&writer) || TnyWriter_finish(&writer, &data) != 0 || data != NULL) {
+		printf("Writing a document with a wrong count did not fail!\n");
+		errors++;
+	}
+
+	/* Serializing into a caller provided buffer and into pieces. */
+	memset(blob, 'x', sizeof(blob));
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	root = Tny_add(root, TNY_BIN, "Small", message, strlen(message));
+	root = Tny_add(root, TNY_BIN, "Large", blob, sizeof(blob));
+	embedded = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	embedded = Tny_add(embedded, TNY_BIN, NULL, blob, sizeof(blob));
+	embedded = Tny_add(embedded, TNY_INT32, NULL, &ui32, 0);
+	root = Tny_add(root, TNY_OBJ, "Sub", embedded, 0);
+	Tny_free(embedded);
+	size = Tny_dumps(root, &dump);
+	data = malloc(size);
+	if (Tny_dumpsInto(root, data, size - 1) != size || Tny_dumpsInto(root, data, size) != size
+		|| memcmp(data, dump, size) != 0) {
+		printf("Serializing into a caller provided buffer failed!\n");
+		errors++;
+	}
+
+	memset(data, 0, size);
+	if (Tny_dumpsIov(root, 100, &iov, &count) == size && count == 5
+		&& iov[1].iov_base == Tny_get(root, "Large")->value.ptr) {
+		for (counter = 0, i = 0; i < count; i++) {
+			memcpy((char*)data + counter, iov[i].iov_base, iov[i].iov_len);
+			counter += iov[i].iov_len;
+		}
+		if (counter != size || memcmp(data, dump, size) != 0) {
+			printf("Serializing into pieces produced wrong data!\n");
+			errors++;
+		}
+	} else {
+		printf("Serializing into pieces failed!\n");
+		errors++;
+	}
+	free(iov);
+	free(data);
+	free(dump);
+	Tny_free(root);
+
+	/* Appending to and indexing into a large array. */
+	root = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	for (i = 0; i < 1000; i++) {
+		Tny_append(root, TNY_INT32, NULL, &i, 0);
+	}
+	counter = 0;
+	for (i = 0; i < 1000; i += 7) {
+		tmp = Tny_at(root, i);
+		if (tmp == NULL || tmp->value.num != i) {
+			counter++;
+		}
+	}
+	if (root->index == NULL || root->tail->value.num != 999 || Tny_at(root, 1000) != NULL) {
+		counter++;
+	}
+
+	/* Removing and inserting elements keeps the positions correct. */
+	Tny_remove(Tny_at(root, 999));
+	Tny_remove(Tny_at(root, 500));
+	ui32 = 5000;
+	Tny_add(Tny_at(root, 9), TNY_INT32, NULL, &ui32, 0);
+	Tny_append(root, TNY_INT32, NULL, &ui32, 0);
+	for (i = 0; i < 1000; i++) {
+		tmp = Tny_at(root, i);
+		if (tmp == NULL || tmp->value.num != (i == 10 || i == 999 ? 5000 : i < 10 ? i : i <= 500 ? i - 1 : i)) {
+			counter++;
+		}
+	}
+	if (counter != 0 || root->size != 1000 || root->tail != Tny_at(root, 999) || serialize_deserialize(root)) {
+		printf("Indexing into a large array failed!\n");
+		errors++;
+	}
+	Tny_free(root);
+
+	/* Inserting into the middle of an arena array updates the index in place. */
+	root = Tny_newArena(TNY_ARRAY, 0);
+	for (i = 0; i < 100; i++) {
+		Tny_append(root, TNY_INT32, NULL, &i, 0);
+	}
+	block = root->index;
+	for (i = 0; i < 200; i++) {
+		Tny_add(Tny_at(root, 49), TNY_INT32, NULL, &i, 0);
+		if (Tny_at(root, 50) == NULL || Tny_at(root, 50)->value.num != i || Tny_at(root, 51)->value.num != 50) {
+			counter++;
+		}
+		Tny_remove(Tny_at(root, 50));
+	}
+	if (counter != 0 || block == NULL || root->index != block || Tny_at(root, 99)->value.num != 99) {
+		printf("Inserting into an indexed arena array rebuilt or broke the index!\n");
+		errors++;
+	}
+	Tny_free(root);
+
+	/* Taking over sub documents instead of copying them. */
+	i = 0;
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	root = Tny_add(root, TNY_INT32, "Depth", &i, 0);
+	for (i = 1; i < 100; i++) {
+		embedded = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+		embedded = Tny_add(embedded, TNY_INT32, "Depth", &i, 0);
+		tmp = root->root;
+		root = Tny_addOwned(embedded, "Child", tmp);
+		if (root == NULL || root->value.tny != tmp) {
+			break;
+		}
+	}
+	root = root->root;
+	counter = 0;
+	for (tmp = root, i = 0; tmp != NULL; tmp = Tny_get(tmp, "Child")->value.tny, i++) {
+		size = Tny_dumps(tmp, &dump);
+		if (size == 0 || size != tmp->docSize || Tny_get(tmp, "Depth")->value.num != 99 - i) {
+			counter++;
+		}
+		free(dump);
+		if (Tny_get(tmp, "Child") == NULL) {
+			break;
+		}
+	}
+	if (i != 99 || counter != 0 || serialize_deserialize(root)) {
+		printf("Taking over sub documents failed!\n");
+		errors++;
+	}
+
+	/* Changing a deep sub document updates the size of every document above. */
+	tmp = Tny_get(Tny_get(root, "Child")->value.tny, "Child")->value.tny;
+	Tny_add(tmp, TNY_BIN, "Message", message, strlen(message));
+	size = root->docSize;
+	Tny_remove(Tny_get(tmp, "Depth"));
+	if (serialize_deserialize(root) || root->docSize != size - 15) {
+		printf("Changing a sub document taken over failed!\n");
+		errors++;
+	}
+
+	/* A document can not take over itself, arena documents copy instead. */
+	embedded = Tny_newArena(TNY_ARRAY, 0);
+	if (Tny_addOwned(tmp, "Loop", root) != NULL || Tny_addOwned(embedded, NULL, root) == NULL
+		|| serialize_deserialize(embedded)) {
+		printf("Taking over a sub document into an arena failed!\n");
+		errors++;
+	}
+	root = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	if (Tny_addOwned(root, NULL, embedded) == NULL || serialize_deserialize(root)) {
+		printf("Taking over an arena document failed!\n");
+		errors++;
+	}
+	Tny_remove(Tny_at(root, 0));
+	if (root->docSize != 5) {
+		printf("Removing an arena document taken over failed!\n");
+		errors++;
+	}
+	Tny_free(root);
+
+	/* Documents can carry an offset index for random access. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < 100; i++) {
+		sprintf(key, "Key%u", i);
+		root = Tny_add(root, TNY_INT32, key, &i, 0);
+	}
+	embedded = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	for (i = 0; i < 50; i++) {
+		embedded = Tny_add(embedded, TNY_INT32, NULL, &i, 0);
+	}
+	root = Tny_add(root, TNY_OBJ, "List", embedded, 0);
+	root = Tny_add(root, TNY_BIN, "Last", message, strlen(message));
+	Tny_free(embedded);
+	size = Tny_dumpsEx(root, &dump, TNY_DUMP_INDEX);
+	tmp = Tny_loads(dump, size);
+	if (size != root->root->docSize + 8 + 102 * 16 + 8 + 50 * 8 || tmp == NULL || Tny_cmp(root, tmp) != 0) {
+		printf("Loading an indexed document failed!\n");
+		errors++;
+	}
+	Tny_free(tmp);
+	if (!TnyReader_init(&reader, dump, size) || !TnyReader_find(&reader, "Key57") || TnyReader_int32(&reader) != 57
+		|| !TnyReader_seek(&reader, 10) || strcmp(TnyReader_key(&reader, NULL), "Key10") != 0
+		|| TnyReader_find(&reader, "Missing") || TnyReader_next(&reader)
+		|| !TnyReader_find(&reader, "List") || !TnyReader_enter(&reader)
+		|| !TnyReader_seek(&reader, 42) || TnyReader_int32(&reader) != 42 || !TnyReader_leave(&reader)
+		|| !TnyReader_next(&reader) || strcmp(TnyReader_key(&reader, NULL), "Last") != 0
+		|| !TnyReader_seek(&reader, 99) || !TnyReader_next(&reader) || !TnyReader_skip(&reader)
+		|| !TnyReader_next(&reader) || TnyReader_type(&reader) != TNY_BIN || TnyReader_next(&reader)) {
+		printf("Random access on an indexed document failed!\n");
+		errors++;
+	}
+	free(dump);
+
+	/* Without an index the reader walks the document instead. */
+	size = Tny_dumps(root, &dump);
+	if (!TnyReader_init(&reader, dump, size) || !TnyReader_find(&reader, "Key57") || TnyReader_int32(&reader) != 57
+		|| !TnyReader_seek(&reader, 10) || strcmp(TnyReader_key(&reader, NULL), "Key10") != 0
+		|| TnyReader_find(&reader, "Missing") || TnyReader_seek(&reader, 102)
+		|| !TnyReader_find(&reader, "List") || !TnyReader_enter(&reader)
+		|| !TnyReader_seek(&reader, 42) || TnyReader_int32(&reader) != 42 || !TnyReader_leave(&reader)
+		|| !TnyReader_next(&reader) || strcmp(TnyReader_key(&reader, NULL), "Last") != 0) {
+		printf("Random access on a plain document failed!\n");
+		errors++;
+	}
+	free(dump);
+	Tny_free(root);
+
+	/* The compact encoding writes small numbers and lengths in a single byte. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < 6; i++) {
+		root = Tny_add(root, types[i], keys[i], values[i], sizes[i]);
+	}
+	i = -5;
+	root = Tny_add(root, TNY_INT32, "Negative", &i, 0);
+	i = 7;
+	root = Tny_add(root, TNY_INT32, "Small", &i, 0);
+	root = Tny_add(root, TNY_BIN, "Blob", blob, 200);
+	embedded = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	for (i = 0; i < 20; i++) {
+		embedded = Tny_add(embedded, TNY_INT64, NULL, &ui64, 0);
+		embedded = Tny_add(embedded, TNY_INT32, NULL, &i, 0);
+	}
+	root = Tny_add(root, TNY_OBJ, "Sub", embedded, 0);
+	Tny_free(embedded);
+	root = root->root;
+	size = Tny_dumpsEx(root, &dump, TNY_DUMP_COMPACT);
+	tmp = Tny_loads(dump, size);
+	if (size == 0 || size >= root->docSize || tmp == NULL || Tny_cmp(root, tmp) != 0
+		|| Tny_get(tmp, "Negative")->value.num != (uint32_t)-5) {
+		printf("Loading a compact document failed!\n");
+		errors++;
+	}
+	Tny_free(tmp);
+	free(dump);
+
+	/* Compact documents can carry an index as well. */
+	size = Tny_dumpsEx(root, &dump, TNY_DUMP_COMPACT | TNY_DUMP_INDEX);
+	tmp = Tny_loads(dump, size);
+	if (size == 0 || tmp == NULL || Tny_cmp(root, tmp) != 0
+		|| !TnyReader_init(&reader, dump, size) || !TnyReader_find(&reader, "Key2") || TnyReader_int32(&reader) != ui32
+		|| !TnyReader_find(&reader, "Negative") || TnyReader_int32(&reader) != (uint32_t)-5
+		|| !TnyReader_next(&reader) || TnyReader_int32(&reader) != 7
+		|| !TnyReader_next(&reader) || TnyReader_bin(&reader, &len) == NULL || len != 200
+		|| !TnyReader_find(&reader, "Sub") || !TnyReader_enter(&reader)
+		|| !TnyReader_seek(&reader, 38) || TnyReader_int64(&reader) != ui64
+		|| !TnyReader_next(&reader) || TnyReader_int32(&reader) != 19 || !TnyReader_leave(&reader)
+		|| !TnyReader_find(&reader, "Key3") || TnyReader_int64(&reader) != ui64) {
+		printf("Reading a compact document failed!\n");
+		errors++;
+	}
+	Tny_free(tmp);
+	free(dump);
+	Tny_free(root);
+
+	/* Large binary values and whole documents can be compressed. */
+	for (i = 0; i < sizeof(blob); i++) {
+		blob[i] = i % 7 == 0 ? 'A' + i % 13 : 'x';
+	}
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	root = Tny_add(root, TNY_BIN, "Pattern", blob, sizeof(blob));
+	root = Tny_add(root, TNY_BIN, "Small", message, strlen(message));
+	memset(blob, 'z', sizeof(blob));
+	root = Tny_add(root, TNY_BIN, "Run", blob, sizeof(blob));
+	for (i = 0, counter = 1; i < sizeof(blob); i++) {
+		counter ^= counter << 13;
+		counter ^= counter >> 17;
+		counter ^= counter << 5;
+		blob[i] = counter;
+	}
+	root = Tny_add(root, TNY_BIN, "Noise", blob, sizeof(blob));
+	root = root->root;
+	for (counter = 0; counter < 4; counter++) {
+		size = Tny_dumpsEx(root, &dump, TNY_DUMP_COMPRESS_BIN | (counter & 1 ? TNY_DUMP_COMPACT : 0)
+			| (counter & 2 ? TNY_DUMP_INDEX : 0));
+		tmp = Tny_loads(dump, size);
+		embedded = Tny_loadsView(dump, size);
+		if (size == 0 || size >= root->docSize - 1000 || tmp == NULL || Tny_cmp(root, tmp) != 0
+			|| embedded == NULL || Tny_cmp(root, embedded) != 0) {
+			printf("Loading compressed binary values failed!\n");
+			errors++;
+		}
+		Tny_free(embedded);
+		if (!TnyReader_init(&reader, dump, size) || !TnyReader_next(&reader)
+			|| TnyReader_bin(&reader, &len) != NULL || len != sizeof(blob)
+			|| TnyReader_binInto(&reader, key, sizeof(key)) || !TnyReader_binInto(&reader, blob, sizeof(blob))
+			|| memcmp(blob, Tny_get(tmp, "Pattern")->value.ptr, sizeof(blob)) != 0
+			|| !TnyReader_next(&reader) || !TnyReader_binInto(&reader, key, sizeof(key)) || memcmp(key, message, 7) != 0
+			|| !TnyReader_find(&reader, "Noise") || TnyReader_bin(&reader, &len) == NULL || len != sizeof(blob)) {
+			printf("Reading compressed binary values failed!\n");
+			errors++;
+		}
+		Tny_free(tmp);
+		free(dump);
+	}
+
+	size = Tny_dumpsEx(root, &dump, TNY_DUMP_COMPRESS);
+	tmp = Tny_loads(dump, size);
+	embedded = Tny_loadsView(dump, size);
+	if (size == 0 || size >= root->docSize - 1000 || tmp == NULL || Tny_cmp(root, tmp) != 0
+		|| embedded == NULL || Tny_cmp(root, embedded) != 0 || TnyReader_init(&reader, dump, size)) {
+		printf("Loading a compressed document failed!\n");
+		errors++;
+	}
+	Tny_free(tmp);
+	Tny_free(embedded);
+	((char*)dump)[size / 2] ^= 0x5A;
+	tmp = Tny_loads(dump, size);
+	if (Tny_loads(dump, size / 2) != NULL || (tmp != NULL && Tny_cmp(root, tmp) == 0)) {
+		printf("Loading a corrupted compressed document failed!\n");
+		errors++;
+	}
+	Tny_free(tmp);
+	free(dump);
+	Tny_free(root);
+
+	/* Documents can be loaded straight from a file. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < 6; i++) {
+		root = Tny_add(root, types[i], keys[i], values[i], sizes[i]);
+	}
+	root = Tny_add(root, TNY_BIN, "Blob", blob, sizeof(blob));
+	root = root->root;
+	size = Tny_dumps(root, &dump);
+	file = createTempFile(filename);
+	if (file == NULL || fwrite(dump, 1, size, file) != size || fclose(file) != 0) {
+		printf("Writing the test file failed!\n");
+		errors++;
+	}
+	free(dump);
+	tmp = file != NULL ? Tny_loadFile(filename, TNY_LOAD_DEFAULT) : NULL;
+	embedded = file != NULL ? Tny_loadFile(filename, TNY_LOAD_VIEW) : NULL;
+	if (tmp == NULL || Tny_cmp(root, tmp) != 0 || embedded == NULL || Tny_cmp(root, embedded) != 0
+		|| Tny_loadFile("tny-missing.tny", TNY_LOAD_DEFAULT) != NULL) {
+		printf("Loading a document from a file failed!\n");
+		errors++;
+	}
+	Tny_free(tmp);
+	Tny_free(embedded);
+	if (file != NULL) {
+		remove(filename);
+	}
+	Tny_free(root);
+
+	/* Documents can be parsed from pieces as they arrive. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < 6; i++) {
+		root = Tny_add(root, types[i], keys[i], values[i], sizes[i]);
+	}
+	memset(blob, 'p', sizeof(blob));
+	root = Tny_add(root, TNY_BIN, "Blob", blob, sizeof(blob));
+	embedded = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	for (i = 0; i < 20; i++) {
+		embedded = Tny_add(embedded, TNY_INT32, NULL, &i, 0);
+	}
+	embedded = Tny_add(embedded, TNY_OBJ, NULL, root, 0);
+	root = Tny_add(root, TNY_OBJ, "Sub", embedded, 0);
+	Tny_free(embedded);
+	root = root->root;
+	for (counter = 0; counter < 6 * 4; counter++) {
+		size = Tny_dumpsEx(root, &dump, (int[]){TNY_DUMP_DEFAULT, TNY_DUMP_COMPACT | TNY_DUMP_INDEX,
+			TNY_DUMP_COMPRESS_BIN, TNY_DUMP_COMPRESS, TNY_DUMP_INDEX | TNY_DUMP_COMPRESS_BIN,
+			TNY_DUMP_COMPACT | TNY_DUMP_COMPRESS}[counter / 4]);
+		TnyParser_init(&parser, counter % 2 ? TNY_LOAD_ARENA : TNY_LOAD_DEFAULT);
+		len = (uint32_t[]){1, 3, 64, size}[counter % 4];
+		for (i = 0; i < size && TnyParser_feed(&parser, (char*)dump + i, i + len < size ? len : size - i, NULL) == TNY_PARSE_MORE; i += len);
+		tmp = TnyParser_finish(&parser);
+		if (tmp == NULL || Tny_cmp(root, tmp) != 0 || tmp->docSize != root->docSize) {
+			printf("Parsing a document in pieces of %u bytes failed!\n", len);
+			errors++;
+		}
+		Tny_free(tmp);
+		free(dump);
+	}
+
+	/* The parser stops at the end of the document and reports truncated or corrupted data. */
+	size = Tny_dumps(root, &dump);
+	data = malloc(2 * size);
+	memcpy(data, dump, size);
+	memcpy((char*)data + size, dump, size);
+	TnyParser_init(&parser, TNY_LOAD_DEFAULT);
+	if (TnyParser_feed(&parser, data, size / 2, &count) != TNY_PARSE_MORE || count != size / 2
+		|| TnyParser_feed(&parser, (char*)data + size / 2, size + 10, &count) != TNY_PARSE_DONE
+		|| count != size - size / 2 || (tmp = TnyParser_finish(&parser)) == NULL || Tny_cmp(root, tmp) != 0) {
+		printf("Parsing a stream of documents failed!\n");
+		errors++;
+	}
+	Tny_free(tmp);
+	TnyParser_init(&parser, TNY_LOAD_ARENA);
+	TnyParser_feed(&parser, dump, size - 1, NULL);
+	if (TnyParser_finish(&parser) != NULL) {
+		printf("Parsing a truncated document did not fail!\n");
+		errors++;
+	}
+	((char*)dump)[0] = 0x09;
+	TnyParser_init(&parser, TNY_LOAD_DEFAULT);
+	if (TnyParser_feed(&parser, dump, size, NULL) != TNY_PARSE_ERROR || TnyParser_finish(&parser) != NULL) {
+		printf("Parsing a corrupted document did not fail!\n");
+		errors++;
+	}
+	free(data);
+	free(dump);
+	Tny_free(root);
+
+	/* A sub document with a duplicate key replaces the earlier element. */
+	ui32 = 3;
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	root = Tny_add(root, TNY_INT32, "a", &ui32, 0);
+	root = Tny_add(root, TNY_INT32, "b", &ui32, 0);
+	embedded = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	embedded = Tny_add(embedded, TNY_INT32, "x", &ui32, 0);
+	root = Tny_addOwned(root, "c", embedded->root);
+	root = root->root;
+	changed = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	changed = Tny_add(changed, TNY_OBJ, "a", embedded->root, 0);
+	changed = Tny_add(changed, TNY_INT32, "b", &ui32, 0);
+	changed = changed->root;
+	for (counter = 0; counter < 2 * 3; counter++) {
+		size = Tny_dumpsEx(root, &dump, counter / 3 ? TNY_DUMP_KEYS : TNY_DUMP_DEFAULT);
+		for (i = 0; i + 1 < size && memcmp((char*)dump + i, "c", 2) != 0; i++);
+		((char*)dump)[i] = 'a';
+		if (counter % 3 == 0) {
+			tmp = Tny_loads(dump, size);
+		} else {
+			TnyParser_init(&parser, counter % 3 == 2 ? TNY_LOAD_ARENA : TNY_LOAD_DEFAULT);
+			for (i = 0; i < size && TnyParser_feed(&parser, (char*)dump + i, 1, NULL) == TNY_PARSE_MORE; i++);
+			tmp = TnyParser_finish(&parser);
+		}
+		if (tmp == NULL || Tny_cmp(changed, tmp) != 0 || tmp->docSize != changed->docSize
+				|| Tny_get(tmp, "a")->value.tny == NULL || Tny_get(tmp, "b")->type != TNY_INT32) {
+			printf("Loading a sub document with a duplicate key failed!\n");
+			errors++;
+		}
+		Tny_free(tmp);
+		free(dump);
+	}
+	Tny_free(changed);
+	Tny_free(root);
+	changed = NULL;
+
+	/* Large arrays are loaded on several threads with the same result. */
+	root = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	for (i = 0; i < 5000; i++) {
+		embedded = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+		embedded = Tny_add(embedded, TNY_BIN, "Name", blob, i % 100);
+		embedded = Tny_add(embedded, TNY_INT32, "Nr", &i, 0);
+		root = Tny_addOwned(root, NULL, embedded->root);
+		root = Tny_add(root, TNY_INT64, NULL, &ui64, 0);
+	}
+	root = root->root;
+	for (counter = 0; counter < 5 * 3; counter++) {
+		size = Tny_dumpsEx(root, &dump, (int[]){TNY_DUMP_DEFAULT, TNY_DUMP_INDEX, TNY_DUMP_COMPACT,
+			TNY_DUMP_COMPACT | TNY_DUMP_INDEX, TNY_DUMP_COMPRESS}[counter / 3]);
+		tmp = Tny_loadsParallel(dump, size, (int[]){TNY_LOAD_DEFAULT, TNY_LOAD_ARENA, TNY_LOAD_VIEW}[counter % 3], 4);
+		if (tmp == NULL || Tny_cmp(root, tmp) != 0 || tmp->size != root->size || tmp->docSize != root->docSize
+			|| Tny_at(tmp, 7777)->root != tmp || Tny_at(tmp, 7776)->value.tny->docSizePtr != &tmp->docSize
+			|| tmp->tail != Tny_at(tmp, tmp->size - 1)) {
+			printf("Loading a large array on several threads failed!\n");
+			errors++;
+		}
+		Tny_free(tmp);
+		free(dump);
+	}
+	size = Tny_dumps(root, &dump);
+	tmp = Tny_loadsParallel(dump, size - 100, TNY_LOAD_DEFAULT, 4);
+	embedded = Tny_loads(dump, size - 100);
+	if (tmp == NULL || embedded == NULL || Tny_cmp(tmp, embedded) != 0 || tmp->size != embedded->size) {
+		printf("Loading a truncated array on several threads failed!\n");
+		errors++;
+	}
+	Tny_free(tmp);
+	Tny_free(embedded);
+	/* Sub documents of an arena loaded on several threads can still be changed. */
+	tmp = Tny_loadsParallel(dump, size, TNY_LOAD_ARENA, 4);
+	embedded = tmp != NULL ? Tny_at(tmp, 9000)->value.tny : NULL;
+	if (embedded == NULL || embedded->arena != tmp->arena
+			|| Tny_add(embedded, TNY_BIN, "Blob", blob, sizeof(blob)) == NULL
+			|| Tny_get(embedded, "Blob") == NULL || Tny_at(tmp, 9000)->value.tny->size != 3) {
+		printf("Changing a sub document of an array loaded on several threads failed!\n");
+		errors++;
+	}
+	if (tmp != NULL) {
+		Tny_remove(Tny_get(embedded, "Name"));
+		Tny_remove(Tny_at(tmp, 9000));
+		Tny_remove(Tny_at(tmp, 8000));
+		if (tmp->size != root->size - 2 || Tny_at(tmp, 9000)->type != TNY_OBJ) {
+			printf("Removing a sub document of an array loaded on several threads failed!\n");
+			errors++;
+		}
+	}
+	Tny_free(tmp);
+	free(dump);
+	Tny_free(root);
+
+	/* Large documents are serialized on several threads with the same result. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < 20000; i++) {
+		snprintf(key, sizeof(key), "key%u", i);
+		if (i % 1000 == 0) {
+			embedded = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+			embedded = Tny_add(embedded, TNY_BIN, NULL, blob, sizeof(blob));
+			root = Tny_addOwned(root, key, embedded->root);
+		} else {
+			root = Tny_add(root, TNY_BIN, key, blob, i % 50);
+		}
+	}
+	root = root->root;
+	for (counter = 0; counter < 3; counter++) {
+		flags = (int[]){TNY_DUMP_DEFAULT, TNY_DUMP_COMPRESS, TNY_DUMP_INDEX}[counter];
+		size = Tny_dumpsEx(root, &dump, flags);
+		count = Tny_dumpsParallel(root, &data, flags, 4);
+		if (data == NULL || count != size || memcmp(data, dump, size) != 0) {
+			printf("Serializing a large document on several threads failed!\n");
+			errors++;
+		}
+		free(data);
+		free(dump);
+	}
+	Tny_free(root);
+
+	/* Numeric arrays are stored packed in one buffer and as one run on the wire. */
+	for (i = 0; i < 1000; i++) {
+		samples[i] = i * 0.25;
+		ids[i] = i * 7;
+		stamps[i] = 1400000000000ull + i;
+	}
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	root = Tny_add(root, TNY_PACKED_DOUBLE, "Samples", samples, 1000);
+	root = Tny_add(root, TNY_PACKED_INT32, "Ids", ids, 1000);
+	root = Tny_add(root, TNY_PACKED_INT64, "Stamps", stamps, 1000);
+	root = Tny_add(root, TNY_PACKED_INT32, "Empty", ids, 0);
+	root = root->root;
+	size = Tny_dumps(root, &dump);
+	/* The second sample (0.25) is stored little-endian behind the header, the key and the count. */
+	if (size != root->docSize || size != 5 + 4 * 9 + 8 + 4 + 7 + 6 + 1000 * (8 + 4 + 8)
+		|| ((double*)Tny_get(root, "Samples")->value.ptr)[999] != 999 * 0.25 || ((char*)dump)[5] != TNY_PACKED_DOUBLE
+		|| ((unsigned char*)dump)[22 + 8 + 6] != 0xD0 || ((unsigned char*)dump)[22 + 8 + 7] != 0x3F) {
+		printf("Serializing packed arrays failed!\n");
+		errors++;
+	}
+	free(dump);
+	for (counter = 0; counter < 3 * 3; counter++) {
+		size = Tny_dumpsEx(root, &dump, (int[]){TNY_DUMP_DEFAULT, TNY_DUMP_COMPACT | TNY_DUMP_INDEX, TNY_DUMP_COMPRESS}[counter / 3]);
+		tmp = Tny_loadsEx(dump, size, (int[]){TNY_LOAD_DEFAULT, TNY_LOAD_ARENA, TNY_LOAD_VIEW}[counter % 3]);
+		free(dump);
+		if (tmp == NULL || tmp->size != 4 || tmp->docSize != root->docSize
+			|| Tny_get(tmp, "Ids")->size != 1000 || memcmp(Tny_get(tmp, "Ids")->value.ptr, ids, sizeof(ids)) != 0
+			|| memcmp(Tny_get(tmp, "Stamps")->value.ptr, stamps, sizeof(stamps)) != 0
+			|| memcmp(Tny_get(tmp, "Samples")->value.ptr, samples, sizeof(samples)) != 0) {
+			printf("Loading packed arrays failed!\n");
+			errors++;
+		}
+		Tny_free(tmp);
+	}
+	size = Tny_dumps(root, &dump);
+	memset(stamps, 0, sizeof(stamps));
+	if (!TnyReader_init(&reader, dump, size) || !TnyReader_next(&reader) || !TnyReader_next(&reader)
+		|| TnyReader_packed(&reader, NULL, 0) != 1000 || !TnyReader_next(&reader)
+		|| TnyReader_packed(&reader, stamps, 10) != 1000 || stamps[0] != 0
+		|| TnyReader_packed(&reader, stamps, 1000) != 1000 || stamps[999] != 1400000000999ull
+		|| !TnyReader_next(&reader) || TnyReader_packed(&reader, stamps, 1000) != 0 || TnyReader_type(&reader) != TNY_PACKED_INT32
+		|| TnyReader_next(&reader) || reader.error) {
+		printf("Reading packed arrays failed!\n");
+		errors++;
+	}
+	TnyParser_init(&parser, TNY_LOAD_DEFAULT);
+	for (i = 0; i < size && TnyParser_feed(&parser, (char*)dump + i, i + 3 < size ? 3 : size - i, NULL) == TNY_PARSE_MORE; i += 3);
+	tmp = TnyParser_finish(&parser);
+	TnyWriter_init(&writer, NULL, NULL);
+	TnyWriter_begin(&writer, TNY_DICT, NULL, 4);
+	TnyWriter_add(&writer, TNY_PACKED_DOUBLE, "Samples", samples, 1000);
+	TnyWriter_add(&writer, TNY_PACKED_INT32, "Ids", ids, 1000);
+	TnyWriter_add(&writer, TNY_PACKED_INT64, "Stamps", stamps, 1000);
+	TnyWriter_add(&writer, TNY_PACKED_INT32, "Empty", ids, 0);
+	TnyWriter_end(&writer);
+	len = TnyWriter_finish(&writer, &data);
+	if (tmp == NULL || tmp->docSize != root->docSize || memcmp(Tny_get(tmp, "Samples")->value.ptr, samples, sizeof(samples)) != 0
+		|| len != size || memcmp(data, dump, size) != 0) {
+		printf("Parsing or writing packed arrays failed!\n");
+		errors++;
+	}
+	free(data);
+	Tny_free(tmp);
+	embedded = Tny_copy(NULL, root);
+	if (embedded == NULL || embedded->docSize != root->docSize
+		|| memcmp(Tny_get(embedded, "Ids")->value.ptr, ids, sizeof(ids)) != 0) {
+		printf("Copying packed arrays failed!\n");
+		errors++;
+	}
+	Tny_free(embedded);
+	free(dump);
+	Tny_free(root);
+
+	/* Untrusted data is validated without loading it. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < 6; i++) {
+		root = Tny_add(root, types[i], keys[i], values[i], sizes[i]);
+	}
+	memset(blob, 'v', sizeof(blob));
+	root = Tny_add(root, TNY_BIN, "Blob", blob, sizeof(blob));
+	root = Tny_add(root, TNY_PACKED_INT32, "Ids", ids, 100);
+	embedded = NULL;
+	for (i = 0; i < 9; i++) {
+		tmp = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+		tmp = Tny_add(tmp, TNY_INT32, NULL, &i, 0);
+		if (embedded != NULL) {
+			tmp = Tny_addOwned(tmp, NULL, embedded);
+		}
+		embedded = tmp->root;
+	}
+	root = Tny_addOwned(root, "Deep", embedded);
+	root = root->root;
+	for (counter = 0; counter < 6; counter++) {
+		size = Tny_dumpsEx(root, &dump, (int[]){TNY_DUMP_DEFAULT, TNY_DUMP_INDEX, TNY_DUMP_COMPACT | TNY_DUMP_INDEX,
+			TNY_DUMP_COMPRESS_BIN, TNY_DUMP_COMPRESS, TNY_DUMP_COMPACT | TNY_DUMP_COMPRESS_BIN}[counter]);
+		if (!Tny_validate(dump, size, NULL) || Tny_validate(dump, size - 1, NULL)) {
+			printf("Validating a document failed!\n");
+			errors++;
+		}
+		free(dump);
+	}
+	size = Tny_dumps(root, &dump);
+	memset(&limits, 0, sizeof(limits));
+	limits.maxDepth = 10;
+	if (!Tny_validate(dump, size, &limits)) {
+		printf("Validating a document within the depth limit failed!\n");
+		errors++;
+	}
+	limits.maxDepth = 9;
+	if (Tny_validate(dump, size, &limits)) {
+		printf("Validating a document beyond the depth limit did not fail!\n");
+		errors++;
+	}
+	memset(&limits, 0, sizeof(limits));
+	limits.maxElements = 9 + 17;
+	if (!Tny_validate(dump, size, &limits) || (limits.maxElements--, Tny_validate(dump, size, &limits))) {
+		printf("Validating the element budget failed!\n");
+		errors++;
+	}
+	memset(&limits, 0, sizeof(limits));
+	limits.maxValueSize = sizeof(blob) - 1;
+	if (Tny_validate(dump, size, &limits)) {
+		printf("Validating the value size limit did not fail!\n");
+		errors++;
+	}
+	data = malloc(size + 1);
+	memcpy(data, dump, size);
+	((char*)data)[size] = 0;
+	if (Tny_validate(data, size + 1, NULL)) {
+		printf("Validating a document with trailing data did not fail!\n");
+		errors++;
+	}
+	/* Every corruption the validator lets through has to load safely. */
+	for (i = 0; i < size; i++) {
+		memcpy(data, dump, size);
+		((char*)data)[i] ^= (i % 2) ? 0x01 : 0x80;
+		tmp = Tny_loadsEx(data, size, TNY_LOAD_VALIDATE);
+		if (Tny_validate(data, size, NULL) != (tmp != NULL)) {
+			printf("Loading a validated document failed at byte %u!\n", i);
+			errors++;
+		}
+		Tny_free(tmp);
+	}
+	((char*)dump)[5 + 4 + 5] = 'X';
+	if (Tny_validate(dump, size, NULL) || Tny_loadsEx(dump, size, TNY_LOAD_VALIDATE) != NULL) {
+		printf("Validating a key without terminator did not fail!\n");
+		errors++;
+	}
+	free(data);
+	free(dump);
+
+	/* Loading untrusted data applies the limits. */
+	size = Tny_dumpsEx(root, &dump, TNY_DUMP_COMPRESS);
+	memset(&limits, 0, sizeof(limits));
+	limits.maxDepth = 9;
+	if (Tny_loadsLimited(dump, size, TNY_LOAD_DEFAULT, &limits) != NULL) {
+		printf("Loading a document beyond the depth limit did not fail!\n");
+		errors++;
+	}
+	limits.maxDepth = 10;
+	limits.maxElements = 9 + 16;
+	if (Tny_loadsLimited(dump, size, TNY_LOAD_ARENA, &limits) != NULL) {
+		printf("Loading a document beyond the element budget did not fail!\n");
+		errors++;
+	}
+	limits.maxElements++;
+	tmp = Tny_loadsLimited(dump, size, TNY_LOAD_ARENA, &limits);
+	if (tmp == NULL || Tny_cmp(root, tmp) != 0) {
+		printf("Loading a document within the limits failed!\n");
+		errors++;
+	}
+	Tny_free(tmp);
+	free(dump);
+	Tny_free(root);
+
+	/* Dictionary keys are written once into a key table and shared after loading. */
+	root = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	for (i = 0; i < 5000; i++) {
+		tmp = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+		tmp = Tny_add(tmp, TNY_BIN, "Name", message, strlen(message));
+		tmp = Tny_add(tmp, TNY_BIN, "Street", "Main Street", 11);
+		tmp = Tny_add(tmp, TNY_INT32, "Nr", &i, 0);
+		embedded = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+		embedded = Tny_add(embedded, TNY_DOUBLE, "Lat", &flt, 0);
+		embedded = Tny_add(embedded, TNY_DOUBLE, "Lon", &flt, 0);
+		tmp = Tny_addOwned(tmp, "Geo", embedded->root);
+		root = Tny_addOwned(root, NULL, tmp->root);
+	}
+	root = root->root;
+	count = Tny_dumps(root, &data);
+	free(data);
+	for (counter = 0; counter < 5; counter++) {
+		flags = (int[]){TNY_DUMP_KEYS, TNY_DUMP_KEYS | TNY_DUMP_COMPACT, TNY_DUMP_KEYS | TNY_DUMP_INDEX,
+			TNY_DUMP_KEYS | TNY_DUMP_COMPACT | TNY_DUMP_INDEX, TNY_DUMP_KEYS | TNY_DUMP_COMPRESS}[counter];
+		size = Tny_dumpsEx(root, &dump, flags);
+		if (size == 0 || (flags == TNY_DUMP_KEYS && size >= count)) {
+			printf("Dumping a document with a key table failed!\n");
+			errors++;
+		}
+		for (i = 0; i < 5; i++) {
+			tmp = Tny_loadsParallel(dump, size, (int[]){TNY_LOAD_DEFAULT, TNY_LOAD_ARENA, TNY_LOAD_VIEW,
+				TNY_LOAD_VALIDATE | TNY_LOAD_TRUSTED, TNY_LOAD_ARENA}[i], i < 4 ? 1 : 4);
+			if (tmp == NULL || Tny_cmp(root, tmp) != 0 || tmp->docSize != root->docSize
+					|| Tny_at(tmp, 0)->value.tny->next->key != Tny_at(tmp, 4999)->value.tny->next->key) {
+				printf("Loading a document with a key table failed!\n");
+				errors++;
+			}
+			Tny_free(tmp);
+		}
+		if (!(flags & TNY_DUMP_COMPRESS) && (!Tny_validate(dump, size, NULL) || !TnyReader_init(&reader, dump, size)
+				|| !TnyReader_next(&reader) || !TnyReader_enter(&reader) || !TnyReader_next(&reader)
+				|| !TnyReader_next(&reader) || strcmp(TnyReader_key(&reader, &len), "Street") != 0 || len != 6)) {
+			printf("Reading a document with a key table failed!\n");
+			errors++;
+		}
+		TnyParser_init(&parser, TNY_LOAD_DEFAULT);
+		for (i = 0; i < size && TnyParser_feed(&parser, (char*)dump + i, 1, NULL) == TNY_PARSE_MORE; i++);
+		tmp = TnyParser_finish(&parser);
+		if (tmp == NULL || Tny_cmp(root, tmp) != 0) {
+			printf("Parsing a document with a key table failed!\n");
+			errors++;
+		}
+		Tny_free(tmp);
+		free(dump);
+	}
+	/* A reference behind the end of the table is rejected. */
+	size = Tny_dumpsEx(root, &dump, TNY_DUMP_KEYS);
+	((char*)dump)[5] = 5;
+	tmp = Tny_loads(dump, size);
+	if ((tmp != NULL && Tny_cmp(root, tmp) == 0) || Tny_validate(dump, size, NULL)
+			|| Tny_loadsEx(dump, size, TNY_LOAD_VALIDATE) != NULL) {
+		printf("Loading a document with a broken key table did not fail!\n");
+		errors++;
+	}
+	Tny_free(tmp);
+	free(dump);
+	Tny_free(root);
+
+	/* Structs are encoded and decoded through field descriptors. */
+	codec = TnyCodec_create(addressFields, 6);
+	memset(&address, 0, sizeof(address));
+	strcpy(address.name, "John Doe");
+	strcpy(address.street, "Some street name");
+	address.nr = 10;
+	address.stamp = ui64;
+	address.position[0] = flt;
+	address.position[2] = -flt;
+	address.flag = c;
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	root = Tny_add(root, TNY_BIN, "Name", address.name, strlen(address.name));
+	root = Tny_add(root, TNY_BIN, "Street", address.street, strlen(address.street));
+	root = Tny_add(root, TNY_INT32, "Nr", &address.nr, 0);
+	root = Tny_add(root, TNY_INT64, "Stamp", &address.stamp, 0);
+	root = Tny_add(root, TNY_PACKED_DOUBLE, "Position", address.position, 3);
+	root = Tny_add(root, TNY_CHAR, "Flag", &address.flag, 0);
+	root = root->root;
+	for (counter = 0; counter < 2; counter++) {
+		flags = counter == 0 ? TNY_DUMP_DEFAULT : TNY_DUMP_COMPACT;
+		size = TnyCodec_encode(codec, &address, &dump, flags);
+		count = Tny_dumpsEx(root, &data, flags);
+		if (codec == NULL || size == 0 || size != count || memcmp(dump, data, size) != 0) {
+			printf("Encoding a struct failed!\n");
+			errors++;
+		}
+		memset(&decoded, 0, sizeof(decoded));
+		if (!TnyCodec_decode(codec, dump, size, &decoded) || memcmp(&address, &decoded, sizeof(Address)) != 0) {
+			printf("Decoding a struct failed!\n");
+			errors++;
+		}
+		if (TnyCodec_decode(codec, dump, size - 1, &decoded)) {
+			printf("Decoding a truncated struct did not fail!\n");
+			errors++;
+		}
+		free(data);
+		free(dump);
+	}
+	size = Tny_dumps(root, &dump);
+	memset(blob, 0, sizeof(blob));
+	if (TnyCodec_encodeInto(codec, &address, blob, 10, TNY_DUMP_DEFAULT) != size || blob[0] != 0
+			|| TnyCodec_encodeInto(codec, &address, blob, sizeof(blob), TNY_DUMP_DEFAULT) != size
+			|| memcmp(blob, dump, size) != 0 || TnyCodec_encode(codec, &address, &data, TNY_DUMP_INDEX) != 0) {
+		printf("Encoding a struct into a buffer failed!\n");
+		errors++;
+	}
+	free(dump);
+	Tny_free(root);
+	/* Keys in another order, unknown keys and other encodings are matched by hash. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	root = Tny_add(root, TNY_CHAR, "Flag", &c, 0);
+	root = Tny_add(root, TNY_BIN, "Unknown", blob, 100);
+	root = Tny_add(root, TNY_INT32, "Nr", &ui32, 0);
+	root = Tny_add(root, TNY_BIN, "Name", "Jane", 4);
+	root = root->root;
+	size = Tny_dumpsEx(root, &dump, TNY_DUMP_INDEX | TNY_DUMP_KEYS | TNY_DUMP_COMPACT);
+	memset(&decoded, 0, sizeof(decoded));
+	if (!TnyCodec_decode(codec, dump, size, &decoded) || decoded.nr != ui32 || decoded.flag != c
+			|| strcmp(decoded.name, "Jane") != 0 || decoded.street[0] != '\0') {
+		printf("Decoding a struct in another order failed!\n");
+		errors++;
+	}
+	free(dump);
+	/* Values which do not fit are rejected. */
+	Tny_add(root, TNY_BIN, "Name", "A name longer than the member", 29);
+	size = Tny_dumps(root, &dump);
+	if (TnyCodec_decode(codec, dump, size, &decoded)) {
+		printf("Decoding a string which does not fit did not fail!\n");
+		errors++;
+	}
+	free(dump);
+	Tny_add(root, TNY_INT64, "Nr", &ui64, 0);
+	size = Tny_dumps(root, &dump);
+	if (TnyCodec_decode(codec, dump, size, &decoded)) {
+		printf("Decoding a value of another type did not fail!\n");
+		errors++;
+	}
+	free(dump);
+	Tny_free(root);
+	TnyCodec_free(codec);
+	codec = TnyCodec_create((TnyField[]){{"Nr", TNY_INT32, 0, 0}, {"Nr", TNY_INT64, 0, 0}}, 2);
+	if (codec != NULL || TnyCodec_create((TnyField[]){{"Name", TNY_BIN, 0, 0}}, 1) != NULL
+			|| TnyCodec_create((TnyField[]){{"Doc", TNY_OBJ, 0, 0}}, 1) != NULL) {
+		printf("Creating an invalid codec did not fail!\n");
+		errors++;
+	}
+
+	/* Compiled paths select a value of the serialized data. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < 20; i++) {
+		sprintf(key, "Key%u", i);
+		root = Tny_add(root, TNY_INT32, key, &i, 0);
+	}
+	embedded = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	for (i = 0; i < 3; i++) {
+		embedded = Tny_add(embedded, TNY_INT32, NULL, &i, 0);
+	}
+	tmp = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	tmp = Tny_add(tmp, TNY_BIN, "c", message, strlen(message));
+	embedded = Tny_add(embedded, TNY_OBJ, NULL, tmp->root, 0);
+	Tny_free(tmp);
+	tmp = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	tmp = Tny_add(tmp, TNY_OBJ, "b", embedded->root, 0);
+	Tny_free(embedded);
+	root = Tny_add(root, TNY_OBJ, "a", tmp->root, 0);
+	Tny_free(tmp);
+	root = root->root;
+	path = Tny_compilePath("a.b[3].c");
+	for (i = 0; i < 4; i++) {
+		flags = (int[]){TNY_DUMP_DEFAULT, TNY_DUMP_COMPACT, TNY_DUMP_INDEX, TNY_DUMP_KEYS | TNY_DUMP_COMPACT}[i];
+		size = Tny_dumpsEx(root, &dump, flags);
+		if (path == NULL || !TnyReader_init(&reader, dump, size) || !TnyPath_evaluate(path, &reader)
+				|| TnyReader_bin(&reader, &ui32) == NULL || ui32 != strlen(message)
+				|| memcmp(TnyReader_bin(&reader, NULL), message, ui32) != 0) {
+			printf("Evaluating a path with flags %d failed!\n", flags);
+			errors++;
+		}
+		TnyPath_free(path);
+		path = Tny_compilePath("Key17");
+		if (path == NULL || !TnyReader_init(&reader, dump, size) || !TnyPath_evaluate(path, &reader)
+				|| TnyReader_int32(&reader) != 17) {
+			printf("Evaluating a key path with flags %d failed!\n", flags);
+			errors++;
+		}
+		TnyPath_free(path);
+		path = Tny_compilePath("a.b[4].c");
+		if (path == NULL || !TnyReader_init(&reader, dump, size) || TnyPath_evaluate(path, &reader)) {
+			printf("Evaluating a path out of range did not fail!\n");
+			errors++;
+		}
+		TnyPath_free(path);
+		path = Tny_compilePath("a.b.c");
+		if (path == NULL || !TnyReader_init(&reader, dump, size) || TnyPath_evaluate(path, &reader)) {
+			printf("Evaluating a key step on an array did not fail!\n");
+			errors++;
+		}
+		TnyPath_free(path);
+		path = Tny_compilePath("Key3.c");
+		if (path == NULL || !TnyReader_init(&reader, dump, size) || TnyPath_evaluate(path, &reader)) {
+			printf("Evaluating a path through a scalar did not fail!\n");
+			errors++;
+		}
+		TnyPath_free(path);
+		path = Tny_compilePath("a.b[3].c");
+		free(dump);
+	}
+	TnyPath_free(path);
+	Tny_free(root);
+	path = Tny_compilePath("[1].x");
+	root = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	root = Tny_add(root, TNY_INT32, NULL, &ui32, 0);
+	tmp = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	tmp = Tny_add(tmp, TNY_INT64, "x", &ui64, 0);
+	root = Tny_add(root, TNY_OBJ, NULL, tmp->root, 0);
+	Tny_free(tmp);
+	size = Tny_dumps(root->root, &dump);
+	if (path == NULL || !TnyReader_init(&reader, dump, size) || !TnyPath_evaluate(path, &reader)
+			|| TnyReader_int64(&reader) != ui64) {
+		printf("Evaluating a path on an array failed!\n");
+		errors++;
+	}
+	free(dump);
+	Tny_free(root->root);
+	TnyPath_free(path);
+	path = NULL;
+	for (i = 0; i < 8; i++) {
+		path = Tny_compilePath((const char*[]){"", ".a", "a.", "a..b", "a[", "a[]", "a[x]", "[4294967296]"}[i]);
+		if (path != NULL) {
+			printf("Compiling an invalid path did not fail!\n");
+			errors++;
+			TnyPath_free(path);
+		}
+	}
+
+	/* A diff turns the old version of a document into the new one. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	root = Tny_add(root, TNY_BIN, "Name", message, strlen(message));
+	root = Tny_add(root, TNY_INT32, "Nr", &ui32, 0);
+	root = Tny_add(root, TNY_CHAR, "Flag", &c, 0);
+	embedded = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	for (i = 0; i < 100; i++) {
+		embedded = Tny_add(embedded, TNY_INT32, NULL, &i, 0);
+	}
+	root = Tny_add(root, TNY_OBJ, "List", embedded->root, 0);
+	Tny_free(embedded);
+	tmp = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	tmp = Tny_add(tmp, TNY_INT64, "a", &ui64, 0);
+	tmp = Tny_add(tmp, TNY_PACKED_DOUBLE, "b", samples, 10);
+	root = Tny_add(root, TNY_OBJ, "Sub", tmp->root, 0);
+	root = Tny_add(root, TNY_OBJ, "Same", tmp->root, 0);
+	Tny_free(tmp);
+	root = root->root;
+	changed = Tny_copy(NULL, root);
+	patch = Tny_diff(root, changed);
+	if (patch == NULL || patch->size != 0) {
+		printf("Diffing equal documents failed!\n");
+		errors++;
+	}
+	Tny_free(patch);
+	i = 4711;
+	Tny_add(changed, TNY_INT32, "Nr", &i, 0);
+	Tny_remove(Tny_get(changed, "Flag"));
+	Tny_append(changed, TNY_DOUBLE, "New", &flt, 0);
+	embedded = Tny_get(changed, "List")->value.tny;
+	Tny_add(Tny_at(embedded, 49), TNY_BIN, NULL, message, strlen(message));
+	Tny_remove(Tny_at(embedded, 90));
+	Tny_remove(embedded->tail);
+	Tny_add(Tny_get(changed, "Sub")->value.tny, TNY_BIN, "a", "now a string", 12);
+	patch = Tny_diff(root, changed);
+	size = patch != NULL ? Tny_dumps(patch, &dump) : 0;
+	tmp = Tny_copy(NULL, root);
+	Tny_free(patch);
+	patch = size > 0 ? Tny_loads(dump, size) : NULL;
+	if (patch == NULL || patch->size != 7 || size > 300 || !Tny_patch(tmp, patch) || Tny_cmp(tmp, changed) != 0) {
+		printf("Applying a patch failed!\n");
+		errors++;
+	}
+	Tny_free(patch);
+	free(dump);
+	patch = Tny_diff(tmp, changed);
+	if (patch == NULL || patch->size != 0) {
+		printf("A patched document differs from the new version!\n");
+		errors++;
+	}
+	Tny_free(patch);
+	/* The other way round, and a patch which does not fit the document. */
+	patch = Tny_diff(changed, root);
+	if (patch == NULL || !Tny_patch(tmp, patch)) {
+		printf("Reverting a patch failed!\n");
+		errors++;
+	}
+	Tny_free(patch);
+	/* A removed key comes back at its old place. */
+	patch = Tny_diff(root, tmp);
+	if (patch == NULL || patch->size != 0 || Tny_get(tmp, "Flag") != Tny_at(tmp, 2)) {
+		printf("A reverted document differs from the old version!\n");
+		errors++;
+	}
+	Tny_free(patch);
+	Tny_free(tmp);
+	patch = Tny_diff(root, changed);
+	tmp = Tny_copy(NULL, changed);
+	if (patch == NULL || Tny_patch(tmp, patch)) {
+		printf("Applying a patch to the wrong document did not fail!\n");
+		errors++;
+	}
+	Tny_free(patch);
+	Tny_free(tmp);
+	embedded = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	if (Tny_diff(root, embedded) != NULL || Tny_patch(root, embedded) != 1 || Tny_patch(embedded, root)) {
+		printf("Diffing documents of different types did not fail!\n");
+		errors++;
+	}
+	Tny_free(embedded);
+	Tny_free(changed);
+	Tny_free(root);
+
+	/* A patched dictionary has the keys in the order of the new version. */
+	for (counter = 0; counter < 6; counter++) {
+		root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+		changed = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+		if (counter < 5) {
+			order = (const char*[]){"axbcde", "edcba", "bcdea", "xaecb", ""}[counter];
+			key[1] = '\0';
+			for (i = 0; i < 5; i++) {
+				key[0] = (char)('a' + i);
+				Tny_append(root, TNY_INT32, key, &i, 0);
+			}
+			for (i = 0; order[i] != '\0'; i++) {
+				key[0] = order[i];
+				Tny_append(changed, TNY_INT32, key, &i, 0);
+			}
+		} else {
+			for (i = 0; i < 40; i++) {
+				snprintf(key, sizeof(key), "Key%u", i);
+				Tny_append(root, TNY_INT32, key, &i, 0);
+				snprintf(key, sizeof(key), "Key%u", (i * 7) % 40);
+				if (i != 20) {
+					Tny_append(changed, TNY_INT32, key, &i, 0);
+				}
+			}
+		}
+		patch = Tny_diff(root, changed);
+		size = patch != NULL ? Tny_dumps(patch, &dump) : 0;
+		Tny_free(patch);
+		patch = size > 0 ? Tny_loads(dump, size) : NULL;
+		free(dump);
+		size = Tny_dumps(changed, &dump);
+		count = 0;
+		if (patch != NULL && Tny_patch(root, patch)) {
+			count = Tny_dumps(root, &data);
+		}
+		if (count != size || memcmp(data, dump, size) != 0) {
+			printf("A patched dictionary does not have the keys in the new order!\n");
+			errors++;
+		}
+		if (count > 0) {
+			free(data);
+		}
+		free(dump);
+		Tny_free(patch);
+		Tny_free(changed);
+		Tny_free(root);
+	}
+
+	/* Diffing only reads both documents, so shared documents can be diffed from several threads. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < 40; i++) {
+		snprintf(key, sizeof(key), "Key%u", i);
+		Tny_add(root, TNY_INT32, key, &i, 0);
+	}
+	changed = Tny_copy(NULL, root);
+	Tny_remove(Tny_get(changed, "Key7"));
+	Tny_memory(changed, &memory);
+	size = memory.otherBytes;
+	block = changed->index;
+	patch = Tny_diff(root, changed);
+	Tny_memory(changed, &memory);
+	if (patch == NULL || patch->size != 1 || block == NULL || changed->index != block || memory.otherBytes != size) {
+		printf("Diffing large dictionaries changed them!\n");
+		errors++;
+	}
+	Tny_free(patch);
+	Tny_free(changed);
+	Tny_free(root);
+
+	/* A frozen document answers the same questions as the document it was made of. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	for (i = 0; i < 100; i++) {
+		sprintf(key, "Key%u", i);
+		root = Tny_add(root, TNY_INT32, key, &i, 0);
+	}
+	root = Tny_add(root, TNY_BIN, "Name", message, strlen(message));
+	root = Tny_add(root, TNY_INT64, "Big", &ui64, 0);
+	root = Tny_add(root, TNY_CHAR, "Flag", &c, 0);
+	root = Tny_add(root, TNY_DOUBLE, "Pi", &flt, 0);
+	root = Tny_add(root, TNY_NULL, "Nothing", NULL, 0);
+	root = Tny_add(root, TNY_PACKED_DOUBLE, "Samples", samples, 10);
+	embedded = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	for (i = 0; i < 3; i++) {
+		tmp = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+		tmp = Tny_add(tmp, TNY_INT32, "Key7", &i, 0);
+		embedded = Tny_add(embedded, TNY_OBJ, NULL, tmp->root, 0);
+		Tny_free(tmp);
+	}
+	root = Tny_add(root, TNY_OBJ, "List", embedded->root, 0);
+	Tny_free(embedded);
+	root = root->root;
+	size = Tny_dumpsEx(root, &dump, TNY_DUMP_KEYS);
+	tmp = Tny_loads(dump, size);
+	frozen = Tny_freeze(tmp);
+	Tny_free(tmp);
+	free(dump);
+	node = TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "List");
+	if (frozen == NULL || TnyFrozen_type(frozen, TNY_FROZEN_ROOT) != TNY_DICT || TnyFrozen_size(frozen, TNY_FROZEN_ROOT) != 107
+			|| TnyFrozen_int32(frozen, TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "Key57")) != 57
+			|| strcmp(TnyFrozen_key(frozen, TnyFrozen_at(frozen, TNY_FROZEN_ROOT, 42), NULL), "Key42") != 0
+			|| TnyFrozen_int64(frozen, TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "Big")) != ui64
+			|| TnyFrozen_char(frozen, TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "Flag")) != c
+			|| TnyFrozen_double(frozen, TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "Pi")) != flt
+			|| TnyFrozen_type(frozen, TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "Nothing")) != TNY_NULL
+			|| TnyFrozen_size(frozen, node) != 3 || TnyFrozen_type(frozen, node) != TNY_OBJ
+			|| TnyFrozen_int32(frozen, TnyFrozen_get(frozen, TnyFrozen_at(frozen, node, 2), "Key7")) != 2) {
+		printf("Reading a frozen document failed!\n");
+		errors++;
+	}
+	node = TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "Name");
+	if (frozen == NULL || TnyFrozen_bin(frozen, node, &ui32) == NULL || ui32 != strlen(message)
+			|| memcmp(TnyFrozen_bin(frozen, node, NULL), message, ui32) != 0
+			|| TnyFrozen_bin(frozen, TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "Samples"), &ui32) == NULL || ui32 != 10
+			|| memcmp(TnyFrozen_bin(frozen, TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "Samples"), NULL), samples, 10 * sizeof(double)) != 0) {
+		printf("Reading a binary value of a frozen document failed!\n");
+		errors++;
+	}
+	if (frozen == NULL || TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "Missing") != TNY_FROZEN_NONE
+			|| TnyFrozen_get(frozen, TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "Missing"), "Key7") != TNY_FROZEN_NONE
+			|| TnyFrozen_get(frozen, TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "List"), "Key7") != TNY_FROZEN_NONE
+			|| TnyFrozen_at(frozen, TNY_FROZEN_ROOT, 107) != TNY_FROZEN_NONE
+			|| TnyFrozen_at(frozen, TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "Key1"), 0) != TNY_FROZEN_NONE
+			|| TnyFrozen_int32(frozen, TnyFrozen_get(frozen, TNY_FROZEN_ROOT, "Big")) != 0
+			|| TnyFrozen_key(frozen, TNY_FROZEN_ROOT, NULL) != NULL) {
+		printf("Looking up missing elements of a frozen document did not fail!\n");
+		errors++;
+	}
+	TnyFrozen_free(frozen);
+	Tny_free(root);
+
+	/* Cached dumps match fresh ones after every kind of change. */
+	for (i = 0; i < 2; i++) {
+		flags = i == 0 ? TNY_DUMP_DEFAULT : TNY_DUMP_COMPACT;
+		root = i == 0 ? Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0) : Tny_newArena(TNY_ARRAY, 0);
+		for (ui32 = 0; ui32 < 100; ui32++) {
+			tmp = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+			tmp = Tny_add(tmp, TNY_INT32, "Nr", &ui32, 0);
+			tmp = Tny_add(tmp, TNY_BIN, "Name", message, strlen(message));
+			embedded = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+			embedded = Tny_add(embedded, TNY_DOUBLE, NULL, &flt, 0);
+			tmp = Tny_add(tmp, TNY_OBJ, "Sub", embedded->root, 0);
+			Tny_free(embedded);
+			root = Tny_add(root, TNY_OBJ, NULL, tmp->root, 0);
+			Tny_free(tmp);
+		}
+		root = root->root;
+		for (ui32 = 0; ui32 < 6; ui32++) {
+			size = Tny_dumpsEx(root, &cached, flags | TNY_DUMP_CACHE);
+			if (size == 0 || size != Tny_dumpsEx(root, &dump, flags) || memcmp(cached, dump, size) != 0) {
+				printf("A cached dump after change %u with flags %d differs!\n", ui32, flags);
+				errors++;
+			}
+			free(cached);
+			free(dump);
+			tmp = Tny_at(root, 10 * ui32)->value.tny;
+			if (ui32 == 0) {
+				/* Same size, different value. */
+				Tny_add(tmp, TNY_INT32, "Nr", &ui32, 0);
+			} else if (ui32 == 1) {
+				Tny_add(Tny_get(tmp, "Sub")->value.tny, TNY_CHAR, NULL, &c, 0);
+			} else if (ui32 == 2) {
+				Tny_remove(Tny_get(tmp, "Name"));
+			} else if (ui32 == 3) {
+				Tny_remove(Tny_at(root, 50));
+			} else if (ui32 == 4) {
+				embedded = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+				embedded = Tny_add(embedded, TNY_INT64, "Big", &ui64, 0);
+				Tny_addOwned(tmp, "Owned", embedded);
+			}
+		}
+		size = Tny_dumpsEx(root, &cached, flags | TNY_DUMP_CACHE | TNY_DUMP_INDEX);
+		if (size == 0 || size != Tny_dumpsEx(root, &dump, flags | TNY_DUMP_INDEX) || memcmp(cached, dump, size) != 0) {
+			printf("A cached dump with an index differs!\n");
+			errors++;
+		}
+		free(cached);
+		free(dump);
+		Tny_free(root);
+	}
+
+	/* The kept forms of an arena document are given back when they are dropped. */
+	memset(&usage, 0, sizeof(usage));
+	Tny_setAllocator(&allocator);
+	root = Tny_newArena(TNY_ARRAY, 0);
+	for (ui32 = 0; ui32 < 100; ui32++) {
+		tmp = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+		Tny_add(tmp, TNY_BIN, "Name", message, strlen(message));
+		Tny_add(root->tail, TNY_OBJ, NULL, tmp, 0);
+		Tny_free(tmp);
+	}
+	for (i = 0; i < 50; i++) {
+		Tny_add(Tny_at(root, 7)->value.tny, TNY_INT32, "Nr", &i, 0);
+		size = Tny_dumpsEx(root, &cached, TNY_DUMP_CACHE);
+		countRelease(&usage, cached);
+		if (i == 0) {
+			count = usage.live;
+		}
+	}
+	if (size == 0 || (size_t)usage.live != count) {
+		printf("Cached dumps of an arena document are not given back!\n");
+		errors++;
+	}
+	Tny_free(root);
+	Tny_setAllocator(NULL);
+	if (usage.live != 0) {
+		printf("Freeing an arena document with cached dumps leaked %ld allocation(s)!\n", usage.live);
+		errors++;
+	}
+
+	/* A document with an allocator of its own takes everything from it and gives everything back. */
+	memset(&usage, 0, sizeof(usage));
+	root = Tny_newWithAllocator(TNY_DICT, &allocator);
+	for (ui32 = 0; ui32 < 40; ui32++) {
+		snprintf(key, sizeof(key), "Key%"PRIu32, ui32);
+		tmp = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+		tmp = Tny_add(tmp, TNY_BIN, NULL, message, strlen(message));
+		tmp = Tny_add(tmp, TNY_PACKED_DOUBLE, NULL, samples, 10);
+		Tny_add(root, TNY_OBJ, key, tmp->root, 0);
+		Tny_free(tmp);
+	}
+	embedded = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	embedded = Tny_add(embedded, TNY_INT64, "Big", &ui64, 0);
+	Tny_addOwned(root, "Owned", embedded);
+	Tny_remove(Tny_get(root, "Key7"));
+	size = Tny_dumpsEx(root, &cached, TNY_DUMP_CACHE);
+	tmp = Tny_copy(NULL, root);
+	if (root == NULL || usage.calls < 40 * 5 || usage.live <= 0 || tmp == NULL
+			|| size != Tny_dumps(tmp, &dump) || memcmp(cached, dump, size) != 0) {
+		printf("Building a document with an allocator of its own failed!\n");
+		errors++;
+	}
+	free(cached);
+	free(dump);
+	Tny_free(tmp);
+	Tny_free(root);
+	if (usage.live != 0 || usage.nulls != 0 || Tny_newWithAllocator(TNY_DICT, NULL) != NULL) {
+		printf("A document with an allocator of its own leaked %ld allocation(s)!\n", usage.live);
+		errors++;
+	}
+
+	/* The allocator of the library is used by loads, dumps and arenas. */
+	memset(&usage, 0, sizeof(usage));
+	Tny_setAllocator(&allocator);
+	root = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	for (ui32 = 0; ui32 < 100; ui32++) {
+		Tny_add(root->root->tail, TNY_INT32, NULL, &ui32, 0);
+	}
+	size = Tny_dumpsEx(root, &dump, TNY_DUMP_COMPRESS);
+	tmp = Tny_loadsEx(dump, size, TNY_LOAD_ARENA);
+	embedded = Tny_loads(dump, size);
+	if (size == 0 || tmp == NULL || embedded == NULL || Tny_cmp(root, tmp) != 0 || Tny_cmp(root, embedded) != 0
+			|| usage.calls < 100) {
+		printf("Using the allocator of the library failed!\n");
+		errors++;
+	}
+	countRelease(&usage, dump);
+	Tny_free(embedded);
+	Tny_free(tmp);
+	Tny_free(root);
+	Tny_setAllocator(NULL);
+	if (usage.live != 0 || usage.nulls != 0) {
+		printf("The allocator of the library leaked %ld allocation(s)!\n", usage.live);
+		errors++;
+	}
+
+	/* A length read from the data does not make the parser allocate ahead of the bytes,
+	   however small the pieces are. */
+	memset(&usage, 0, sizeof(usage));
+	Tny_setAllocator(&allocator);
+	data = calloc(1, 200000);
+	for (counter = 0; counter < 8; counter++) {
+		memcpy(data, (const char*[]){"\x01\x01\x00\x00\x00\x04\xf0\xff\xff\xff",
+			"\x02\x01\x00\x00\x00\x04\xf0\xff\xff\xff",
+			"\x01\x01\x00\x00\x00\x0b\xf0\xff\xff\xff",
+			"\x80\xf0\xff\xff\xff\x00\x00\x00\x00\x00"}[counter / 2], 10);
+		TnyParser_init(&parser, counter % 2 ? TNY_LOAD_ARENA : TNY_LOAD_DEFAULT);
+		for (i = 0; i < 1000 && TnyParser_feed(&parser, (char*)data + i, 1, NULL) == TNY_PARSE_MORE; i++);
+		if (i != 1000 || TnyParser_finish(&parser) != NULL || usage.largest > 2 * 64 * 1024) {
+			printf("Parsing a forged length allocated %lu bytes!\n", (unsigned long)usage.largest);
+			errors++;
+		}
+	}
+	memset(data, 'x', 200000);
+	root = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	Tny_add(root, TNY_BIN, NULL, data, 200000);
+	for (i = 0; i < 200000 / sizeof(double); i++) {
+		((double*)data)[i] = i * 0.5;
+	}
+	Tny_add(root->root->tail, TNY_PACKED_DOUBLE, NULL, data, 200000 / sizeof(double));
+	size = Tny_dumps(root, &dump);
+	for (counter = 0; counter < 2; counter++) {
+		TnyParser_init(&parser, counter % 2 ? TNY_LOAD_ARENA : TNY_LOAD_DEFAULT);
+		for (i = 0; i < size && TnyParser_feed(&parser, (char*)dump + i, i + 1000 < size ? 1000 : size - i, NULL) == TNY_PARSE_MORE; i += 1000);
+		tmp = TnyParser_finish(&parser);
+		if (tmp == NULL || Tny_cmp(root, tmp) != 0) {
+			printf("Parsing a large value in pieces failed!\n");
+			errors++;
+		}
+		Tny_free(tmp);
+	}
+	countRelease(&usage, dump);
+	Tny_free(root);
+	free(data);
+	Tny_setAllocator(NULL);
+	if (usage.live != 0 || usage.nulls != 0) {
+		printf("Parsing forged and large values leaked %ld allocation(s)!\n", usage.live);
+		errors++;
+	}
+
+	/* Memory held by a document. */
+	root = Tny_add(NULL, TNY_DICT, NULL, NULL, 0);
+	Tny_add(root, TNY_BIN, "Name", message, strlen(message));
+	Tny_add(root, TNY_INT32, "Nr", &ui32, 0);
+	embedded = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	embedded = Tny_add(embedded, TNY_PACKED_INT32, NULL, ids, 4);
+	Tny_add(root, TNY_OBJ, "Sub", embedded->root, 0);
+	Tny_free(embedded);
+	Tny_memory(Tny_get(root, "Nr"), &memory);
+	if (memory.nodes != 6 || memory.nodeBytes != 6 * sizeof(Tny) || memory.keyBytes != 5 + 3 + 4
+			|| memory.binBytes != strlen(message) + 4 * sizeof(uint32_t) || memory.otherBytes != 0) {
+		printf("Counting the memory of a document failed!\n");
+		errors++;
+	}
+	size = Tny_dumpsEx(root, &dump, TNY_DUMP_CACHE);
+	free(dump);
+	Tny_memory(root, &memory);
+	if (memory.otherBytes < size) {
+		printf("The memory of a dump cache was not counted!\n");
+		errors++;
+	}
+
+	/* The counters only move if the library was compiled with TNY_STATS. */
+	Tny_resetStats();
+	if (Tny_stats(&stats)) {
+		nodes = stats.nodes;
+		size = Tny_dumps(root, &dump);
+		tmp = Tny_loads(dump, size);
+		Tny_stats(&stats);
+		if (stats.nodes != nodes + 6 || stats.elements != 6 || stats.loads != 1 || stats.dumps != 1
+				|| stats.parsedBytes != size || stats.emittedBytes != size || stats.allocations < 6) {
+			printf("The counters of a load are wrong!\n");
+			errors++;
+		}
+		Tny_free(tmp);
+		tmp = Tny_loadsEx(dump, size, TNY_LOAD_ARENA);
+		Tny_remove(Tny_get(tmp, "Nr"));
+		Tny_stats(&stats);
+		if (stats.nodes != nodes + 6 || stats.loads != 2) {
+			printf("The counters of an arena load are wrong!\n");
+			errors++;
+		}
+		Tny_free(tmp);
+		free(dump);
+		Tny_stats(&stats);
+		/* The dump was not given back through the library. */
+		if (stats.nodes != nodes || stats.allocations != stats.releases + 1) {
+			printf("The counters do not balance after freeing!\n");
+			errors++;
+		}
+	} else if (stats.nodes != 0 || stats.allocations != 0) {
+		printf("Counters are set without TNY_STATS!\n");
+		errors++;
+	}
+	Tny_free(root);
+
 	printf("Tny tests completed with %u error(s).\n", errors);
 
 	return EXIT_SUCCESS;
@@ -1,21 +1,854 @@
+#if !defined(TNY_NO_POSIX) && (defined(__unix__) || defined(__APPLE__)) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "tny.h"
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef TNY_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <stdio.h>
+#endif
+
+#if defined(TNY_POSIX) && !defined(TNY_NO_THREADS)
+#define TNY_THREADS 1
+#include <pthread.h>
+#endif
+
 #define HASNEXTDATA(X) if ((*pos) + X > length) break
+#define TNY_ARENA_CHUNKSIZE (64 * 1024)
+#define TNY_ALIGN(X) (((X) + sizeof(TnyAlign) - 1) & ~(sizeof(TnyAlign) - 1))
+#define TNY_INDEX_THRESHOLD 16
+#define TNY_DIFF_LOOKAHEAD 8
+#define TNY_WRITER_BUFSIZE 256
+#define TNY_WRITER_FLUSHSIZE (64 * 1024)
+#define TNY_PARSER_PREALLOC (64 * 1024)
+#define TNY_INDEX_DELETED (&TnyIndex_deleted)
+#define TNY_FORMAT_INDEXED 0x10
+#define TNY_FORMAT_COMPACT 0x20
+#define TNY_FORMAT_COMPRESSED 0x40
+#define TNY_FORMAT_KEYED 0x80
+#define TNY_LZ_HASHBITS 12
+#define TNY_LZ_MINMATCH 4
+#define TNY_LZ_MAXRATIO 255
+#define TNY_COMPRESSED_HEADER (1 + 2 * sizeof(uint64_t))
+#define TNY_ZIGZAG32(X) (((uint32_t)(X) << 1) ^ (uint32_t)-((uint32_t)(X) >> 31))
+#define TNY_ZIGZAG64(X) (((uint64_t)(X) << 1) ^ (uint64_t)-((uint64_t)(X) >> 63))
+#define TNY_UNZIGZAG(X) (((X) >> 1) ^ -((X) & 1))
+#define TNY_PARENT(X) ((Tny*)((char*)(X)->docSizePtr - offsetof(Tny, docSize)))
+
+#if defined(TNY_STATS) && defined(__GNUC__)
+#define TNY_COUNT(X, N) __atomic_fetch_add(&tnyStats.X, (uint64_t)(N), __ATOMIC_RELAXED)
+#define TNY_UNCOUNT(X, N) __atomic_fetch_sub(&tnyStats.X, (uint64_t)(N), __ATOMIC_RELAXED)
+#elif defined(TNY_STATS)
+#define TNY_COUNT(X, N) (tnyStats.X += (uint64_t)(N))
+#define TNY_UNCOUNT(X, N) (tnyStats.X -= (uint64_t)(N))
+#else
+#define TNY_COUNT(X, N) ((void)sizeof(N))
+#define TNY_UNCOUNT(X, N) ((void)sizeof(N))
+#endif
+
+enum {
+	TNY_ADD_UNIQUE = 0x01,		/* The key is known not to exist yet. */
+	TNY_ADD_BORROW = 0x02,		/* Key and binary value are referenced instead of copied. */
+	TNY_ADD_ADOPT = 0x04,		/* The sub document is taken over instead of copied. */
+	TNY_ADD_TAKE = 0x08,		/* The binary value was allocated for the element and is taken over. */
+	TNY_ADD_SHARED = 0x10,		/* The key belongs to the key table of the document and is referenced. */
+	TNY_ADD_REPLACE = 0x20		/* prev is the element whose value is replaced. */
+};
+
+enum {
+	TNY_STEP_HEADER,			/* Type byte of a document. */
+	TNY_STEP_COUNT,				/* Number of elements of a document. */
+	TNY_STEP_INDEX,				/* Position of the offset index of a document. */
+	TNY_STEP_ELEMENT,			/* Type byte of an element, or the end of a document. */
+	TNY_STEP_KEYLENGTH,
+	TNY_STEP_KEY,
+	TNY_STEP_VALUE,				/* Fixed size or varint value. */
+	TNY_STEP_BINLENGTH,
+	TNY_STEP_BLOCKLENGTH,		/* Size of a compressed binary value. */
+	TNY_STEP_BIN,
+	TNY_STEP_FOOTER,			/* Offset index behind the elements, it is skipped. */
+	TNY_STEP_PACKED,			/* Header of a compressed document. */
+	TNY_STEP_BLOCK,				/* Compressed document. */
+	TNY_STEP_TABLESIZE,			/* Size of the key table in front of a document. */
+	TNY_STEP_TABLE				/* Key table in front of a document. */
+};
+
+typedef union {
+	void *ptr;
+	uint64_t num;
+	double flt;
+} TnyAlign;
+
+typedef struct _TnyArenaChunk {
+	struct _TnyArenaChunk *next;
+	size_t size;
+	size_t used;
+} TnyArenaChunk;
+
+typedef struct _TnyArenaBlock {
+	struct _TnyArenaBlock *prev;
+	struct _TnyArenaBlock *next;
+} TnyArenaBlock;
+
+struct _TnyArena {
+	TnyArenaChunk *chunks;
+	size_t chunkSize;			/* Is 0 if every allocation is taken separately from the allocator. */
+	Tny *owner;
+	void *mapping;
+	size_t mappingSize;
+	TnyAllocator allocator;		/* Allocator of the chunks and of the arena itself. */
+	TnyArenaBlock *blocks;		/* Memory outside the chunks which is given back one by one. */
+	uint64_t nodes;				/* Number of elements taken from the chunks, only counted with TNY_STATS. */
+};
+
+typedef struct {
+	const Tny **keys;			/* First element of every distinct key, in the order of the table. */
+	uint32_t count;
+	uint32_t *slots;			/* Hash table of the keys, a slot holds the number of a key + 1. */
+	size_t capacity;
+	size_t size;				/* Size of the serialized table. */
+	size_t keyBytes;			/* Size of all keys in the document without a table. */
+	size_t refBytes;			/* Size of all references to the table. */
+} TnyKeyTable;
+
+typedef struct {
+	int flags;
+	const TnyKeyTable *keys;
+	TnyIovec *iov;
+	size_t count;
+	size_t threshold;
+	size_t start;
+	uint64_t *offsets;
+	size_t used;
+	size_t capacity;
+} TnyDumpState;
+
+#ifdef TNY_THREADS
+typedef struct {
+	char *data;
+	size_t start;				/* Position of the first element. */
+	size_t end;					/* Position behind the last element. */
+	uint32_t number;			/* Number of the first element. */
+	uint32_t count;
+	int compact;
+	int flags;
+	Tny *root;					/* Document the elements are chained into. */
+	Tny *first;					/* Root the elements are loaded into. */
+	const struct _TnyKeys *keys;
+	TnyArena *arena;
+	int done;					/* Is 1 if exactly the elements of the range were loaded. */
+	pthread_t thread;
+	int started;
+} TnySlice;
+
+typedef struct {
+	char *data;
+	size_t start;				/* Position of the first element. */
+	size_t end;					/* Position behind the last element. */
+	const Tny *first;
+	const Tny *last;			/* Element behind the range, or NULL. */
+	int done;					/* Is 1 if the range was written exactly. */
+	pthread_t thread;
+	int started;
+} TnyDumpSlice;
+#endif
+
+struct _TnyIndex {
+	size_t capacity;
+	size_t used;
+	size_t deleted;
+	Tny *slots[];
+};
+
+typedef struct {
+	TnyField field;
+	uint32_t keyLength;
+	uint32_t keyHash;
+} TnyCodecField;
 
+struct _TnyCodec {
+	uint32_t count;
+	size_t capacity;
+	uint32_t *slots;			/* Hash table of the keys, a slot holds the number of a field + 1. */
+	TnyCodecField fields[];
+};
+
+typedef struct {
+	const char *key;			/* Points into the copy of the path, NULL for an index step. */
+	uint32_t keyLength;
+	uint32_t keyHash;
+	uint32_t index;
+} TnyPathStep;
+
+struct _TnyPath {
+	uint32_t count;
+	TnyPathStep steps[];		/* Followed by a copy of the path text. */
+};
+
+typedef struct _TnyDiffStep {
+	const struct _TnyDiffStep *parent;
+	const Tny *element;			/* Element of a dictionary, NULL for a position in an array. */
+	uint32_t index;
+} TnyDiffStep;
+
+struct _TnyFrozen {
+	uint32_t count;				/* Number of nodes, node 0 is the root document. */
+	uint32_t keyCount;			/* Number of distinct keys. */
+	size_t capacity;			/* Number of slots of the key hash table. */
+	size_t bytes;				/* Size of the whole block. */
+	uint64_t *values;			/* Scalar, offset into blobs, node of the sub document or first pair of a dictionary. */
+	uint64_t *pairs;			/* (key number << 32 | node) of the elements of every dictionary, sorted per dictionary. */
+	char *blobs;				/* Binary values and packed values in host byte order. */
+	uint32_t *sizes;			/* Size of the value, number of elements of a document. */
+	uint32_t *keys;				/* Key number of every element of a dictionary, otherwise TNY_FROZEN_NONE. */
+	uint32_t *keyOffsets;		/* Position of every distinct key in keyData, followed by the end. */
+	uint32_t *keyHashes;
+	uint32_t *slots;			/* Hash table of the distinct keys, a slot holds the number of a key + 1. */
+	unsigned char *types;
+	char *keyData;				/* The distinct keys, each one NUL terminated. */
+};
+
+typedef struct {
+	TnyFrozen *frozen;
+	const TnyKeyTable *keys;
+	uint32_t next;				/* First node which is not taken yet. */
+	size_t blobs;
+	size_t pairs;
+} TnyFreezeState;
+
+struct _TnyCache {
+	int flags;					/* TNY_DUMP_COMPACT if the compact form is kept. */
+	size_t size;
+	char data[];
+};
+
+struct _TnyKeys {
+	uint32_t count;
+	uint32_t size;				/* Size of the copied table, 0 if the keys are borrowed. */
+	char *keys[];				/* The copies of the keys follow the pointers, unless they are borrowed. */
+};
+
+static Tny TnyIndex_deleted;
+
+static Tny* _Tny_add(Tny *prev, TnyType type, char *key, void *value, uint64_t size, TnyArena *arena, int flags);
+static Tny* _Tny_copy(size_t *docSizePtr, const Tny *src, TnyArena *arena);
+static void* Tny_defaultAllocate(void *context, size_t size);
+static void* Tny_defaultReallocate(void *context, void *ptr, size_t size);
+static void Tny_defaultRelease(void *context, void *ptr);
+static void* Tny_allocate(const TnyAllocator *allocator, size_t size);
+static void* Tny_reallocate(void *ptr, size_t size);
+static void Tny_deallocate(const TnyAllocator *allocator, void *ptr);
+static TnyArena* TnyArena_create(size_t chunkSize, const TnyAllocator *allocator);
+static void* TnyArena_alloc(TnyArena *arena, size_t size);
+static void TnyArena_free(TnyArena *arena);
+static void* Tny_malloc(TnyArena *arena, size_t size);
+static void Tny_release(TnyArena *arena, void *ptr);
+static void* Tny_mallocBlock(TnyArena *arena, size_t size);
+static void Tny_releaseBlock(TnyArena *arena, void *ptr);
+static uint32_t Tny_hash(const char *key, size_t len);
+static int TnyIndex_build(Tny *root);
+static void TnyIndex_insert(Tny *root, Tny *tny);
+static void TnyIndex_remove(Tny *root, Tny *tny);
+static void TnyIndex_append(Tny *root, Tny *tny);
+static size_t TnyIndex_position(const struct _TnyIndex *index, const Tny *tny);
+static void TnyIndex_free(Tny *root);
+static Tny* Tny_find(const Tny *root, const char *key, size_t len, uint32_t hash);
+static void Tny_unlink(Tny *tny);
+static void Tny_freeKey(TnyArena *arena, Tny *tny);
+static void Tny_releaseNode(TnyArena *arena, Tny *tny);
+static void Tny_countMemory(const Tny *tny, TnyMemory *memory);
 static void Tny_addSize(Tny *tny, size_t size);
 static void Tny_subSize(Tny *tny, size_t size);
+static void Tny_attach(Tny *root, size_t *docSizePtr);
+static void Tny_detach(Tny *root);
+static void Tny_dropCache(Tny *root);
+static void Tny_keepCache(Tny *root, const char *data, size_t size, int flags);
 static size_t Tny_valueSize(TnyType type, size_t size);
-static size_t _Tny_dumps(const Tny *tny, char *data, size_t pos);
-static Tny* _Tny_loads(char *data, size_t length, size_t *pos, size_t *docSizePtr);
+static int Tny_equalValue(const Tny *left, const Tny *right);
+static int Tny_equalDocument(const Tny *left, const Tny *right);
+static Tny* Tny_addValue(Tny *prev, char *key, const Tny *src, int flags);
+static Tny* Tny_diffPath(Tny *path, const TnyDiffStep *step);
+static int Tny_diffOp(Tny *patch, char op, const TnyDiffStep *step, const Tny *value);
+static int Tny_diffPlace(Tny *patch, char op, const TnyDiffStep *step, const Tny *value, const Tny *after);
+static int Tny_diffOrdered(const Tny *from, const Tny *to);
+static void* Tny_diffKeep(const Tny *from, const Tny *to, char **keep);
+static int Tny_diffElement(Tny *patch, const Tny *from, const Tny *to, const TnyDiffStep *step);
+static int Tny_diffDocument(Tny *patch, const Tny *from, const Tny *to, const TnyDiffStep *parent);
+static int Tny_patchStep(const Tny *root, const Tny *step);
+static Tny* Tny_patchElement(const Tny *root, const Tny *step);
+static Tny* Tny_patchAfter(const Tny *root, const Tny *after);
+static int Tny_patchOp(Tny *root, char op, const Tny *step, const Tny *value);
+static size_t _Tny_dumps(const Tny *tny, char *data, size_t pos, TnyDumpState *state);
+static size_t Tny_dumpElement(const Tny *tny, char *data, size_t pos, size_t start, TnyDumpState *state);
+static int Tny_pushOffset(TnyDumpState *state, uint64_t offset);
+static int Tny_compareOffsets(const void *left, const void *right);
+static size_t Tny_dumpIndex(const Tny *tny, char *data, size_t start, size_t indexAt, size_t pos, TnyDumpState *state, size_t base);
+static size_t Tny_indexSize(const Tny *tny);
+static size_t Tny_compactSize(const Tny *tny);
+static size_t Tny_varintSize(uint64_t value);
+static size_t Tny_writeVarint(char *data, uint64_t value);
+static int Tny_readVarint(const char *data, size_t length, size_t *pos, uint64_t *value);
+static int Tny_readLength(const char *data, size_t length, size_t *pos, int compact, uint32_t *value);
+static size_t TnyLz_sequence(unsigned char *out, size_t op, const unsigned char *literals, size_t count, size_t offset, size_t match);
+static size_t TnyLz_compress(const char *src, size_t size, char *dest, size_t capacity);
+static int TnyLz_decompress(const char *src, size_t size, char *dest, size_t capacity);
+static size_t Tny_dumpBin(const Tny *tny, char *data, size_t typePos, size_t pos, int compact);
+static size_t Tny_compressDump(void **data, size_t size);
+static void Tny_countLargeValues(const Tny *tny, size_t threshold, size_t *count, size_t *size);
+static int TnyKeyTable_collect(TnyKeyTable *table, const Tny *tny, int compact);
+static int TnyKeyTable_grow(TnyKeyTable *table);
+static uint32_t* TnyKeyTable_find(const TnyKeyTable *table, const Tny *tny);
+static void TnyKeyTable_free(TnyKeyTable *table);
+static size_t Tny_dumpKeys(const TnyKeyTable *table, char *data);
+static int Tny_checkKeyTable(const char *table, size_t size, uint32_t *count);
+static const char* Tny_readKeyTable(const char *data, size_t length, size_t *pos, uint32_t *size, uint32_t *count);
+static const char* Tny_tableKey(const char *table, uint32_t number, uint32_t *length);
+static struct _TnyKeys* Tny_internKeys(const char *table, uint32_t size, uint32_t count, TnyArena *arena, int borrow);
+static Tny* _Tny_loads(char *data, size_t length, size_t *pos, size_t *docSizePtr, TnyArena *arena, int flags, const struct _TnyKeys *keys);
+static Tny* Tny_loadsChecked(void *data, size_t length, int flags, int threads, const TnyLimits *limits);
+static Tny* Tny_loadElements(Tny *tny, char *data, size_t length, size_t *pos, uint64_t elements, int compact, TnyArena *arena, int flags, const struct _TnyKeys *keys);
+#ifdef TNY_THREADS
+static void TnyArena_merge(TnyArena *arena, TnyArena *other);
+static void TnyArena_adopt(TnyArena *arena, Tny *root);
+static size_t Tny_splitArray(const char *data, size_t length, TnySlice *slices, size_t count);
+static void* Tny_loadSlice(void *arg);
+static Tny* Tny_loadsSliced(char *data, size_t length, TnyArena *arena, int flags, int threads, const struct _TnyKeys *keys);
+static void* Tny_dumpSlice(void *arg);
+static int Tny_dumpsSliced(const Tny *tny, char *data, size_t size, int threads);
+#endif
 static uint32_t* Tny_swapBytes32(uint32_t *dest, const char *src);
+static size_t Tny_packedWidth(TnyType type);
+static void Tny_swapBulk(char *dest, const char *src, size_t count, size_t width);
 static uint64_t* Tny_swapBytes64(uint64_t *dest, const char *src);
 static void Tny_freeValue(Tny *tny);
+static int TnyReader_push(TnyReader *reader);
+static int TnyReader_advance(TnyReader *reader);
+static int TnyReader_skipScalar(TnyReader *reader);
+static void TnyReader_pop(TnyReader *reader);
+static int TnyReader_rewind(TnyReader *reader, uint32_t index);
+static int TnyReader_findKey(TnyReader *reader, const char *key, size_t len, uint32_t hash);
+static int Tny_validateValue(TnyReader *reader, uint64_t maxValueSize);
+static int Tny_validateIndex(const TnyReader *reader);
+static int TnyParser_collect(TnyParser *parser, const char **data, size_t *size, size_t need);
+static int TnyParser_bulk(TnyParser *parser, const char **data, size_t *size, char *dest, uint64_t need);
+static int TnyParser_number(TnyParser *parser, const char **data, size_t *size, int compact, size_t width, uint64_t *value);
+static int TnyParser_reserve(char **buffer, size_t *capacity, uint64_t size);
+static int TnyParser_gather(TnyParser *parser, const char **data, size_t *size, char **buffer, size_t *capacity, uint64_t need);
+static int TnyParser_add(TnyParser *parser, void *value, uint64_t size, int flags);
+static int TnyParser_open(TnyParser *parser, uint32_t count);
+static void TnyParser_value(TnyParser *parser);
+static size_t TnyCodec_size(const TnyCodec *codec, const void *object, int compact);
+static uint32_t TnyCodec_length(const char *member, size_t size);
+static size_t TnyCodec_write(const TnyCodec *codec, const void *object, char *data, int compact);
+static const TnyCodecField* TnyCodec_match(const TnyCodec *codec, const char *key, uint32_t length, uint32_t *next);
+static int TnyCodec_read(const TnyReader *reader, const TnyCodecField *field, char *member);
+static void Tny_freezeCount(const Tny *doc, size_t *nodes, size_t *blobs, size_t *pairs);
+static void Tny_freezeDocument(TnyFreezeState *state, const Tny *doc, uint32_t node);
+static uint32_t TnyFrozen_document(const TnyFrozen *frozen, uint32_t node);
+static char* TnyWriter_reserve(TnyWriter *writer, size_t size);
+static int TnyWriter_element(TnyWriter *writer, TnyType type, const char *key);
+static int TnyWriter_flush(TnyWriter *writer, int all);
 
 union tnyHostOrder tnyHostOrder = { { 0, 1, 2, 3 } };
 
+static TnyAllocator tnyAllocator = { Tny_defaultAllocate, Tny_defaultReallocate, Tny_defaultRelease, NULL };
+
+#ifdef TNY_STATS
+static TnyStats tnyStats;
+#endif
+
+static void* Tny_defaultAllocate(void *context, size_t size)
+{
+	(void)context;
+	return malloc(size);
+}
+
+static void* Tny_defaultReallocate(void *context, void *ptr, size_t size)
+{
+	(void)context;
+	return realloc(ptr, size);
+}
+
+static void Tny_defaultRelease(void *context, void *ptr)
+{
+	(void)context;
+	free(ptr);
+}
+
+void Tny_setAllocator(const TnyAllocator *allocator)
+{
+	TnyAllocator standard = { Tny_defaultAllocate, Tny_defaultReallocate, Tny_defaultRelease, NULL };
+
+	tnyAllocator = allocator != NULL ? *allocator : standard;
+}
+
+int Tny_stats(TnyStats *stats)
+{
+#ifdef TNY_STATS
+	*stats = tnyStats;
+	return 1;
+#else
+	memset(stats, 0, sizeof(TnyStats));
+	return 0;
+#endif
+}
+
+void Tny_resetStats(void)
+{
+#ifdef TNY_STATS
+	uint64_t nodes = tnyStats.nodes;
+
+	memset(&tnyStats, 0, sizeof(TnyStats));
+	tnyStats.nodes = nodes;
+#endif
+}
+
+static void* Tny_allocate(const TnyAllocator *allocator, size_t size)
+{
+	TNY_COUNT(allocations, 1);
+	TNY_COUNT(allocatedBytes, size);
+	return allocator->allocate(allocator->context, size);
+}
+
+static void* Tny_reallocate(void *ptr, size_t size)
+{
+	TNY_COUNT(allocations, 1);
+	TNY_COUNT(allocatedBytes, size);
+	return tnyAllocator.reallocate(tnyAllocator.context, ptr, size);
+}
+
+static void Tny_deallocate(const TnyAllocator *allocator, void *ptr)
+{
+	if (ptr != NULL) {
+		TNY_COUNT(releases, 1);
+		allocator->release(allocator->context, ptr);
+	}
+}
+
+static TnyArena* TnyArena_create(size_t chunkSize, const TnyAllocator *allocator)
+{
+	TnyArena *arena = Tny_allocate(allocator != NULL ? allocator : &tnyAllocator, sizeof(TnyArena));
+
+	if (arena != NULL) {
+		arena->chunks = NULL;
+		/* An arena with an allocator of its own passes every allocation on. */
+		arena->chunkSize = allocator != NULL ? 0 : chunkSize > 0 ? chunkSize : TNY_ARENA_CHUNKSIZE;
+		arena->owner = NULL;
+		arena->mapping = NULL;
+		arena->mappingSize = 0;
+		arena->allocator = allocator != NULL ? *allocator : tnyAllocator;
+		arena->blocks = NULL;
+		arena->nodes = 0;
+	}
+
+	return arena;
+}
+
+static void* TnyArena_alloc(TnyArena *arena, size_t size)
+{
+	TnyArenaChunk *chunk = arena->chunks;
+	size_t offset = TNY_ALIGN(sizeof(TnyArenaChunk));
+	size_t chunkSize = arena->chunkSize;
+	void *ptr = NULL;
+
+	size = TNY_ALIGN(size > 0 ? size : 1);
+	if (chunk == NULL || chunk->used + size > chunk->size) {
+		/* Big allocations get a chunk of their own so the current chunk stays usable. */
+		if (size > chunkSize / 4) {
+			chunkSize = size;
+		}
+
+		chunk = Tny_allocate(&arena->allocator, offset + chunkSize);
+		if (chunk == NULL) {
+			return NULL;
+		}
+		chunk->size = chunkSize;
+		chunk->used = 0;
+		if (chunkSize == size && arena->chunks != NULL) {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		} else {
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+	}
+
+	ptr = (char*)chunk + offset + chunk->used;
+	chunk->used += size;
+
+	return ptr;
+}
+
+static void TnyArena_free(TnyArena *arena)
+{
+	TnyArenaChunk *chunk = NULL;
+	TnyArenaChunk *next = NULL;
+	TnyArenaBlock *block = NULL;
+	TnyArenaBlock *nextBlock = NULL;
+	TnyAllocator allocator;
+
+	if (arena != NULL) {
+		allocator = arena->allocator;
+		for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+			next = chunk->next;
+			Tny_deallocate(&allocator, chunk);
+		}
+		for (block = arena->blocks; block != NULL; block = nextBlock) {
+			nextBlock = block->next;
+			Tny_deallocate(&allocator, block);
+		}
+#ifdef TNY_POSIX
+		if (arena->mapping != NULL) {
+			munmap(arena->mapping, arena->mappingSize);
+		}
+#endif
+		TNY_UNCOUNT(nodes, arena->nodes);
+		Tny_deallocate(&allocator, arena);
+	}
+}
+
+#ifdef TNY_THREADS
+static void TnyArena_merge(TnyArena *arena, TnyArena *other)
+{
+	TnyArenaChunk *chunk = other->chunks;
+	TnyArenaBlock *block = other->blocks;
+
+	/* The chunks are put behind the current chunk of the arena, which stays in use. */
+	if (chunk != NULL) {
+		while (chunk->next != NULL) {
+			chunk = chunk->next;
+		}
+		if (arena->chunks != NULL) {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = other->chunks;
+		} else {
+			arena->chunks = other->chunks;
+		}
+	}
+	if (block != NULL) {
+		while (block->next != NULL) {
+			block = block->next;
+		}
+		block->next = arena->blocks;
+		if (arena->blocks != NULL) {
+			arena->blocks->prev = block;
+		}
+		arena->blocks = other->blocks;
+	}
+	arena->nodes += other->nodes;
+	Tny_deallocate(&other->allocator, other);
+}
+
+static void TnyArena_adopt(TnyArena *arena, Tny *root)
+{
+	Tny *next = NULL;
+
+	/* Sub documents keep allocating from the arena their memory was merged into. */
+	root->arena = arena;
+	for (next = root->next; next != NULL; next = next->next) {
+		if (next->type == TNY_OBJ && next->value.tny != NULL) {
+			TnyArena_adopt(arena, next->value.tny);
+		}
+	}
+}
+#endif
+
+static void* Tny_malloc(TnyArena *arena, size_t size)
+{
+	if (arena == NULL) {
+		return Tny_allocate(&tnyAllocator, size);
+	} else if (arena->chunkSize == 0) {
+		return Tny_allocate(&arena->allocator, size);
+	}
+
+	return TnyArena_alloc(arena, size);
+}
+
+static void Tny_release(TnyArena *arena, void *ptr)
+{
+	/* Memory of an arena is only given back when the whole arena is free'd. */
+	if (arena == NULL) {
+		Tny_deallocate(&tnyAllocator, ptr);
+	} else if (arena->chunkSize == 0) {
+		Tny_deallocate(&arena->allocator, ptr);
+	}
+}
+
+static void* Tny_mallocBlock(TnyArena *arena, size_t size)
+{
+	TnyArenaBlock *block = NULL;
+	size_t offset = TNY_ALIGN(sizeof(TnyArenaBlock));
+
+	/* Memory which is replaced over and over would pile up in the chunks, so it is taken
+	   from the allocator and only tracked by the arena, which releases what is left. */
+	if (arena == NULL || arena->chunkSize == 0) {
+		return Tny_malloc(arena, size);
+	}
+
+	block = Tny_allocate(&arena->allocator, offset + size);
+	if (block == NULL) {
+		return NULL;
+	}
+	block->prev = NULL;
+	block->next = arena->blocks;
+	if (arena->blocks != NULL) {
+		arena->blocks->prev = block;
+	}
+	arena->blocks = block;
+
+	return (char*)block + offset;
+}
+
+static void Tny_releaseBlock(TnyArena *arena, void *ptr)
+{
+	TnyArenaBlock *block = NULL;
+
+	if (arena == NULL || arena->chunkSize == 0) {
+		Tny_release(arena, ptr);
+	} else if (ptr != NULL) {
+		block = (TnyArenaBlock*)((char*)ptr - TNY_ALIGN(sizeof(TnyArenaBlock)));
+		if (block->prev != NULL) {
+			block->prev->next = block->next;
+		} else {
+			arena->blocks = block->next;
+		}
+		if (block->next != NULL) {
+			block->next->prev = block->prev;
+		}
+		Tny_deallocate(&arena->allocator, block);
+	}
+}
+
+static uint32_t Tny_hash(const char *key, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	/* FNV-1a */
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)key[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static int TnyIndex_build(Tny *root)
+{
+	struct _TnyIndex *index = NULL;
+	Tny *next = NULL;
+	size_t capacity = 2 * TNY_INDEX_THRESHOLD;
+	size_t i = 0;
+
+	/* Arrays store the elements in order, dictionaries use a linear probing hash table. */
+	while (capacity < (root->type == TNY_ARRAY ? 1 : 2) * ((size_t)root->size + 1)) {
+		capacity *= 2;
+	}
+
+	index = Tny_mallocBlock(root->arena, sizeof(struct _TnyIndex) + capacity * sizeof(Tny*));
+	if (index == NULL) {
+		return 0;
+	}
+	memset(index->slots, 0, capacity * sizeof(Tny*));
+	index->capacity = capacity;
+	index->used = 0;
+	index->deleted = 0;
+
+	for (next = root->next; next != NULL; next = next->next) {
+		if (root->type == TNY_ARRAY) {
+			index->slots[index->used++] = next;
+		} else if (next->key != NULL) {
+			i = next->keyHash & (capacity - 1);
+			while (index->slots[i] != NULL) {
+				i = (i + 1) & (capacity - 1);
+			}
+			index->slots[i] = next;
+			index->used++;
+		}
+	}
+
+	TnyIndex_free(root);
+	root->index = index;
+
+	return 1;
+}
+
+static void TnyIndex_insert(Tny *root, Tny *tny)
+{
+	struct _TnyIndex *index = root->index;
+	size_t i = 0;
+
+	if (index == NULL && root->size >= TNY_INDEX_THRESHOLD) {
+		/* Built while the document is changed anyway, so lookups only ever read it. */
+		TnyIndex_build(root);
+	} else if (index != NULL) {
+		if ((index->used + index->deleted + 1) * 4 > index->capacity * 3) {
+			/* The new element is already chained, so a rebuild picks it up. */
+			if (!TnyIndex_build(root)) {
+				TnyIndex_free(root);
+			}
+		} else {
+			i = tny->keyHash & (index->capacity - 1);
+			while (index->slots[i] != NULL && index->slots[i] != TNY_INDEX_DELETED) {
+				i = (i + 1) & (index->capacity - 1);
+			}
+			if (index->slots[i] == TNY_INDEX_DELETED) {
+				index->deleted--;
+			}
+			index->slots[i] = tny;
+			index->used++;
+		}
+	}
+}
+
+static void TnyIndex_remove(Tny *root, Tny *tny)
+{
+	struct _TnyIndex *index = root->index;
+	size_t i = 0;
+
+	if (index != NULL) {
+		i = tny->keyHash & (index->capacity - 1);
+		while (index->slots[i] != NULL) {
+			if (index->slots[i] == tny) {
+				index->slots[i] = TNY_INDEX_DELETED;
+				index->used--;
+				index->deleted++;
+				break;
+			}
+			i = (i + 1) & (index->capacity - 1);
+		}
+	}
+}
+
+static void TnyIndex_append(Tny *root, Tny *tny)
+{
+	struct _TnyIndex *index = root->index;
+	size_t i = 0;
+
+	if (index == NULL && root->size >= TNY_INDEX_THRESHOLD) {
+		TnyIndex_build(root);
+	} else if (index != NULL) {
+		if (index->used == index->capacity) {
+			/* The new element is already chained, so a rebuild picks it up. */
+			if (!TnyIndex_build(root)) {
+				TnyIndex_free(root);
+			}
+		} else if (root->tail == tny) {
+			index->slots[index->used++] = tny;
+		} else {
+			/* Every position behind the new element moves up by one. */
+			i = tny->prev == root ? 0 : TnyIndex_position(index, tny->prev) + 1;
+			if (i <= index->used) {
+				memmove(index->slots + i + 1, index->slots + i, (index->used - i) * sizeof(Tny*));
+				index->slots[i] = tny;
+				index->used++;
+			} else {
+				TnyIndex_free(root);
+			}
+		}
+	}
+}
+
+static size_t TnyIndex_position(const struct _TnyIndex *index, const Tny *tny)
+{
+	size_t i = 0;
+
+	while (i < index->used && index->slots[i] != tny) {
+		i++;
+	}
+
+	return i;
+}
+
+static void TnyIndex_free(Tny *root)
+{
+	if (root->index != NULL) {
+		Tny_releaseBlock(root->arena, root->index);
+		root->index = NULL;
+	}
+}
+
+static Tny* Tny_find(const Tny *root, const char *key, size_t len, uint32_t hash)
+{
+	const struct _TnyIndex *index = root->index;
+	Tny *next = NULL;
+	size_t i = 0;
+
+	if (index != NULL) {
+		i = hash & (index->capacity - 1);
+		for (next = index->slots[i]; next != NULL; next = index->slots[i]) {
+			if (next != TNY_INDEX_DELETED && next->keyHash == hash && next->keyLength == len
+				&& memcmp(next->key, key, len) == 0) {
+				return next;
+			}
+			i = (i + 1) & (index->capacity - 1);
+		}
+	} else {
+		for (next = root->next; next != NULL; next = next->next) {
+			if (next->key != NULL && next->keyHash == hash && next->keyLength == len
+				&& memcmp(next->key, key, len) == 0) {
+				return next;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+Tny* Tny_newArena(TnyType type, size_t chunkSize)
+{
+	TnyArena *arena = NULL;
+	Tny *tny = NULL;
+
+	if (type == TNY_ARRAY || type == TNY_DICT) {
+		arena = TnyArena_create(chunkSize, NULL);
+		if (arena != NULL) {
+			tny = _Tny_add(NULL, type, NULL, NULL, 0, arena, 0);
+			if (tny != NULL) {
+				arena->owner = tny;
+			} else {
+				TnyArena_free(arena);
+			}
+		}
+	}
+
+	return tny;
+}
+
+Tny* Tny_newWithAllocator(TnyType type, const TnyAllocator *allocator)
+{
+	TnyArena *arena = NULL;
+	Tny *tny = NULL;
+
+	/* The document gets an arena without chunks which hands every allocation to the allocator. */
+	if ((type == TNY_ARRAY || type == TNY_DICT) && allocator != NULL) {
+		arena = TnyArena_create(0, allocator);
+		if (arena != NULL) {
+			tny = _Tny_add(NULL, type, NULL, NULL, 0, arena, 0);
+			if (tny != NULL) {
+				arena->owner = tny;
+			} else {
+				TnyArena_free(arena);
+			}
+		}
+	}
+
+	return tny;
+}
+
 Tny* Tny_add(Tny *prev, TnyType type, char *key, void *value, uint64_t size)
+{
+	return _Tny_add(prev, type, key, value, size, NULL, 0);
+}
+
+static Tny* _Tny_add(Tny *prev, TnyType type, char *key, void *value, uint64_t size, TnyArena *arena, int flags)
 {
 	Tny *tny = NULL;
 	enum {CHECK_PRECONDITIONS, ALLOCATE, CHAIN, SET_KEY, SET_VALUE, FAILED};
@@ -24,6 +857,10 @@ Tny* Tny_add(Tny *prev, TnyType type, char *key, void *value, uint64_t size)
 	int isoverwrite = 0;
 	size_t keyLen = 0;
 
+	if (prev != NULL) {
+		arena = prev->root->arena;
+	}
+
 	while (loop) {
 		switch (status) {
 		case CHECK_PRECONDITIONS:
@@ -31,10 +868,15 @@ Tny* Tny_add(Tny *prev, TnyType type, char *key, void *value, uint64_t size)
 				(prev == NULL && (type == TNY_ARRAY || type == TNY_DICT))) {
 
 				status = ALLOCATE;
-				if (prev != NULL && prev->root->type == TNY_DICT && key == NULL) {
+				if (prev != NULL && (flags & TNY_ADD_REPLACE)) {
+					tny = prev;
+					Tny_freeValue(tny);
+					status = SET_VALUE;
+					isoverwrite = 1;
+				} else if (prev != NULL && prev->root->type == TNY_DICT && key == NULL) {
 					/* Dict must have a key! */
 					status = FAILED;
-				} else if (key != NULL && prev != NULL && prev->root->type == TNY_DICT) {
+				} else if (key != NULL && prev != NULL && prev->root->type == TNY_DICT && !(flags & TNY_ADD_UNIQUE)) {
 					tny = Tny_get(prev, key);
 					if (tny != NULL) {
 						Tny_freeValue(tny);
@@ -47,10 +889,17 @@ Tny* Tny_add(Tny *prev, TnyType type, char *key, void *value, uint64_t size)
 			}
 			break;
 		case ALLOCATE:
-			tny = malloc(sizeof(Tny));
+			tny = Tny_malloc(arena, sizeof(Tny));
 
 			if (tny != NULL) {
 				memset(tny, 0, sizeof(Tny));
+				TNY_COUNT(nodes, 1);
+				TNY_COUNT(elements, 1);
+#ifdef TNY_STATS
+				if (arena != NULL && arena->chunkSize > 0) {
+					arena->nodes++;
+				}
+#endif
 				status = CHAIN;
 			} else {
 				status = FAILED;
@@ -68,10 +917,18 @@ Tny* Tny_add(Tny *prev, TnyType type, char *key, void *value, uint64_t size)
 
 					tny->root = prev->root;
 					tny->root->size++;
-					tny->docSizePtr  = tny->root->docSizePtr;
+					tny->docSizePtr  = &tny->root->docSize;
+					if (tny->next == NULL) {
+						tny->root->tail = tny;
+					}
+					if (tny->root->type == TNY_ARRAY) {
+						TnyIndex_append(tny->root, tny);
+					}
 				} else {
 					tny->root = tny;
+					tny->tail = tny;
 					tny->docSizePtr = &tny->docSize;
+					tny->arena = arena;
 				}
 			}
 
@@ -83,10 +940,20 @@ Tny* Tny_add(Tny *prev, TnyType type, char *key, void *value, uint64_t size)
 			break;
 		case SET_KEY:
 			keyLen = strlen(key) + 1;
-			tny->key = malloc(keyLen);
+			if (flags & (TNY_ADD_BORROW | TNY_ADD_SHARED)) {
+				tny->key = key;
+				tny->flags |= TNY_BORROWED_KEY;
+			} else {
+				tny->key = Tny_malloc(arena, keyLen);
+				if (tny->key != NULL) {
+					memcpy(tny->key, key, keyLen);
+				}
+			}
 
 			if (tny->key != NULL) {
-				memcpy(tny->key, key, keyLen);
+				tny->keyLength = keyLen - 1;
+				tny->keyHash = Tny_hash(key, keyLen - 1);
+				TnyIndex_insert(tny->root, tny);
 				Tny_addSize(tny, sizeof(uint32_t) + keyLen);
 				status = SET_VALUE;
 			} else {
@@ -101,21 +968,44 @@ Tny* Tny_add(Tny *prev, TnyType type, char *key, void *value, uint64_t size)
 				tny->size = size;
 				/* Set value */
 				if (tny->type == TNY_OBJ) {
-					if (value != NULL) {
-						tny->value.tny = Tny_copy(tny->root->docSizePtr, value);
+					if (value != NULL && (flags & TNY_ADD_ADOPT)) {
+						tny->value.tny = value;
+						Tny_attach(value, &tny->root->docSize);
+					} else if (value != NULL) {
+						tny->value.tny = _Tny_copy(&tny->root->docSize, value, arena);
 						if (tny->value.tny == NULL) {
 							status = FAILED;
 							break;
 						}
 					}
 				} else if (tny->type == TNY_BIN) {
-					tny->value.ptr = malloc(size);
+					if (flags & TNY_ADD_TAKE) {
+						tny->value.ptr = value;
+					} else if (flags & TNY_ADD_BORROW) {
+						tny->value.ptr = value;
+						tny->flags |= TNY_BORROWED_VALUE;
+					} else {
+						tny->value.ptr = Tny_malloc(arena, size);
 
-					if (tny->value.ptr != NULL) {
-						memcpy(tny->value.ptr, value, size);
+						if (tny->value.ptr != NULL) {
+							memcpy(tny->value.ptr, value, size);
+						} else {
+							status = FAILED;
+							break;
+						}
+					}
+				} else if (Tny_packedWidth(tny->type) > 0) {
+					if (flags & TNY_ADD_TAKE) {
+						tny->value.ptr = value;
 					} else {
-						status = FAILED;
-						break;
+						tny->value.ptr = Tny_malloc(arena, size > 0 ? size * Tny_packedWidth(tny->type) : 1);
+
+						if (tny->value.ptr != NULL) {
+							memcpy(tny->value.ptr, value, size * Tny_packedWidth(tny->type));
+						} else {
+							status = FAILED;
+							break;
+						}
 					}
 				} else if (tny->type == TNY_CHAR) {
 					tny->value.chr = *((char*)value);
@@ -134,8 +1024,10 @@ Tny* Tny_add(Tny *prev, TnyType type, char *key, void *value, uint64_t size)
 			break;
 		case FAILED:
 			if (tny != NULL && !isoverwrite) {
-				free(tny->key);
-				free(tny);
+				if (tny->root != NULL && tny->root != tny) {
+					Tny_unlink(tny);
+				}
+				Tny_releaseNode(arena, tny);
 			}
 			tny = NULL;
 			loop = 0;
@@ -147,23 +1039,66 @@ Tny* Tny_add(Tny *prev, TnyType type, char *key, void *value, uint64_t size)
 	return isoverwrite ? prev : tny;
 }
 
-Tny* Tny_copy(size_t *docSizePtr, const Tny *src)
+Tny* Tny_append(Tny *tny, TnyType type, char *key, void *value, uint64_t size)
 {
-	Tny *dest = NULL;
-	Tny *newObj = NULL;
-	Tny *next = NULL;
+	return Tny_add(tny->root->tail, type, key, value, size);
+}
 
-	for (next = src->root; next != NULL; next = next->next) {
-		if (next->type == TNY_BIN || next->type == TNY_OBJ) {
-			newObj = Tny_add(dest, next->type, next->key, next->value.ptr, next->size);
-		} else {
-			newObj = Tny_add(dest, next->type, next->key, &next->value.num, next->size);
-		}
+Tny* Tny_addOwned(Tny *prev, char *key, Tny *value)
+{
+	Tny *top = NULL;
+	Tny *tny = NULL;
 
-		if (newObj != NULL) {
-			if (dest == NULL) {
-				newObj->docSizePtr = docSizePtr;
-				*docSizePtr += newObj->docSize;
+	if (prev == NULL || value == NULL) {
+		return NULL;
+	}
+
+	value = value->root;
+	if (value->docSizePtr != &value->docSize) {
+		return NULL;
+	}
+
+	/* Adding a document to itself would create a cycle. */
+	for (top = prev->root; top->docSizePtr != &top->docSize; top = TNY_PARENT(top));
+	if (top == value) {
+		return NULL;
+	}
+
+	if (prev->root->arena != NULL) {
+		/* Freeing the arena would not free the elements of \p value, so they get copied into it. */
+		tny = Tny_add(prev, TNY_OBJ, key, value, 0);
+		if (tny != NULL) {
+			Tny_free(value);
+		}
+	} else {
+		tny = _Tny_add(prev, TNY_OBJ, key, value, 0, NULL, TNY_ADD_ADOPT);
+	}
+
+	return tny;
+}
+
+Tny* Tny_copy(size_t *docSizePtr, const Tny *src)
+{
+	return _Tny_copy(docSizePtr, src, NULL);
+}
+
+static Tny* _Tny_copy(size_t *docSizePtr, const Tny *src, TnyArena *arena)
+{
+	Tny *dest = NULL;
+	Tny *newObj = NULL;
+	Tny *next = NULL;
+
+	TNY_COUNT(copies, 1);
+	for (next = src->root; next != NULL; next = next->next) {
+		if (next->type == TNY_BIN || next->type == TNY_OBJ || Tny_packedWidth(next->type) > 0) {
+			newObj = _Tny_add(dest, next->type, next->key, next->value.ptr, next->size, arena, TNY_ADD_UNIQUE);
+		} else {
+			newObj = _Tny_add(dest, next->type, next->key, &next->value.num, next->size, arena, TNY_ADD_UNIQUE);
+		}
+
+		if (newObj != NULL) {
+			if (dest == NULL && docSizePtr != NULL) {
+				Tny_attach(newObj, docSizePtr);
 			}
 			dest = newObj;
 		} else {
@@ -177,48 +1112,140 @@ Tny* Tny_copy(size_t *docSizePtr, const Tny *src)
 
 void Tny_addSize(Tny *tny, size_t size)
 {
-	*tny->docSizePtr += size;
-	if (tny->docSizePtr != &tny->docSize) {
+	Tny *root = tny->root;
+
+	if (tny != root) {
 		tny->docSize += size;
 	}
 
-	if (tny->docSizePtr != &tny->root->docSize) {
-		tny->root->docSize += size;
+	/* Every document above contains this one, so all of them grow. */
+	root->docSize += size;
+	Tny_dropCache(root);
+	while (root->docSizePtr != &root->docSize) {
+		root = TNY_PARENT(root);
+		root->docSize += size;
+		Tny_dropCache(root);
 	}
 }
 
 void Tny_subSize(Tny *tny, size_t size)
 {
-	*tny->docSizePtr -= size;
-	if (tny->docSizePtr != &tny->docSize) {
+	Tny *root = tny->root;
+
+	if (tny != root) {
 		tny->docSize -= size;
 	}
 
-	if (tny->docSizePtr != &tny->root->docSize) {
-		tny->root->docSize -= size;
+	root->docSize -= size;
+	Tny_dropCache(root);
+	while (root->docSizePtr != &root->docSize) {
+		root = TNY_PARENT(root);
+		root->docSize -= size;
+		Tny_dropCache(root);
+	}
+}
+
+static void Tny_attach(Tny *root, size_t *docSizePtr)
+{
+	Tny *parent = root;
+
+	root->docSizePtr = docSizePtr;
+	while (parent->docSizePtr != &parent->docSize) {
+		parent = TNY_PARENT(parent);
+		parent->docSize += root->docSize;
+		Tny_dropCache(parent);
+	}
+}
+
+static void Tny_detach(Tny *root)
+{
+	Tny *parent = root;
+
+	while (parent->docSizePtr != &parent->docSize) {
+		parent = TNY_PARENT(parent);
+		parent->docSize -= root->docSize;
+		Tny_dropCache(parent);
+	}
+	root->docSizePtr = &root->docSize;
+}
+
+static void Tny_dropCache(Tny *root)
+{
+	if (root->cache != NULL) {
+		Tny_releaseBlock(root->arena, root->cache);
+		root->cache = NULL;
+	}
+}
+
+static void Tny_keepCache(Tny *root, const char *data, size_t size, int flags)
+{
+	Tny_dropCache(root);
+	root->cache = Tny_mallocBlock(root->arena, sizeof(struct _TnyCache) + size);
+	if (root->cache != NULL) {
+		root->cache->flags = flags;
+		root->cache->size = size;
+		memcpy(root->cache->data, data, size);
 	}
 }
 
 void Tny_remove(Tny *tny)
 {
+	TnyArena *arena = NULL;
+
 	if (tny != NULL) {
+		arena = tny->root->arena;
 		if (tny->root == tny) {
 			Tny_free(tny);
 		} else {
-			tny->root->size--;
-			if (tny->root->type == TNY_DICT) {
-				Tny_subSize(tny, sizeof(uint32_t) + strlen(tny->key) + 1);
-			}
-
-			tny->prev->next = tny->next;
-			if (tny->next != NULL) {
-				tny->next->prev = tny->prev;
-			}
+			Tny_unlink(tny);
 			Tny_freeValue(tny);
-			free(tny->key);
-			free(tny);
+			Tny_releaseNode(arena, tny);
+		}
+	}
+}
+
+static void Tny_unlink(Tny *tny)
+{
+	Tny *root = tny->root;
+	size_t i = 0;
+
+	root->size--;
+	if (tny->key != NULL) {
+		TnyIndex_remove(root, tny);
+		Tny_subSize(tny, sizeof(uint32_t) + tny->keyLength + 1);
+	} else if (root->type == TNY_ARRAY && root->index != NULL) {
+		i = root->tail == tny ? root->index->used - 1 : TnyIndex_position(root->index, tny);
+		if (i < root->index->used) {
+			memmove(root->index->slots + i, root->index->slots + i + 1, (root->index->used - i - 1) * sizeof(Tny*));
+			root->index->used--;
 		}
 	}
+
+	if (root->tail == tny) {
+		root->tail = tny->prev;
+	}
+
+	tny->prev->next = tny->next;
+	if (tny->next != NULL) {
+		tny->next->prev = tny->prev;
+	}
+}
+
+static void Tny_freeKey(TnyArena *arena, Tny *tny)
+{
+	if (!(tny->flags & TNY_BORROWED_KEY)) {
+		Tny_release(arena, tny->key);
+	}
+}
+
+static void Tny_releaseNode(TnyArena *arena, Tny *tny)
+{
+	Tny_freeKey(arena, tny);
+	Tny_release(arena, tny);
+	/* Elements in arena chunks stay allocated until the arena is free'd. */
+	if (arena == NULL || arena->chunkSize == 0) {
+		TNY_UNCOUNT(nodes, 1);
+	}
 }
 
 Tny* Tny_at(const Tny* tny, size_t index)
@@ -227,6 +1254,11 @@ Tny* Tny_at(const Tny* tny, size_t index)
 	Tny *result = NULL;
 	size_t count = 0;
 
+	tny = tny->root;
+	if (tny->index != NULL && tny->type == TNY_ARRAY) {
+		return index < tny->index->used ? tny->index->slots[index] : NULL;
+	}
+
 	for (next = tny->root; next != NULL; next = next->next) {
 		if (next == tny->root) {
 			continue;
@@ -244,304 +1276,4336 @@ Tny* Tny_at(const Tny* tny, size_t index)
 
 Tny* Tny_get(const Tny* tny, const char *key)
 {
-	Tny *next = NULL;
 	Tny *result = NULL;
 	size_t len = 0;
 
 	if (key != NULL) {
 		len = strlen(key);
-		for (next = tny->root; next != NULL; next = next->next) {
-			if (next == tny->root) {
-				continue;
-			}
-
-			if (next->key != NULL && len == strlen(next->key) && memcmp(next->key, key, len) == 0) {
-				result = next;
-				break;
-			}
-		}
+		result = Tny_find(tny->root, key, len, Tny_hash(key, len));
 	}
 
 	return result;
 }
 
-size_t Tny_valueSize(TnyType type, size_t size)
+Tny* Tny_diff(const Tny *from, const Tny *to)
 {
-	size_t result = 1; /* Because of value type field. */
+	Tny *patch = NULL;
 
-	if (type == TNY_ARRAY || type == TNY_DICT) {
-		result += sizeof(uint32_t); /* Number of elements field. */
-	} else if (type == TNY_OBJ) {
-		result += 0; /* only the type field is needed. */
-	} else if (type == TNY_NULL) {
-		result += 0; /* No data necessary */
-	} else if (type == TNY_BIN) {
-		result += sizeof(uint32_t) + size; /* tny->size size + value size */
-	} else if (type == TNY_CHAR) {
-		result += 1;
-	} else if (type == TNY_INT32) {
-		result += sizeof(uint32_t);
-	} else if (type == TNY_INT64) {
-		result += sizeof(uint64_t);
-	} else if (type == TNY_DOUBLE) {
-		result += sizeof(double);
+	if (from == NULL || to == NULL || from->root->type != to->root->type) {
+		return NULL;
 	}
 
-	return result;
+	patch = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	if (patch != NULL && !Tny_diffDocument(patch, from->root, to->root, NULL)) {
+		Tny_free(patch);
+		patch = NULL;
+	}
+
+	return patch;
 }
 
-size_t _Tny_dumps(const Tny *tny, char *data, size_t pos)
+int Tny_patch(Tny *doc, const Tny *patch)
 {
-	const Tny *next = NULL;
-	uint32_t size = 0;
+	const Tny *operation = NULL;
+	const Tny *op = NULL;
+	const Tny *path = NULL;
+	const Tny *step = NULL;
+	Tny *root = NULL;
+	Tny *element = NULL;
 
-	for (next = tny; next != NULL; next = next->next) {
-		/* Add the data type */
-		data[pos++] = next->type;
+	if (doc == NULL || patch == NULL || patch->root->type != TNY_ARRAY) {
+		return 0;
+	}
 
-		/* Add the number of elements if this is the root element. */
-		if (next->type == TNY_ARRAY || next->type == TNY_DICT) {
-			Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&next->size);
-			pos += sizeof(uint32_t);
-			continue;
+	for (operation = patch->root->next; operation != NULL; operation = operation->next) {
+		if (operation->type != TNY_OBJ || operation->value.tny == NULL) {
+			return 0;
 		}
-
-		/* Add the key if this is a dictionary */
-		if (next->root->type == TNY_DICT) {
-			size = strlen(next->key) + 1;
-			Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&size);
-			pos += sizeof(uint32_t);
-			memcpy((data + pos), next->key, size);
-			pos += size;
+		op = operation->value.tny->next;
+		path = op != NULL ? op->next : NULL;
+		if (op == NULL || op->type != TNY_CHAR || path == NULL || path->type != TNY_OBJ
+			|| path->value.tny == NULL || path->value.tny->next == NULL) {
+			return 0;
 		}
 
-		/* Add the value */
-		if (next->type == TNY_OBJ) {
-			if (next->value.tny != NULL) {
-				pos = _Tny_dumps(next->value.tny, data, pos);
-			} else {
-				pos = 0;
-				break;
+		/* Every step but the last one leads into a sub document. */
+		root = doc->root;
+		for (step = path->value.tny->next; step->next != NULL; step = step->next) {
+			element = Tny_patchElement(root, step);
+			if (element == NULL || element->type != TNY_OBJ || element->value.tny == NULL) {
+				return 0;
 			}
-		} else if (next->type == TNY_BIN) {
-			Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&next->size);
-			pos += sizeof(uint32_t);
-			memcpy((data + pos), next->value.ptr, next->size);
-			pos += next->size;
-		} else if (next->type == TNY_CHAR) {
-			data[pos++] = next->value.chr;
-		} else if (next->type == TNY_INT32) {
-			Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&next->value.num);
-			pos += sizeof(uint32_t);
-		} else if (next->type == TNY_INT64) {
-			Tny_swapBytes64((uint64_t*)(data + pos), (const char*)&next->value.num);
-			pos += sizeof(uint64_t);
-		} else if (next->type == TNY_DOUBLE) {
-			Tny_swapBytes64((uint64_t*)(data + pos), (const char*)&next->value.num);
-			pos += sizeof(double);
+			root = element->value.tny;
+		}
+
+		if (!Tny_patchOp(root, op->value.chr, step, path->next)) {
+			return 0;
 		}
 	}
 
-	return pos;
+	return 1;
 }
 
-size_t Tny_dumps(const Tny *tny, void **data)
+static int Tny_equalValue(const Tny *left, const Tny *right)
 {
-	size_t size = 0;
+	size_t width = Tny_packedWidth(left->type);
 
-	*data = NULL;
-	tny = tny->root;
-	size = tny->docSize;
-	*data = malloc(size);
-	if (*data != NULL) {
-		size = _Tny_dumps(tny, *data, 0);
-		if (size == 0) {
-			free(*data);
-			*data = NULL;
-		}
-	} else {
-		size = 0;
+	if (left->type != right->type || left->size != right->size) {
+		return 0;
 	}
 
-	return size;
+	if (left->type == TNY_OBJ) {
+		return Tny_equalDocument(left->value.tny, right->value.tny);
+	} else if (left->type == TNY_BIN) {
+		return left->size == 0 || memcmp(left->value.ptr, right->value.ptr, left->size) == 0;
+	} else if (width > 0) {
+		return left->size == 0 || memcmp(left->value.ptr, right->value.ptr, left->size * width) == 0;
+	} else if (left->type == TNY_CHAR) {
+		return left->value.chr == right->value.chr;
+	} else if (left->type == TNY_DOUBLE) {
+		return memcmp(&left->value.flt, &right->value.flt, sizeof(double)) == 0;
+	}
+
+	return left->type == TNY_NULL || left->value.num == right->value.num;
 }
 
-Tny* _Tny_loads(char *data, size_t length, size_t *pos, size_t *docSizePtr)
+static int Tny_equalDocument(const Tny *left, const Tny *right)
 {
-	Tny *tny = NULL;
-	Tny *newObj = NULL;
-	TnyType type = TNY_NULL;
-	uint32_t size = 0;
-	uint32_t i32 = 0;
-	uint64_t i64 = 0;
-	double flt = 0.0f;
-	char *key = NULL;
-	uint64_t counter = 0;
-	uint64_t elements = 0;
-
-	while ((*pos) < length && (counter == 0 || counter < elements)) {
-		type = data[(*pos)++];
-		if (tny == NULL) {
-			if (type == TNY_ARRAY || type == TNY_DICT) {
-				HASNEXTDATA(sizeof(uint32_t));
-				Tny_swapBytes32(&size, (const char*)(data + (*pos)));
-				*pos += sizeof(uint32_t);
-				elements = size;
-				tny = Tny_add(NULL, type, NULL, NULL, size);
-				if (tny != NULL) {
-					if (docSizePtr != NULL) {
-						tny->docSizePtr = docSizePtr;
-						*tny->docSizePtr += tny->docSize;
-					}
-				} else {
-					break;
-				}
+	const Tny *l = NULL;
+	const Tny *r = NULL;
 
-				if (elements == 0) {
-					break;
-				} else {
-					continue;
-				}
-			} else {
-				break;
-			}
-		}
+	if (left == right) {
+		return 1;
+	}
 
-		if (tny->root->type == TNY_DICT) {
-			HASNEXTDATA(sizeof(uint32_t));
-			Tny_swapBytes32(&size, (const char*)(data + (*pos)));
-			*pos += sizeof(uint32_t);
-			HASNEXTDATA(size);
-			if (data[(*pos) + size - 1] == '\0') {
-				key = data + (*pos);
-				*pos += size;
-			} else {
-				break;
-			}
-		} else {
-			key = NULL;
-		}
+	/* The sizes are kept up to date on every change, so most changed documents differ in them. */
+	if (left == NULL || right == NULL || left->type != right->type || left->size != right->size
+		|| left->docSize != right->docSize) {
+		return 0;
+	}
 
-		if (type == TNY_NULL) {
-			tny = Tny_add(tny, type, key, NULL, 0);
-	 	} else if (type == TNY_OBJ) {
-	 		newObj = _Tny_loads(data, length, pos, tny->root->docSizePtr);
-	 		if (newObj != NULL) {
-				tny = Tny_add(tny, type, key, NULL, 0);
-				if (tny != NULL) {
-					tny->value.tny = newObj->root;
-				} else {
-					break;
-				}
-	 		} else {
-	 			break;
-	 		}
-		} else if (type == TNY_BIN) {
-			HASNEXTDATA(sizeof(uint32_t));
-			Tny_swapBytes32(&size, (const char*)(data + (*pos)));
-			*pos += sizeof(uint32_t);
-			HASNEXTDATA(size);
-			tny = Tny_add(tny, type, key, (data + *pos), size);
-			*pos += size;
-		} else if (type == TNY_CHAR) {
-			HASNEXTDATA(1);
-			tny = Tny_add(tny, type, key, (data + *pos), 0);
-			(*pos)++;
-		} else if (type == TNY_INT32) {
-			HASNEXTDATA(sizeof(uint32_t));
-			Tny_swapBytes32(&i32, (const char*)(data + (*pos)));
-			*pos += sizeof(uint32_t);
-			tny = Tny_add(tny, type, key, &i32, 0);
-		} else if (type == TNY_INT64) {
-			HASNEXTDATA(sizeof(uint64_t));
-			Tny_swapBytes64(&i64, (data + (*pos)));
-			*pos += sizeof(uint64_t);
-			tny = Tny_add(tny, type, key, &i64, 0);
-		} else if (type == TNY_DOUBLE) {
-			HASNEXTDATA(sizeof(double));
-			Tny_swapBytes64((uint64_t*)&flt, (data + (*pos)));
-			*pos += sizeof(double);
-			tny = Tny_add(tny, type, key, &flt, 0);
+	for (l = left->next, r = right->next; l != NULL && r != NULL; l = l->next, r = r->next) {
+		if (l->keyLength != r->keyLength || (l->key != NULL && memcmp(l->key, r->key, l->keyLength) != 0)
+			|| !Tny_equalValue(l, r)) {
+			return 0;
 		}
-		counter++;
 	}
 
-	if (tny != NULL) {
-		tny = tny->root;
+	return l == r;
+}
+
+static Tny* Tny_addValue(Tny *prev, char *key, const Tny *src, int flags)
+{
+	void *value = (void*)&src->value.num;
+
+	if (src->type == TNY_BIN || src->type == TNY_OBJ || Tny_packedWidth(src->type) > 0) {
+		value = src->value.ptr;
 	}
 
-	return tny;
+	return _Tny_add(prev, src->type, key, value, src->size, NULL, flags);
 }
 
-Tny* Tny_loads(void *data, size_t length)
+static Tny* Tny_diffPath(Tny *path, const TnyDiffStep *step)
 {
-	size_t pos = 0;
+	if (step->parent != NULL) {
+		path = Tny_diffPath(path, step->parent);
+	}
+
+	if (path == NULL) {
+		return NULL;
+	} else if (step->element != NULL) {
+		/* Keys are stored with their NUL, so a patch can use them directly. */
+		return Tny_add(path, TNY_BIN, NULL, step->element->key, step->element->keyLength + 1);
+	}
 
-	return _Tny_loads(data, length, &pos, NULL);
+	return Tny_add(path, TNY_INT32, NULL, (void*)&step->index, 0);
 }
 
-static uint32_t* Tny_swapBytes32(uint32_t *dest, const char *src)
+static int Tny_diffOp(Tny *patch, char op, const TnyDiffStep *step, const Tny *value)
 {
-	union {
-		uint32_t num;
-		char c[4];
-	} bytes;
-	char c;
+	Tny *operation = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	Tny *path = Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0);
+	Tny *tny = NULL;
 
-	if (ORDER_LITTLE_ENDIAN != HOST_ORDER) {
-		memcpy(&bytes.num, src, sizeof(uint32_t));
-		c = bytes.c[0]; bytes.c[0] = bytes.c[3]; bytes.c[3] = c;
-		c = bytes.c[1]; bytes.c[1] = bytes.c[2]; bytes.c[2] = c;
-		memcpy(dest, &bytes.num, sizeof(uint32_t));
-	} else {
-		memcpy(dest, src, sizeof(uint32_t));
+	if (operation != NULL && path != NULL && Tny_diffPath(path, step) != NULL) {
+		tny = Tny_add(operation, TNY_CHAR, NULL, &op, 0);
+		tny = tny != NULL ? Tny_addOwned(tny, NULL, path) : NULL;
 	}
 
-	return dest;
+	if (tny == NULL) {
+		Tny_free(path);
+	} else if ((value == NULL || Tny_addValue(tny, NULL, value, 0) != NULL)
+		&& Tny_addOwned(patch->root->tail, NULL, operation) != NULL) {
+		return 1;
+	}
+	Tny_free(operation);
+
+	return 0;
 }
 
-static uint64_t* Tny_swapBytes64(uint64_t *dest, const char *src)
+static int Tny_diffPlace(Tny *patch, char op, const TnyDiffStep *step, const Tny *value, const Tny *after)
 {
-	union {
-		uint64_t num;
-		char c[8];
-	} bytes;
-	char c;
+	Tny *operation = NULL;
 
-	if (ORDER_LITTLE_ENDIAN != HOST_ORDER) {
-		memcpy(&bytes.num, src, sizeof(uint64_t));
-		c = bytes.c[0]; bytes.c[0] = bytes.c[7]; bytes.c[7] = c;
-		c = bytes.c[1]; bytes.c[1] = bytes.c[6]; bytes.c[6] = c;
-		c = bytes.c[2]; bytes.c[2] = bytes.c[5]; bytes.c[5] = c;
-		c = bytes.c[3]; bytes.c[3] = bytes.c[4]; bytes.c[4] = c;
-		memcpy(dest, &bytes.num, sizeof(uint64_t));
-	} else {
-		memcpy(dest, src, sizeof(uint64_t));
+	if (!Tny_diffOp(patch, op, step, value)) {
+		return 0;
 	}
 
-	return dest;
+	/* The element is placed behind the key of its predecessor, a null places it first. */
+	operation = patch->root->tail->value.tny;
+	if (after != NULL) {
+		return Tny_add(operation->tail, TNY_BIN, NULL, after->key, after->keyLength + 1) != NULL;
+	}
+
+	return Tny_add(operation->tail, TNY_NULL, NULL, NULL, 0) != NULL;
 }
 
-int Tny_hasNext(const Tny *tny)
+static int Tny_diffOrdered(const Tny *from, const Tny *to)
 {
-	return tny->next != NULL;
+	const Tny *left = from->next;
+	const Tny *right = to->next;
+
+	/* Removed and inserted keys are skipped, the keys both documents have are compared in order. */
+	while (1) {
+		while (left != NULL && Tny_find(to, left->key, left->keyLength, left->keyHash) == NULL) {
+			left = left->next;
+		}
+		while (right != NULL && Tny_find(from, right->key, right->keyLength, right->keyHash) == NULL) {
+			right = right->next;
+		}
+		if (left == NULL || right == NULL) {
+			return left == right;
+		} else if (left->keyLength != right->keyLength || memcmp(left->key, right->key, left->keyLength) != 0) {
+			return 0;
+		}
+		left = left->next;
+		right = right->next;
+	}
 }
 
-Tny* Tny_next(const Tny *tny)
+static void* Tny_diffKeep(const Tny *from, const Tny *to, char **keep)
 {
-	return tny->next;
-}
+	const Tny **rights = NULL;
+	const Tny *left = NULL;
+	const Tny *right = NULL;
+	uint64_t *pairs = NULL;
+	uint32_t *order = NULL;
+	uint32_t *tails = NULL;
+	uint32_t *links = NULL;
+	uint32_t count = 0;
+	uint32_t length = 0;
+	uint32_t i = 0;
+	size_t low = 0;
+	size_t high = 0;
+	size_t mid = 0;
+	char *block = Tny_malloc(NULL, to->size * (sizeof(Tny*) + sizeof(uint64_t) + 1) + from->size * 3 * sizeof(uint32_t) + 1);
+
+	if (block == NULL) {
+		return NULL;
+	}
+	rights = (const Tny**)block;
+	pairs = (uint64_t*)(rights + to->size);
+	order = (uint32_t*)(pairs + to->size);
+	tails = order + from->size;
+	links = tails + from->size;
+	*keep = (char*)(links + from->size);
+
+	for (right = to->next; right != NULL; right = right->next, i++) {
+		rights[i] = right;
+		pairs[i] = (uint64_t)right->keyHash << 32 | i;
+		(*keep)[i] = 0;
+	}
+	qsort(pairs, to->size, sizeof(uint64_t), Tny_compareOffsets);
+
+	/* The positions in to of the keys both documents have, in the order of from. */
+	for (left = from->next; left != NULL; left = left->next) {
+		right = Tny_find(to, left->key, left->keyLength, left->keyHash);
+		if (right != NULL) {
+			low = 0;
+			high = to->size;
+			while (low < high) {
+				mid = low + (high - low) / 2;
+				if ((uint32_t)(pairs[mid] >> 32) < right->keyHash) {
+					low = mid + 1;
+				} else {
+					high = mid;
+				}
+			}
+			while (rights[(uint32_t)pairs[low]] != right) {
+				low++;
+			}
+			order[count++] = (uint32_t)pairs[low];
+		}
+	}
+
+	/* The longest increasing run of positions stays in place, every other element is moved. */
+	for (i = 0; i < count; i++) {
+		low = 0;
+		high = length;
+		while (low < high) {
+			mid = low + (high - low) / 2;
+			if (order[tails[mid]] < order[i]) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		links[i] = low > 0 ? tails[low - 1] : UINT32_MAX;
+		tails[low] = i;
+		if (low == length) {
+			length++;
+		}
+	}
+	for (i = length > 0 ? tails[length - 1] : UINT32_MAX; i != UINT32_MAX; i = links[i]) {
+		(*keep)[order[i]] = 1;
+	}
+
+	return block;
+}
+
+static int Tny_diffElement(Tny *patch, const Tny *from, const Tny *to, const TnyDiffStep *step)
+{
+	if (from->type == TNY_OBJ && to->type == TNY_OBJ && from->value.tny != NULL && to->value.tny != NULL
+		&& from->value.tny->type == to->value.tny->type) {
+		return Tny_diffDocument(patch, from->value.tny, to->value.tny, step);
+	}
+
+	return Tny_equalValue(from, to) || Tny_diffOp(patch, TNY_PATCH_REPLACE, step, to);
+}
+
+static int Tny_diffDocument(Tny *patch, const Tny *from, const Tny *to, const TnyDiffStep *parent)
+{
+	TnyDiffStep step;
+	const Tny *left = NULL;
+	const Tny *right = NULL;
+	const Tny *leftTail = NULL;
+	const Tny *rightTail = NULL;
+	const Tny *lookLeft = NULL;
+	const Tny *lookRight = NULL;
+	const Tny *after = NULL;
+	void *block = NULL;
+	char *keep = NULL;
+	uint32_t suffix = 0;
+	uint32_t remaining = 0;
+	uint32_t missing = 0;
+	uint32_t inserts = 0;
+	uint32_t removes = 0;
+	uint32_t i = 0;
+
+	/* Unchanged sub documents are recognized by a single comparison without any lookups. */
+	if (Tny_equalDocument(from, to)) {
+		return 1;
+	}
+
+	step.parent = parent;
+	step.index = 0;
+	if (from->type == TNY_DICT) {
+		for (left = from->next; left != NULL; left = left->next) {
+			step.element = left;
+			right = Tny_find(to, left->key, left->keyLength, left->keyHash);
+			if (right == NULL) {
+				if (!Tny_diffOp(patch, TNY_PATCH_REMOVE, &step, NULL)) {
+					return 0;
+				}
+			} else if (!Tny_diffElement(patch, left, right, &step)) {
+				return 0;
+			}
+		}
+		/* Inserted and moved elements are placed behind their predecessor, so the keys
+		   end up in the order of to. Moves are only needed if the order changed. */
+		if (!Tny_diffOrdered(from, to) && (block = Tny_diffKeep(from, to, &keep)) == NULL) {
+			return 0;
+		}
+		for (right = to->next, i = 0; right != NULL; after = right, right = right->next, i++) {
+			step.element = right;
+			if (Tny_find(from, right->key, right->keyLength, right->keyHash) == NULL) {
+				if (!Tny_diffPlace(patch, TNY_PATCH_INSERT, &step, right, after)) {
+					break;
+				}
+			} else if (keep != NULL && !keep[i] && !Tny_diffPlace(patch, TNY_PATCH_MOVE, &step, NULL, after)) {
+				break;
+			}
+		}
+		Tny_release(NULL, block);
+
+		return right == NULL;
+	}
+
+	/* Equal elements at the end of an array are kept. From the start on the arrays are walked
+	   in step, on a difference a few elements are looked ahead to tell an inserted or removed
+	   element from a changed one, so one edit does not shift everything behind it. */
+	step.element = NULL;
+	leftTail = from->tail;
+	rightTail = to->tail;
+	while (suffix < from->size && suffix < to->size && Tny_equalValue(leftTail, rightTail)) {
+		suffix++;
+		leftTail = leftTail->prev;
+		rightTail = rightTail->prev;
+	}
+
+	left = from->next;
+	right = to->next;
+	remaining = from->size - suffix;
+	missing = to->size - suffix;
+	while (remaining > 0 || missing > 0) {
+		inserts = missing > 0 && remaining == 0 ? missing : 0;
+		removes = remaining > 0 && missing == 0 ? remaining : 0;
+		if (inserts == 0 && removes == 0 && !Tny_equalValue(left, right)) {
+			lookLeft = left->next;
+			lookRight = right->next;
+			for (i = 1; i <= TNY_DIFF_LOOKAHEAD && inserts == 0 && removes == 0; i++) {
+				if (i < missing && Tny_equalValue(left, lookRight)) {
+					inserts = i;
+				} else if (i < remaining && Tny_equalValue(lookLeft, right)) {
+					removes = i;
+				}
+				lookLeft = i < remaining ? lookLeft->next : lookLeft;
+				lookRight = i < missing ? lookRight->next : lookRight;
+			}
+			if (inserts == 0 && removes == 0) {
+				if (!Tny_diffElement(patch, left, right, &step)) {
+					return 0;
+				}
+				inserts = removes = (uint32_t)-1;
+			}
+		} else if (inserts == 0 && removes == 0) {
+			inserts = removes = (uint32_t)-1;
+		}
+
+		if (inserts == (uint32_t)-1) {
+			/* Both elements are done. */
+			step.index++;
+			left = left->next;
+			right = right->next;
+			remaining--;
+			missing--;
+			continue;
+		}
+		for (i = 0; i < inserts; i++, missing--) {
+			if (!Tny_diffOp(patch, TNY_PATCH_INSERT, &step, right)) {
+				return 0;
+			}
+			step.index++;
+			right = right->next;
+		}
+		for (i = 0; i < removes; i++, remaining--) {
+			if (!Tny_diffOp(patch, TNY_PATCH_REMOVE, &step, NULL)) {
+				return 0;
+			}
+			left = left->next;
+		}
+	}
+
+	return 1;
+}
+
+static int Tny_patchStep(const Tny *root, const Tny *step)
+{
+	if (root->type == TNY_DICT) {
+		return step->type == TNY_BIN && step->size > 0 && ((const char*)step->value.ptr)[step->size - 1] == '\0';
+	}
+
+	return step->type == TNY_INT32;
+}
+
+static Tny* Tny_patchElement(const Tny *root, const Tny *step)
+{
+	if (!Tny_patchStep(root, step)) {
+		return NULL;
+	} else if (root->type == TNY_DICT) {
+		return Tny_find(root, step->value.ptr, step->size - 1, Tny_hash(step->value.ptr, step->size - 1));
+	}
+
+	return step->value.num < root->size ? Tny_at(root, (size_t)step->value.num) : NULL;
+}
+
+static Tny* Tny_patchAfter(const Tny *root, const Tny *after)
+{
+	if (after->type == TNY_NULL) {
+		return (Tny*)root;
+	} else if (!Tny_patchStep(root, after)) {
+		return NULL;
+	}
+
+	return Tny_find(root, after->value.ptr, after->size - 1, Tny_hash(after->value.ptr, after->size - 1));
+}
+
+static int Tny_patchOp(Tny *root, char op, const Tny *step, const Tny *value)
+{
+	Tny *element = NULL;
+	Tny *prev = NULL;
+	uint32_t index = 0;
+
+	if (!Tny_patchStep(root, step)) {
+		return 0;
+	}
+
+	index = (uint32_t)step->value.num;
+	element = Tny_patchElement(root, step);
+
+	if (op == TNY_PATCH_REMOVE && element != NULL) {
+		Tny_remove(element);
+		return 1;
+	} else if (value == NULL) {
+		return 0;
+	} else if (op == TNY_PATCH_REPLACE && element != NULL) {
+		return Tny_addValue(element, NULL, value, TNY_ADD_REPLACE) != NULL;
+	} else if (op == TNY_PATCH_MOVE && root->type == TNY_DICT && element != NULL) {
+		prev = Tny_patchAfter(root, value);
+		if (prev == NULL || prev == element) {
+			return 0;
+		} else if (element->prev != prev) {
+			if (root->tail == element) {
+				root->tail = element->prev;
+			}
+			element->prev->next = element->next;
+			if (element->next != NULL) {
+				element->next->prev = element->prev;
+			}
+			element->prev = prev;
+			element->next = prev->next;
+			prev->next = element;
+			if (element->next != NULL) {
+				element->next->prev = element;
+			} else {
+				root->tail = element;
+			}
+			/* The size stays the same, but the serialized forms above have to be dropped. */
+			Tny_addSize(element, 0);
+		}
+		return 1;
+	} else if (op != TNY_PATCH_INSERT || (root->type == TNY_DICT && element != NULL)) {
+		return 0;
+	}
+
+	if (root->type == TNY_DICT) {
+		/* Patches without a predecessor append the element. */
+		prev = value->next != NULL ? Tny_patchAfter(root, value->next) : root->tail;
+		return prev != NULL && Tny_addValue(prev, step->value.ptr, value, TNY_ADD_UNIQUE) != NULL;
+	}
+
+	prev = index == 0 ? root : Tny_at(root, index - 1);
+	return index <= root->size && prev != NULL && Tny_addValue(prev, NULL, value, 0) != NULL;
+}
+
+size_t Tny_valueSize(TnyType type, size_t size)
+{
+	size_t result = 1; /* Because of value type field. */
+
+	if (type == TNY_ARRAY || type == TNY_DICT) {
+		result += sizeof(uint32_t); /* Number of elements field. */
+	} else if (type == TNY_OBJ) {
+		result += 0; /* only the type field is needed. */
+	} else if (type == TNY_NULL) {
+		result += 0; /* No data necessary */
+	} else if (type == TNY_BIN) {
+		result += sizeof(uint32_t) + size; /* tny->size size + value size */
+	} else if (type == TNY_CHAR) {
+		result += 1;
+	} else if (type == TNY_INT32) {
+		result += sizeof(uint32_t);
+	} else if (type == TNY_INT64) {
+		result += sizeof(uint64_t);
+	} else if (type == TNY_DOUBLE) {
+		result += sizeof(double);
+	} else if (Tny_packedWidth(type) > 0) {
+		result += sizeof(uint32_t) + size * Tny_packedWidth(type); /* Number of values + values */
+	}
+
+	return result;
+}
+
+static int Tny_pushOffset(TnyDumpState *state, uint64_t offset)
+{
+	size_t capacity = state->capacity > 0 ? 2 * state->capacity : 64;
+	uint64_t *offsets = NULL;
+
+	if (state->used == state->capacity) {
+		offsets = Tny_reallocate(state->offsets, capacity * sizeof(uint64_t));
+		if (offsets == NULL) {
+			return 0;
+		}
+		state->offsets = offsets;
+		state->capacity = capacity;
+	}
+	state->offsets[state->used++] = offset;
+
+	return 1;
+}
+
+static int Tny_compareOffsets(const void *left, const void *right)
+{
+	uint64_t l = *(const uint64_t*)left;
+	uint64_t r = *(const uint64_t*)right;
+
+	return (l > r) - (l < r);
+}
+
+static size_t Tny_dumpIndex(const Tny *tny, char *data, size_t start, size_t indexAt, size_t pos, TnyDumpState *state, size_t base)
+{
+	const Tny *next = NULL;
+	uint64_t offset = pos - start;
+	uint32_t hash = 0;
+	uint32_t number = 0;
+	size_t count = state->used - base;
+	size_t i = 0;
+
+	Tny_swapBytes64((uint64_t*)(data + indexAt), (const char*)&offset);
+	for (i = base; i < state->used; i++) {
+		Tny_swapBytes64((uint64_t*)(data + pos), (const char*)&state->offsets[i]);
+		pos += sizeof(uint64_t);
+	}
+
+	if (tny->type == TNY_DICT) {
+		/* Sorting hash and element number as one number orders by hash first. */
+		state->used = base;
+		for (next = tny->next; next != NULL; next = next->next) {
+			if (!Tny_pushOffset(state, ((uint64_t)next->keyHash << 32) | number++)) {
+				return 0;
+			}
+		}
+		qsort(state->offsets + base, count, sizeof(uint64_t), Tny_compareOffsets);
+		for (i = base; i < state->used; i++) {
+			hash = state->offsets[i] >> 32;
+			number = state->offsets[i] & 0xFFFFFFFFu;
+			Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&hash);
+			Tny_swapBytes32((uint32_t*)(data + pos + sizeof(uint32_t)), (const char*)&number);
+			pos += 2 * sizeof(uint32_t);
+		}
+	}
+	state->used = base;
+
+	return pos;
+}
+
+static size_t Tny_indexSize(const Tny *tny)
+{
+	const Tny *next = NULL;
+	size_t size = sizeof(uint64_t) + tny->size * sizeof(uint64_t) * (tny->type == TNY_DICT ? 2 : 1);
+
+	for (next = tny->next; next != NULL; next = next->next) {
+		if (next->type == TNY_OBJ && next->value.tny != NULL) {
+			size += Tny_indexSize(next->value.tny);
+		}
+	}
+
+	return size;
+}
+
+static size_t Tny_compactSize(const Tny *tny)
+{
+	const Tny *next = NULL;
+	size_t size = 1 + Tny_varintSize(tny->size);
+
+	if (tny->cache != NULL && tny->cache->flags == TNY_DUMP_COMPACT) {
+		return tny->cache->size;
+	}
+
+	for (next = tny->next; next != NULL; next = next->next) {
+		size++;
+		if (tny->type == TNY_DICT) {
+			size += Tny_varintSize(next->keyLength + 1) + next->keyLength + 1;
+		}
+
+		if (next->type == TNY_OBJ && next->value.tny != NULL) {
+			size += Tny_compactSize(next->value.tny);
+		} else if (next->type == TNY_BIN) {
+			size += Tny_varintSize(next->size) + next->size;
+		} else if (next->type == TNY_CHAR) {
+			size++;
+		} else if (next->type == TNY_INT32) {
+			size += Tny_varintSize(TNY_ZIGZAG32(next->value.num));
+		} else if (next->type == TNY_INT64) {
+			size += Tny_varintSize(TNY_ZIGZAG64(next->value.num));
+		} else if (next->type == TNY_DOUBLE) {
+			size += sizeof(double);
+		} else if (Tny_packedWidth(next->type) > 0) {
+			size += Tny_varintSize(next->size) + next->size * Tny_packedWidth(next->type);
+		}
+	}
+
+	return size;
+}
+
+static size_t Tny_varintSize(uint64_t value)
+{
+	size_t size = 1;
+
+	while (value >= 0x80) {
+		value >>= 7;
+		size++;
+	}
+
+	return size;
+}
+
+static size_t Tny_writeVarint(char *data, uint64_t value)
+{
+	size_t size = 0;
+
+	while (value >= 0x80) {
+		data[size++] = (char)(value | 0x80);
+		value >>= 7;
+	}
+	data[size++] = (char)value;
+
+	return size;
+}
+
+static int Tny_readVarint(const char *data, size_t length, size_t *pos, uint64_t *value)
+{
+	const unsigned char *bytes = (const unsigned char*)data + *pos;
+	uint64_t result = 0;
+	size_t i = 0;
+
+	/* Most lengths and numbers fit into a single byte. */
+	if (*pos < length && bytes[0] < 0x80) {
+		*value = bytes[0];
+		(*pos)++;
+		return 1;
+	}
+
+	for (i = 0; i < 10 && *pos + i < length; i++) {
+		result |= (uint64_t)(bytes[i] & 0x7F) << (7 * i);
+		if (bytes[i] < 0x80) {
+			*value = result;
+			*pos += i + 1;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int Tny_readLength(const char *data, size_t length, size_t *pos, int compact, uint32_t *value)
+{
+	uint64_t result = 0;
+
+	if (compact) {
+		if (!Tny_readVarint(data, length, pos, &result) || result > UINT32_MAX) {
+			return 0;
+		}
+		*value = (uint32_t)result;
+	} else {
+		if (*pos + sizeof(uint32_t) > length) {
+			return 0;
+		}
+		Tny_swapBytes32(value, data + *pos);
+		*pos += sizeof(uint32_t);
+	}
+
+	return 1;
+}
+
+static size_t TnyLz_sequence(unsigned char *out, size_t op, const unsigned char *literals, size_t count, size_t offset, size_t match)
+{
+	size_t token = op++;
+	size_t rest = 0;
+
+	out[token] = (count >= 15 ? 15 : count) << 4;
+	if (count >= 15) {
+		for (rest = count - 15; rest >= 255; rest -= 255) {
+			out[op++] = 255;
+		}
+		out[op++] = rest;
+	}
+	memcpy(out + op, literals, count);
+	op += count;
+
+	if (match > 0) {
+		out[op++] = offset & 0xFF;
+		out[op++] = offset >> 8;
+		match -= TNY_LZ_MINMATCH;
+		out[token] |= match >= 15 ? 15 : match;
+		if (match >= 15) {
+			for (rest = match - 15; rest >= 255; rest -= 255) {
+				out[op++] = 255;
+			}
+			out[op++] = rest;
+		}
+	}
+
+	return op;
+}
+
+static size_t TnyLz_compress(const char *src, size_t size, char *dest, size_t capacity)
+{
+	const unsigned char *in = (const unsigned char*)src;
+	unsigned char *out = (unsigned char*)dest;
+	uint32_t table[1 << TNY_LZ_HASHBITS];
+	uint32_t sequence = 0;
+	uint32_t hash = 0;
+	size_t ip = 0;
+	size_t anchor = 0;
+	size_t op = 0;
+	size_t ref = 0;
+	size_t match = 0;
+
+	/* Matches end 5 bytes before the input does, the last sequence only has literals. */
+	memset(table, 0, sizeof(table));
+	while (ip + 12 < size) {
+		memcpy(&sequence, in + ip, sizeof(uint32_t));
+		hash = (sequence * 2654435761u) >> (32 - TNY_LZ_HASHBITS);
+		ref = table[hash];
+		table[hash] = ip;
+		if (ref >= ip || ip - ref > 0xFFFF || memcmp(in + ref, in + ip, TNY_LZ_MINMATCH) != 0) {
+			ip++;
+			continue;
+		}
+
+		for (match = TNY_LZ_MINMATCH; ip + match + 5 < size && in[ref + match] == in[ip + match]; match++);
+		if (op + (ip - anchor) + (ip - anchor) / 255 + match / 255 + 8 > capacity) {
+			return 0;
+		}
+		op = TnyLz_sequence(out, op, in + anchor, ip - anchor, ip - ref, match);
+		ip += match;
+		anchor = ip;
+	}
+
+	if (op + (size - anchor) + (size - anchor) / 255 + 2 > capacity) {
+		return 0;
+	}
+
+	return TnyLz_sequence(out, op, in + anchor, size - anchor, 0, 0);
+}
+
+static int TnyLz_decompress(const char *src, size_t size, char *dest, size_t capacity)
+{
+	const unsigned char *in = (const unsigned char*)src;
+	unsigned char *out = (unsigned char*)dest;
+	size_t ip = 0;
+	size_t op = 0;
+	size_t count = 0;
+	size_t offset = 0;
+	size_t from = 0;
+	size_t step = 0;
+	unsigned char token = 0;
+	unsigned char byte = 0;
+
+	while (ip < size) {
+		token = in[ip++];
+		count = token >> 4;
+		if (count == 15) {
+			do {
+				if (ip >= size) {
+					return 0;
+				}
+				byte = in[ip++];
+				count += byte;
+			} while (byte == 255);
+		}
+		if (count > size - ip || count > capacity - op) {
+			return 0;
+		}
+		/* Without a destination the block is only checked. */
+		if (out != NULL) {
+			memcpy(out + op, in + ip, count);
+		}
+		ip += count;
+		op += count;
+
+		/* The last sequence has no match. */
+		if (ip == size) {
+			break;
+		}
+
+		if (ip + 2 > size) {
+			return 0;
+		}
+		offset = in[ip] | (in[ip + 1] << 8);
+		ip += 2;
+		count = token & 0x0F;
+		if (count == 15) {
+			do {
+				if (ip >= size) {
+					return 0;
+				}
+				byte = in[ip++];
+				count += byte;
+			} while (byte == 255);
+		}
+		count += TNY_LZ_MINMATCH;
+		if (offset == 0 || offset > op || count > capacity - op) {
+			return 0;
+		}
+		if (out == NULL) {
+			op += count;
+			continue;
+		}
+		/* Overlapping matches repeat the last offset bytes, the copied pattern doubles with every step. */
+		for (from = op - offset; count > 0; count -= step) {
+			step = op - from < count ? op - from : count;
+			memcpy(out + op, out + from, step);
+			op += step;
+		}
+	}
+
+	return op == capacity;
+}
+
+static size_t Tny_dumpBin(const Tny *tny, char *data, size_t typePos, size_t pos, int compact)
+{
+	size_t lengthPos = 0;
+	size_t blockPos = 0;
+	size_t block = 0;
+	uint32_t size = 0;
+
+	/* The compressed block is written behind room for both lengths and moved in front if they are shorter. */
+	if (compact) {
+		pos += Tny_writeVarint(data + pos, tny->size);
+		blockPos = pos + Tny_varintSize(UINT32_MAX);
+	} else {
+		Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&tny->size);
+		pos += sizeof(uint32_t);
+		blockPos = pos + sizeof(uint32_t);
+	}
+	lengthPos = pos;
+
+	block = TnyLz_compress(tny->value.ptr, tny->size, data + blockPos, tny->size - 1);
+	if (block == 0) {
+		/* Incompressible values are stored as they are. */
+		memcpy(data + lengthPos, tny->value.ptr, tny->size);
+		return lengthPos + tny->size;
+	}
+
+	data[typePos] |= TNY_FORMAT_COMPRESSED;
+	if (compact) {
+		pos += Tny_writeVarint(data + pos, block);
+		memmove(data + pos, data + blockPos, block);
+	} else {
+		size = block;
+		Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&size);
+		pos += sizeof(uint32_t);
+	}
+
+	return pos + block;
+}
+
+size_t _Tny_dumps(const Tny *tny, char *data, size_t pos, TnyDumpState *state)
+{
+	const Tny *next = NULL;
+	size_t start = pos;
+	size_t indexAt = 0;
+	size_t base = 0;
+	int indexed = state != NULL && (state->flags & TNY_DUMP_INDEX);
+	int compact = state != NULL && (state->flags & TNY_DUMP_COMPACT);
+	int cache = state != NULL && (state->flags & TNY_DUMP_CACHE);
+
+	if (cache && tny->cache != NULL && tny->cache->flags == (state->flags & TNY_DUMP_COMPACT)) {
+		/* Nothing changed since the last dump. */
+		memcpy(data + pos, tny->cache->data, tny->cache->size);
+		return pos + tny->cache->size;
+	}
+
+	if (indexed) {
+		base = state->used;
+	}
+
+	for (next = tny; next != NULL; next = next->next) {
+		if (next->type != TNY_ARRAY && next->type != TNY_DICT) {
+			pos = Tny_dumpElement(next, data, pos, start, state);
+			if (pos == 0) {
+				break;
+			}
+			continue;
+		}
+
+		/* Add the data type and the number of elements if this is the root element. */
+		data[pos++] = next->type;
+		if (compact) {
+			data[pos - 1] |= TNY_FORMAT_COMPACT;
+			pos += Tny_writeVarint(data + pos, next->size);
+		} else {
+			Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&next->size);
+			pos += sizeof(uint32_t);
+		}
+		if (indexed) {
+			/* The position of the index is filled in behind the last element. */
+			data[start] |= TNY_FORMAT_INDEXED;
+			indexAt = pos;
+			pos += sizeof(uint64_t);
+		}
+	}
+
+	if (indexed && pos != 0) {
+		pos = Tny_dumpIndex(tny, data, start, indexAt, pos, state, base);
+	}
+	if (cache && pos != 0) {
+		Tny_keepCache((Tny*)tny, data + start, pos - start, state->flags & TNY_DUMP_COMPACT);
+	}
+
+	return pos;
+}
+
+static size_t Tny_dumpElement(const Tny *tny, char *data, size_t pos, size_t start, TnyDumpState *state)
+{
+	uint32_t size = 0;
+	size_t typePos = pos;
+	int compact = state != NULL && (state->flags & TNY_DUMP_COMPACT);
+
+	/* Add the data type */
+	data[pos++] = tny->type;
+
+	if (state != NULL && (state->flags & TNY_DUMP_INDEX) && !Tny_pushOffset(state, typePos - start)) {
+		return 0;
+	}
+
+	/* Add the key if this is a dictionary, or its number if the keys are written into a table */
+	if (tny->root->type == TNY_DICT && state != NULL && state->keys != NULL) {
+		size = *TnyKeyTable_find(state->keys, tny) - 1;
+		if (compact) {
+			pos += Tny_writeVarint(data + pos, size);
+		} else {
+			Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&size);
+			pos += sizeof(uint32_t);
+		}
+	} else if (tny->root->type == TNY_DICT) {
+		size = tny->keyLength + 1;
+		if (compact) {
+			pos += Tny_writeVarint(data + pos, size);
+		} else {
+			Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&size);
+			pos += sizeof(uint32_t);
+		}
+		memcpy((data + pos), tny->key, size);
+		pos += size;
+	}
+
+	/* Add the value */
+	if (tny->type == TNY_OBJ) {
+		pos = tny->value.tny != NULL ? _Tny_dumps(tny->value.tny, data, pos, state) : 0;
+	} else if (tny->type == TNY_BIN) {
+		if (state != NULL && (state->flags & TNY_DUMP_COMPRESS_BIN) && tny->size >= TNY_COMPRESS_THRESHOLD) {
+			return Tny_dumpBin(tny, data, typePos, pos, compact);
+		}
+		if (compact) {
+			pos += Tny_writeVarint(data + pos, tny->size);
+		} else {
+			Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&tny->size);
+			pos += sizeof(uint32_t);
+		}
+		if (state != NULL && state->iov != NULL && tny->size >= state->threshold) {
+			/* Close the current piece and reference the value instead of copying it. */
+			state->iov[state->count].iov_base = data + state->start;
+			state->iov[state->count++].iov_len = pos - state->start;
+			state->iov[state->count].iov_base = tny->value.ptr;
+			state->iov[state->count++].iov_len = tny->size;
+			state->start = pos;
+		} else {
+			memcpy((data + pos), tny->value.ptr, tny->size);
+			pos += tny->size;
+		}
+	} else if (tny->type == TNY_CHAR) {
+		data[pos++] = tny->value.chr;
+	} else if (tny->type == TNY_INT32 && compact) {
+		pos += Tny_writeVarint(data + pos, TNY_ZIGZAG32(tny->value.num));
+	} else if (tny->type == TNY_INT32) {
+		Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&tny->value.num);
+		pos += sizeof(uint32_t);
+	} else if (tny->type == TNY_INT64 && compact) {
+		pos += Tny_writeVarint(data + pos, TNY_ZIGZAG64(tny->value.num));
+	} else if (tny->type == TNY_INT64) {
+		Tny_swapBytes64((uint64_t*)(data + pos), (const char*)&tny->value.num);
+		pos += sizeof(uint64_t);
+	} else if (tny->type == TNY_DOUBLE) {
+		Tny_swapBytes64((uint64_t*)(data + pos), (const char*)&tny->value.num);
+		pos += sizeof(double);
+	} else if (Tny_packedWidth(tny->type) > 0) {
+		if (compact) {
+			pos += Tny_writeVarint(data + pos, tny->size);
+		} else {
+			Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&tny->size);
+			pos += sizeof(uint32_t);
+		}
+		Tny_swapBulk(data + pos, tny->value.ptr, tny->size, Tny_packedWidth(tny->type));
+		pos += tny->size * Tny_packedWidth(tny->type);
+	}
+
+	return pos;
+}
+
+size_t Tny_dumps(const Tny *tny, void **data)
+{
+	return Tny_dumpsEx(tny, data, TNY_DUMP_DEFAULT);
+}
+
+size_t Tny_dumpsEx(const Tny *tny, void **data, int flags)
+{
+	TnyDumpState state;
+	TnyKeyTable keys;
+	size_t size = 0;
+	size_t large = 0;
+	size_t largeSize = 0;
+	size_t pos = 0;
+
+	memset(&state, 0, sizeof(TnyDumpState));
+	memset(&keys, 0, sizeof(TnyKeyTable));
+	if (flags & (TNY_DUMP_INDEX | TNY_DUMP_COMPRESS_BIN | TNY_DUMP_KEYS)) {
+		/* These forms depend on more than the document itself. */
+		flags &= ~TNY_DUMP_CACHE;
+	}
+	state.flags = flags;
+	*data = NULL;
+	tny = tny->root;
+	size = (flags & TNY_DUMP_COMPACT) ? Tny_compactSize(tny) : tny->docSize;
+	if (flags & TNY_DUMP_INDEX) {
+		size += Tny_indexSize(tny);
+	}
+	if (flags & TNY_DUMP_COMPRESS_BIN) {
+		/* A compressed value needs room for its second length. */
+		Tny_countLargeValues(tny, TNY_COMPRESS_THRESHOLD, &large, &largeSize);
+		size += large * sizeof(uint64_t);
+	}
+	if (flags & TNY_DUMP_KEYS) {
+		/* Every key is replaced by a reference, the distinct keys are written once in front. */
+		keys.size = sizeof(uint32_t);
+		if (!TnyKeyTable_collect(&keys, tny, flags & TNY_DUMP_COMPACT) || keys.size > UINT32_MAX) {
+			TnyKeyTable_free(&keys);
+			return 0;
+		}
+		size = size - keys.keyBytes + keys.refBytes + 1 + sizeof(uint32_t) + keys.size;
+		state.keys = &keys;
+	}
+	*data = Tny_malloc(NULL, size);
+	if (*data != NULL) {
+		if (flags & TNY_DUMP_KEYS) {
+			pos = Tny_dumpKeys(&keys, *data);
+		}
+		size = _Tny_dumps(tny, *data, pos, &state);
+		Tny_release(NULL, state.offsets);
+		if (size == 0) {
+			Tny_release(NULL, *data);
+			*data = NULL;
+		}
+	} else {
+		size = 0;
+	}
+	TnyKeyTable_free(&keys);
+
+	if (flags & TNY_DUMP_COMPRESS) {
+		size = Tny_compressDump(data, size);
+	}
+	TNY_COUNT(dumps, size > 0);
+	TNY_COUNT(emittedBytes, size);
+
+	return size;
+}
+
+static size_t Tny_compressDump(void **data, size_t size)
+{
+	uint64_t original = size;
+	uint64_t block = 0;
+	char *compressed = NULL;
+
+	if (size > TNY_COMPRESSED_HEADER) {
+		compressed = Tny_malloc(NULL, size);
+		if (compressed != NULL) {
+			block = TnyLz_compress(*data, size, compressed + TNY_COMPRESSED_HEADER, size - TNY_COMPRESSED_HEADER - 1);
+		}
+		if (block > 0) {
+			compressed[0] = TNY_FORMAT_COMPRESSED;
+			Tny_swapBytes64((uint64_t*)(compressed + 1), (const char*)&original);
+			Tny_swapBytes64((uint64_t*)(compressed + 1 + sizeof(uint64_t)), (const char*)&block);
+			Tny_release(NULL, *data);
+			*data = compressed;
+			size = TNY_COMPRESSED_HEADER + block;
+		} else {
+			/* Documents which do not get smaller are stored as they are. */
+			Tny_release(NULL, compressed);
+		}
+	}
+
+	return size;
+}
+
+static int TnyKeyTable_collect(TnyKeyTable *table, const Tny *tny, int compact)
+{
+	const Tny *next = NULL;
+	uint32_t *slot = NULL;
+	size_t size = 0;
+
+	for (next = tny; next != NULL; next = next->next) {
+		if (next != next->root && next->root->type == TNY_DICT) {
+			if (((size_t)table->count + 1) * 2 > table->capacity && !TnyKeyTable_grow(table)) {
+				return 0;
+			}
+			slot = TnyKeyTable_find(table, next);
+			if (*slot == 0) {
+				table->keys[table->count++] = next;
+				*slot = table->count;
+				table->size += 2 * sizeof(uint32_t) + next->keyLength + 1;
+			}
+			size = next->keyLength + 1;
+			table->keyBytes += (compact ? Tny_varintSize(size) : sizeof(uint32_t)) + size;
+			table->refBytes += compact ? Tny_varintSize(*slot - 1) : sizeof(uint32_t);
+		}
+		if (next->type == TNY_OBJ && next->value.tny != NULL && !TnyKeyTable_collect(table, next->value.tny, compact)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int TnyKeyTable_grow(TnyKeyTable *table)
+{
+	size_t capacity = table->capacity > 0 ? table->capacity * 2 : 64;
+	uint32_t *slots = NULL;
+	const Tny **keys = NULL;
+	uint32_t i = 0;
+
+	if (capacity / 2 > UINT32_MAX) {
+		return 0;
+	}
+	keys = Tny_reallocate(table->keys, capacity / 2 * sizeof(Tny*));
+	if (keys == NULL) {
+		return 0;
+	}
+	table->keys = keys;
+	slots = Tny_malloc(NULL, capacity * sizeof(uint32_t));
+	if (slots == NULL) {
+		return 0;
+	}
+	memset(slots, 0, capacity * sizeof(uint32_t));
+
+	Tny_release(NULL, table->slots);
+	table->slots = slots;
+	table->capacity = capacity;
+	for (i = 0; i < table->count; i++) {
+		*TnyKeyTable_find(table, table->keys[i]) = i + 1;
+	}
+
+	return 1;
+}
+
+static uint32_t* TnyKeyTable_find(const TnyKeyTable *table, const Tny *tny)
+{
+	const Tny *key = NULL;
+	size_t mask = table->capacity - 1;
+	size_t i = tny->keyHash & mask;
+
+	/* Linear probing, the table is never more than half full. */
+	while (table->slots[i] != 0) {
+		key = table->keys[table->slots[i] - 1];
+		if (key->keyHash == tny->keyHash && key->keyLength == tny->keyLength
+				&& memcmp(key->key, tny->key, tny->keyLength) == 0) {
+			break;
+		}
+		i = (i + 1) & mask;
+	}
+
+	return &table->slots[i];
+}
+
+static void TnyKeyTable_free(TnyKeyTable *table)
+{
+	Tny_release(NULL, table->keys);
+	Tny_release(NULL, table->slots);
+	memset(table, 0, sizeof(TnyKeyTable));
+}
+
+static size_t Tny_dumpKeys(const TnyKeyTable *table, char *data)
+{
+	uint32_t value = table->size;
+	uint32_t offset = (table->count + 1) * sizeof(uint32_t);
+	char *start = data + 1 + sizeof(uint32_t);
+	uint32_t i = 0;
+
+	data[0] = (char)TNY_FORMAT_KEYED;
+	Tny_swapBytes32((uint32_t*)(data + 1), (const char*)&value);
+	Tny_swapBytes32((uint32_t*)start, (const char*)&table->count);
+	for (i = 0; i < table->count; i++) {
+		Tny_swapBytes32((uint32_t*)(start + (i + 1) * sizeof(uint32_t)), (const char*)&offset);
+		value = table->keys[i]->keyLength + 1;
+		Tny_swapBytes32((uint32_t*)(start + offset), (const char*)&value);
+		memcpy(start + offset + sizeof(uint32_t), table->keys[i]->key, value);
+		offset += sizeof(uint32_t) + value;
+	}
+
+	return 1 + sizeof(uint32_t) + table->size;
+}
+
+#ifdef TNY_THREADS
+static void* Tny_dumpSlice(void *arg)
+{
+	TnyDumpSlice *slice = arg;
+	const Tny *next = NULL;
+	size_t pos = slice->start;
+
+	for (next = slice->first; next != slice->last && pos != 0; next = next->next) {
+		pos = Tny_dumpElement(next, slice->data, pos, 0, NULL);
+	}
+	slice->done = pos == slice->end;
+
+	return NULL;
+}
+
+static int Tny_dumpsSliced(const Tny *tny, char *data, size_t size, int threads)
+{
+	TnyDumpSlice slices[TNY_DUMP_MAXTHREADS];
+	const Tny *next = NULL;
+	size_t count = threads < TNY_DUMP_MAXTHREADS ? threads : TNY_DUMP_MAXTHREADS;
+	size_t used = 0;
+	size_t pos = 0;
+	size_t i = 0;
+	int done = 1;
+
+	if (size / TNY_DUMP_SLICESIZE < count) {
+		count = size / TNY_DUMP_SLICESIZE;
+	}
+	if (count < 2) {
+		return 0;
+	}
+
+	data[pos++] = tny->type;
+	Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&tny->size);
+	pos += sizeof(uint32_t);
+
+	/* The sizes of the elements are known, so the position of every element is their running sum. */
+	memset(slices, 0, sizeof(slices));
+	for (next = tny->next; next != NULL; next = next->next) {
+		if (used < count && pos >= size / count * used) {
+			if (used > 0) {
+				slices[used - 1].last = next;
+				slices[used - 1].end = pos;
+			}
+			slices[used].first = next;
+			slices[used].start = pos;
+			slices[used].data = data;
+			used++;
+		}
+		pos += Tny_valueSize(next->type, next->size);
+		if (next->type == TNY_OBJ && next->value.tny != NULL) {
+			pos += next->value.tny->docSize;
+		}
+		if (tny->type == TNY_DICT) {
+			pos += sizeof(uint32_t) + next->keyLength + 1;
+		}
+	}
+	if (used < 2 || pos != size) {
+		return 0;
+	}
+	slices[used - 1].end = pos;
+
+	/* The calling thread writes the first range itself, and every range a thread could not be started for. */
+	for (i = 1; i < used; i++) {
+		slices[i].started = pthread_create(&slices[i].thread, NULL, Tny_dumpSlice, &slices[i]) == 0;
+	}
+	Tny_dumpSlice(&slices[0]);
+	for (i = 1; i < used; i++) {
+		if (slices[i].started) {
+			pthread_join(slices[i].thread, NULL);
+		} else {
+			Tny_dumpSlice(&slices[i]);
+		}
+		done = done && slices[i].done;
+	}
+
+	return done && slices[0].done;
+}
+#endif
+
+size_t Tny_dumpsParallel(const Tny *tny, void **data, int flags, int threads)
+{
+	size_t size = 0;
+	int done = 0;
+
+	if ((flags & ~TNY_DUMP_COMPRESS) != 0 || threads < 2) {
+		return Tny_dumpsEx(tny, data, flags);
+	}
+
+	tny = tny->root;
+	size = tny->docSize;
+	*data = Tny_malloc(NULL, size);
+	if (*data == NULL) {
+		return 0;
+	}
+
+#ifdef TNY_THREADS
+	done = Tny_dumpsSliced(tny, *data, size, threads);
+#endif
+	if (!done) {
+		size = _Tny_dumps(tny, *data, 0, NULL);
+	}
+	if (size == 0) {
+		Tny_release(NULL, *data);
+		*data = NULL;
+	} else if (flags & TNY_DUMP_COMPRESS) {
+		size = Tny_compressDump(data, size);
+	}
+	TNY_COUNT(dumps, size > 0);
+	TNY_COUNT(emittedBytes, size);
+
+	return size;
+}
+
+size_t Tny_dumpsInto(const Tny *tny, void *data, size_t capacity)
+{
+	size_t size = 0;
+
+	tny = tny->root;
+	size = tny->docSize;
+	if (size <= capacity) {
+		size = _Tny_dumps(tny, data, 0, NULL);
+		TNY_COUNT(dumps, size > 0);
+		TNY_COUNT(emittedBytes, size);
+	}
+
+	return size;
+}
+
+static void Tny_countLargeValues(const Tny *tny, size_t threshold, size_t *count, size_t *size)
+{
+	const Tny *next = NULL;
+
+	for (next = tny; next != NULL; next = next->next) {
+		if (next->type == TNY_BIN && next->size >= threshold) {
+			(*count)++;
+			*size += next->size;
+		} else if (next->type == TNY_OBJ && next->value.tny != NULL) {
+			Tny_countLargeValues(next->value.tny, threshold, count, size);
+		}
+	}
+}
+
+size_t Tny_dumpsIov(const Tny *tny, size_t threshold, TnyIovec **iov, size_t *count)
+{
+	TnyDumpState state;
+	size_t large = 0;
+	size_t largeSize = 0;
+	size_t pieces = 0;
+	size_t size = 0;
+	char *data = NULL;
+
+	*iov = NULL;
+	*count = 0;
+	tny = tny->root;
+	if (threshold == 0) {
+		threshold = 1;
+	}
+
+	memset(&state, 0, sizeof(TnyDumpState));
+	Tny_countLargeValues(tny, threshold, &large, &largeSize);
+	pieces = 2 * large + 1;
+	state.iov = Tny_malloc(NULL, pieces * sizeof(TnyIovec) + tny->docSize - largeSize);
+	if (state.iov == NULL) {
+		return 0;
+	}
+	state.threshold = threshold;
+	data = (char*)(state.iov + pieces);
+
+	size = _Tny_dumps(tny, data, 0, &state);
+	if (size == 0) {
+		Tny_release(NULL, state.iov);
+		return 0;
+	}
+	if (size > state.start) {
+		state.iov[state.count].iov_base = data + state.start;
+		state.iov[state.count++].iov_len = size - state.start;
+	}
+
+	*iov = state.iov;
+	*count = state.count;
+	TNY_COUNT(dumps, 1);
+	TNY_COUNT(emittedBytes, size + largeSize);
+
+	return size + largeSize;
+}
+
+static int Tny_checkKeyTable(const char *table, size_t size, uint32_t *count)
+{
+	uint32_t offset = 0;
+	uint32_t length = 0;
+	uint32_t i = 0;
+
+	if (size < sizeof(uint32_t)) {
+		return 0;
+	}
+	Tny_swapBytes32(count, table);
+	if (*count > size / sizeof(uint32_t) - 1) {
+		return 0;
+	}
+
+	/* Every key has to lie inside the table behind the offsets and has to be NUL terminated. */
+	for (i = 0; i < *count; i++) {
+		Tny_swapBytes32(&offset, table + (i + 1) * sizeof(uint32_t));
+		if (offset < (*count + 1) * sizeof(uint32_t) || offset > size - sizeof(uint32_t)) {
+			return 0;
+		}
+		Tny_swapBytes32(&length, table + offset);
+		if (length == 0 || length > size - offset - sizeof(uint32_t)
+				|| table[offset + sizeof(uint32_t) + length - 1] != '\0') {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static const char* Tny_readKeyTable(const char *data, size_t length, size_t *pos, uint32_t *size, uint32_t *count)
+{
+	const char *table = NULL;
+
+	if (*pos + 1 + sizeof(uint32_t) > length || (unsigned char)data[*pos] != TNY_FORMAT_KEYED) {
+		return NULL;
+	}
+	Tny_swapBytes32(size, data + *pos + 1);
+	table = data + *pos + 1 + sizeof(uint32_t);
+	if (*size > length - *pos - 1 - sizeof(uint32_t) || !Tny_checkKeyTable(table, *size, count)) {
+		return NULL;
+	}
+	*pos += 1 + sizeof(uint32_t) + *size;
+
+	return table;
+}
+
+static const char* Tny_tableKey(const char *table, uint32_t number, uint32_t *length)
+{
+	uint32_t offset = 0;
+
+	Tny_swapBytes32(&offset, table + (number + 1) * sizeof(uint32_t));
+	Tny_swapBytes32(length, table + offset);
+	(*length)--;
+
+	return table + offset + sizeof(uint32_t);
+}
+
+static struct _TnyKeys* Tny_internKeys(const char *table, uint32_t size, uint32_t count, TnyArena *arena, int borrow)
+{
+	struct _TnyKeys *keys = NULL;
+	const char *base = table;
+	uint32_t length = 0;
+	uint32_t i = 0;
+
+	/* The whole table is copied in one piece behind the pointers, unless the keys are borrowed. */
+	keys = Tny_malloc(arena, sizeof(struct _TnyKeys) + count * sizeof(char*) + (borrow ? 0 : size));
+	if (keys == NULL) {
+		return NULL;
+	}
+	if (!borrow) {
+		base = memcpy(keys->keys + count, table, size);
+	}
+	keys->count = count;
+	keys->size = borrow ? 0 : size;
+	for (i = 0; i < count; i++) {
+		keys->keys[i] = (char*)Tny_tableKey(base, i, &length);
+	}
+
+	return keys;
+}
+
+Tny* _Tny_loads(char *data, size_t length, size_t *pos, size_t *docSizePtr, TnyArena *arena, int flags, const struct _TnyKeys *keys)
+{
+	Tny *tny = NULL;
+	TnyType type = TNY_NULL;
+	uint32_t size = 0;
+	uint64_t indexPos = 0;
+	size_t start = *pos;
+	int compact = 0;
+
+	if ((*pos) >= length) {
+		return NULL;
+	}
+
+	type = data[(*pos)++];
+	compact = (type & TNY_FORMAT_COMPACT) != 0;
+	if ((type & ~(TNY_FORMAT_INDEXED | TNY_FORMAT_COMPACT)) != TNY_ARRAY
+			&& (type & ~(TNY_FORMAT_INDEXED | TNY_FORMAT_COMPACT)) != TNY_DICT) {
+		return NULL;
+	}
+	if (!Tny_readLength(data, length, pos, compact, &size)) {
+		return NULL;
+	}
+	if (type & TNY_FORMAT_INDEXED) {
+		/* The index is only needed for random access, it gets skipped behind the last element. */
+		if ((*pos) + sizeof(uint64_t) > length) {
+			return NULL;
+		}
+		Tny_swapBytes64(&indexPos, (const char*)(data + (*pos)));
+		*pos += sizeof(uint64_t);
+	}
+	type &= ~(TNY_FORMAT_INDEXED | TNY_FORMAT_COMPACT);
+	tny = _Tny_add(NULL, type, NULL, NULL, size, arena, 0);
+	if (tny == NULL) {
+		return NULL;
+	}
+	if (docSizePtr != NULL) {
+		Tny_attach(tny, docSizePtr);
+	}
+
+	tny = Tny_loadElements(tny, data, length, pos, size, compact, arena, flags, keys)->root;
+	if (indexPos > 0) {
+		indexPos += start + (uint64_t)size * sizeof(uint64_t) * (tny->type == TNY_DICT ? 2 : 1);
+		*pos = indexPos <= length ? indexPos : length;
+	}
+
+	return tny;
+}
+
+static Tny* Tny_loadElements(Tny *tny, char *data, size_t length, size_t *pos, uint64_t elements, int compact, TnyArena *arena, int flags, const struct _TnyKeys *keys)
+{
+	Tny *newObj = NULL;
+	Tny *sub = NULL;
+	TnyType type = TNY_NULL;
+	uint32_t size = 0;
+	uint32_t i32 = 0;
+	uint64_t i64 = 0;
+	double flt = 0.0f;
+	char *key = NULL;
+	uint64_t counter = 0;
+	char *value = NULL;
+	size_t width = 0;
+	int addFlags = 0;
+
+	if (flags & TNY_LOAD_TRUSTED) {
+		addFlags |= TNY_ADD_UNIQUE;
+	}
+	if (flags & TNY_LOAD_VIEW) {
+		addFlags |= TNY_ADD_BORROW;
+	}
+	if (keys != NULL) {
+		addFlags |= TNY_ADD_SHARED;
+	}
+
+	while ((*pos) < length && counter < elements) {
+		type = data[(*pos)++];
+		if (tny->root->type == TNY_DICT) {
+			if (!Tny_readLength(data, length, pos, compact, &size)) {
+				break;
+			}
+			if (keys != NULL) {
+				/* The key is a reference into the key table. */
+				if (size >= keys->count) {
+					break;
+				}
+				key = keys->keys[size];
+			} else if (size > 0 && (*pos) + size <= length && data[(*pos) + size - 1] == '\0') {
+				key = data + (*pos);
+				*pos += size;
+			} else {
+				break;
+			}
+		} else {
+			key = NULL;
+		}
+
+		newObj = tny;
+		if (type == TNY_NULL) {
+			newObj = _Tny_add(tny, type, key, NULL, 0, arena, addFlags);
+		} else if (type == TNY_OBJ) {
+			sub = _Tny_loads(data, length, pos, &tny->root->docSize, arena, flags, keys);
+			if (sub == NULL) {
+				break;
+			}
+			newObj = _Tny_add(tny, type, key, NULL, 0, arena, addFlags);
+			if (newObj == NULL) {
+				Tny_free(sub);
+				break;
+			}
+			/* A duplicate key is overwritten in place, _Tny_add then returns its predecessor. */
+			if (newObj->type != TNY_OBJ || newObj->value.tny != NULL) {
+				Tny_get(newObj, key)->value.tny = sub;
+			} else {
+				newObj->value.tny = sub;
+			}
+		} else if (type == (TNY_BIN | TNY_FORMAT_COMPRESSED)) {
+			if (!Tny_readLength(data, length, pos, compact, &size) || !Tny_readLength(data, length, pos, compact, &i32)) {
+				break;
+			}
+			HASNEXTDATA(i32);
+			if (size / TNY_LZ_MAXRATIO > i32) {
+				break;
+			}
+			value = Tny_malloc(arena, size);
+			if (value == NULL || !TnyLz_decompress(data + *pos, i32, value, size)) {
+				Tny_release(arena, value);
+				break;
+			}
+			*pos += i32;
+			newObj = _Tny_add(tny, TNY_BIN, key, value, size, arena, (addFlags & ~TNY_ADD_BORROW) | TNY_ADD_TAKE);
+			if (newObj == NULL) {
+				Tny_release(arena, value);
+			}
+		} else if (type == TNY_BIN) {
+			if (!Tny_readLength(data, length, pos, compact, &size)) {
+				break;
+			}
+			HASNEXTDATA(size);
+			newObj = _Tny_add(tny, type, key, (data + *pos), size, arena, addFlags);
+			*pos += size;
+		} else if (type == TNY_CHAR) {
+			HASNEXTDATA(1);
+			newObj = _Tny_add(tny, type, key, (data + *pos), 0, arena, addFlags);
+			(*pos)++;
+		} else if (type == TNY_INT32 && compact) {
+			if (!Tny_readVarint(data, length, pos, &i64)) {
+				break;
+			}
+			i32 = (uint32_t)TNY_UNZIGZAG(i64);
+			newObj = _Tny_add(tny, type, key, &i32, 0, arena, addFlags);
+		} else if (type == TNY_INT32) {
+			HASNEXTDATA(sizeof(uint32_t));
+			Tny_swapBytes32(&i32, (const char*)(data + (*pos)));
+			*pos += sizeof(uint32_t);
+			newObj = _Tny_add(tny, type, key, &i32, 0, arena, addFlags);
+		} else if (type == TNY_INT64 && compact) {
+			if (!Tny_readVarint(data, length, pos, &i64)) {
+				break;
+			}
+			i64 = TNY_UNZIGZAG(i64);
+			newObj = _Tny_add(tny, type, key, &i64, 0, arena, addFlags);
+		} else if (type == TNY_INT64) {
+			HASNEXTDATA(sizeof(uint64_t));
+			Tny_swapBytes64(&i64, (data + (*pos)));
+			*pos += sizeof(uint64_t);
+			newObj = _Tny_add(tny, type, key, &i64, 0, arena, addFlags);
+		} else if (type == TNY_DOUBLE) {
+			HASNEXTDATA(sizeof(double));
+			Tny_swapBytes64((uint64_t*)&flt, (data + (*pos)));
+			*pos += sizeof(double);
+			newObj = _Tny_add(tny, type, key, &flt, 0, arena, addFlags);
+		} else if ((width = Tny_packedWidth(type)) > 0) {
+			/* The values are converted in one go, they can not be borrowed because of their alignment. */
+			if (!Tny_readLength(data, length, pos, compact, &size) || size > (length - *pos) / width) {
+				break;
+			}
+			value = Tny_malloc(arena, size > 0 ? size * width : 1);
+			if (value == NULL) {
+				break;
+			}
+			Tny_swapBulk(value, data + *pos, size, width);
+			*pos += size * width;
+			newObj = _Tny_add(tny, type, key, value, size, arena, (addFlags & ~TNY_ADD_BORROW) | TNY_ADD_TAKE);
+			if (newObj == NULL) {
+				Tny_release(arena, value);
+			}
+		}
+		if (newObj == NULL) {
+			break;
+		}
+		tny = newObj;
+		counter++;
+	}
+
+	return tny;
+}
+
+Tny* Tny_loads(void *data, size_t length)
+{
+	return Tny_loadsEx(data, length, TNY_LOAD_DEFAULT);
+}
+
+Tny* Tny_loadsView(void *data, size_t length)
+{
+	return Tny_loadsEx(data, length, TNY_LOAD_VIEW);
+}
+
+Tny* Tny_loadsEx(void *data, size_t length, int flags)
+{
+	return Tny_loadsChecked(data, length, flags, 1, NULL);
+}
+
+Tny* Tny_loadsLimited(void *data, size_t length, int flags, const TnyLimits *limits)
+{
+	return Tny_loadsChecked(data, length, flags | TNY_LOAD_VALIDATE, 1, limits);
+}
+
+#ifdef TNY_THREADS
+static size_t Tny_splitArray(const char *data, size_t length, TnySlice *slices, size_t count)
+{
+	TnyReader reader;
+	uint64_t offset = 0;
+	size_t first = 0;
+	size_t end = 0;
+	size_t used = 0;
+	size_t i = 0;
+	uint32_t low = 0;
+	uint32_t high = 0;
+	uint32_t mid = 0;
+
+	if (!TnyReader_init(&reader, data, length) || reader.stack[0].type != TNY_ARRAY || reader.stack[0].count < count) {
+		return 0;
+	}
+
+	first = reader.stack[0].first;
+	if (reader.stack[0].index > 0) {
+		/* The offset index tells where every element starts, so the ranges are found by bisection. */
+		end = reader.stack[0].index;
+		for (i = 0; i < count; i++) {
+			low = used > 0 ? slices[used - 1].number + 1 : 0;
+			high = reader.stack[0].count;
+			while (low < high) {
+				mid = low + (high - low) / 2;
+				Tny_swapBytes64(&offset, data + end + mid * sizeof(uint64_t));
+				if (offset < (end - first) / count * i + (first - reader.stack[0].start)) {
+					low = mid + 1;
+				} else {
+					high = mid;
+				}
+			}
+			if (low < reader.stack[0].count) {
+				Tny_swapBytes64(&offset, data + end + low * sizeof(uint64_t));
+				if (offset < first - reader.stack[0].start || offset >= end - reader.stack[0].start) {
+					return 0;
+				}
+				slices[used].start = i > 0 ? reader.stack[0].start + offset : first;
+				slices[used].number = low;
+				used++;
+			}
+		}
+	} else {
+		/* Without an index the element boundaries are found by skipping over the elements. */
+		for (i = 0; i < reader.stack[0].count; i++) {
+			if (reader.pending && !TnyReader_skip(&reader)) {
+				return 0;
+			}
+			if (used < count && reader.pos - first >= (length - first) / count * used) {
+				slices[used].start = reader.pos;
+				slices[used].number = i;
+				used++;
+			}
+			if (!TnyReader_advance(&reader)) {
+				return 0;
+			}
+		}
+		if (reader.pending && !TnyReader_skip(&reader)) {
+			return 0;
+		}
+		end = reader.pos;
+	}
+
+	for (i = 0; i < used; i++) {
+		slices[i].end = i + 1 < used ? slices[i + 1].start : end;
+		slices[i].count = (i + 1 < used ? slices[i + 1].number : reader.stack[0].count) - slices[i].number;
+		slices[i].compact = reader.stack[0].compact;
+	}
+
+	return used;
+}
+
+static void* Tny_loadSlice(void *arg)
+{
+	TnySlice *slice = arg;
+	Tny *tny = NULL;
+	size_t pos = slice->start;
+
+	if (slice->flags & TNY_LOAD_ARENA) {
+		slice->arena = TnyArena_create(0, NULL);
+		if (slice->arena == NULL) {
+			return NULL;
+		}
+	}
+
+	slice->first = _Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0, slice->arena, 0);
+	if (slice->first == NULL) {
+		return NULL;
+	}
+
+	Tny_loadElements(slice->first, slice->data, slice->end, &pos, slice->count, slice->compact, slice->arena, slice->flags, slice->keys);
+	slice->done = pos == slice->end && slice->first->size == slice->count;
+	if (slice->done) {
+		/* The shared root is only read here, the sizes are summed up after all threads are done. */
+		for (tny = slice->first->next; tny != NULL; tny = tny->next) {
+			tny->root = slice->root;
+			tny->docSizePtr = &slice->root->docSize;
+			if (tny->type == TNY_OBJ && tny->value.tny != NULL) {
+				tny->value.tny->docSizePtr = &slice->root->docSize;
+				if (slice->arena != NULL) {
+					TnyArena_adopt(slice->root->arena, tny->value.tny);
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static Tny* Tny_loadsSliced(char *data, size_t length, TnyArena *arena, int flags, int threads, const struct _TnyKeys *keys)
+{
+	TnySlice slices[TNY_LOAD_MAXTHREADS];
+	Tny *tny = NULL;
+	size_t header = 0;
+	size_t count = threads < TNY_LOAD_MAXTHREADS ? threads : TNY_LOAD_MAXTHREADS;
+	size_t used = 0;
+	size_t i = 0;
+	int done = 1;
+
+	if (length / TNY_LOAD_SLICESIZE < count) {
+		count = length / TNY_LOAD_SLICESIZE;
+	}
+	if (count < 2) {
+		return NULL;
+	}
+
+	memset(slices, 0, sizeof(slices));
+	used = Tny_splitArray(data, length, slices, count);
+	if (used < 2) {
+		return NULL;
+	}
+
+	tny = _Tny_add(NULL, TNY_ARRAY, NULL, NULL, 0, arena, 0);
+	if (tny == NULL) {
+		return NULL;
+	}
+	header = tny->docSize;
+
+	for (i = 0; i < used; i++) {
+		slices[i].data = data;
+		slices[i].flags = flags;
+		slices[i].keys = keys;
+		slices[i].root = tny;
+	}
+	/* The calling thread loads the first range itself, and every range a thread could not be started for. */
+	for (i = 1; i < used; i++) {
+		slices[i].started = pthread_create(&slices[i].thread, NULL, Tny_loadSlice, &slices[i]) == 0;
+	}
+	Tny_loadSlice(&slices[0]);
+	for (i = 1; i < used; i++) {
+		if (slices[i].started) {
+			pthread_join(slices[i].thread, NULL);
+		} else {
+			Tny_loadSlice(&slices[i]);
+		}
+	}
+
+	for (i = 0; i < used; i++) {
+		done = done && slices[i].done;
+	}
+	for (i = 0; i < used; i++) {
+		if (done && slices[i].first->next != NULL) {
+			slices[i].first->next->prev = tny->tail;
+			tny->tail->next = slices[i].first->next;
+			tny->tail = slices[i].first->tail;
+			tny->size += slices[i].first->size;
+			tny->docSize += slices[i].first->docSize - header;
+			slices[i].first->next = NULL;
+			slices[i].first->tail = slices[i].first;
+		}
+		/* The positions are indexed once for the whole array below. */
+		if (slices[i].first != NULL) {
+			TnyIndex_free(slices[i].first);
+		}
+		if (slices[i].arena != NULL) {
+			if (done) {
+				TnyArena_merge(arena, slices[i].arena);
+			} else {
+				TnyArena_free(slices[i].arena);
+			}
+		} else {
+			Tny_free(slices[i].first);
+		}
+	}
+
+	if (!done) {
+		Tny_releaseNode(arena, tny);
+		tny = NULL;
+	} else if (tny->size >= TNY_INDEX_THRESHOLD) {
+		TnyIndex_build(tny);
+	}
+
+	return tny;
+}
+#endif
+
+Tny* Tny_loadsParallel(void *data, size_t length, int flags, int threads)
+{
+	return Tny_loadsChecked(data, length, flags, threads, NULL);
+}
+
+static Tny* Tny_loadsChecked(void *data, size_t length, int flags, int threads, const TnyLimits *limits)
+{
+	TnyArena *arena = NULL;
+	Tny *tny = NULL;
+	struct _TnyKeys *keys = NULL;
+	const char *table = NULL;
+	size_t pos = 0;
+	uint64_t original = 0;
+	uint64_t block = 0;
+	uint32_t tableSize = 0;
+	uint32_t count = 0;
+	char *buffer = NULL;
+	int valid = 1;
+	size_t input = length;
+
+	if (length >= TNY_COMPRESSED_HEADER && *(char*)data == TNY_FORMAT_COMPRESSED) {
+		Tny_swapBytes64(&original, (const char*)data + 1);
+		Tny_swapBytes64(&block, (const char*)data + 1 + sizeof(uint64_t));
+		if (block > length - TNY_COMPRESSED_HEADER || original > SIZE_MAX || original / TNY_LZ_MAXRATIO > block) {
+			return NULL;
+		}
+		/* A view of a compressed document points into the decompressed copy, which the arena keeps alive. */
+		if (flags & TNY_LOAD_VIEW) {
+			flags |= TNY_LOAD_ARENA;
+		}
+	}
+
+	if (flags & TNY_LOAD_ARENA) {
+		arena = TnyArena_create(0, NULL);
+		if (arena == NULL) {
+			return NULL;
+		}
+	}
+
+	if (original > 0) {
+		buffer = Tny_malloc(arena, original);
+		if (buffer == NULL || !TnyLz_decompress((const char*)data + TNY_COMPRESSED_HEADER, block, buffer, original)) {
+			if (arena != NULL) {
+				TnyArena_free(arena);
+			} else {
+				Tny_release(NULL, buffer);
+			}
+			return NULL;
+		}
+		data = buffer;
+		length = original;
+	}
+
+	if (flags & TNY_LOAD_VALIDATE) {
+		valid = Tny_validate(data, length, limits);
+	}
+	if (valid && length > 0 && *(unsigned char*)data == TNY_FORMAT_KEYED) {
+		/* Every key of the table is copied once, the elements share the copies. */
+		table = Tny_readKeyTable(data, length, &pos, &tableSize, &count);
+		keys = table != NULL ? Tny_internKeys(table, tableSize, count, arena, flags & TNY_LOAD_VIEW) : NULL;
+		valid = keys != NULL;
+	}
+	if (!valid) {
+		if (arena != NULL) {
+			TnyArena_free(arena);
+		} else {
+			Tny_release(NULL, buffer);
+		}
+		return NULL;
+	}
+
+#ifdef TNY_THREADS
+	if (threads > 1) {
+		tny = Tny_loadsSliced(data, length, arena, flags, threads, keys);
+	}
+#endif
+	if (tny == NULL) {
+		tny = _Tny_loads(data, length, &pos, NULL, arena, flags, keys);
+	}
+	if (tny != NULL) {
+		tny->keys = keys;
+		TNY_COUNT(loads, 1);
+		TNY_COUNT(parsedBytes, input);
+	} else {
+		Tny_release(arena, keys);
+	}
+	if (arena == NULL) {
+		Tny_release(NULL, buffer);
+	}
+	if (arena != NULL) {
+		if (tny != NULL) {
+			arena->owner = tny;
+		} else {
+			TnyArena_free(arena);
+		}
+	}
+
+	return tny;
+}
+
+Tny* Tny_loadFile(const char *path, int flags)
+{
+	Tny *tny = NULL;
+	char *data = NULL;
+	size_t size = 0;
+#ifdef TNY_POSIX
+	struct stat info;
+	int fd = open(path, O_RDONLY);
+	int keep = 0;
+
+	if (fd < 0) {
+		return NULL;
+	}
+	if (fstat(fd, &info) != 0 || info.st_size <= 0 || (uint64_t)info.st_size > SIZE_MAX) {
+		close(fd);
+		return NULL;
+	}
+	size = info.st_size;
+	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return NULL;
+	}
+
+	/* A view keeps pointing into the mapping, so the arena of the document owns it.
+	   Compressed documents are decompressed into the arena instead. */
+	keep = (flags & TNY_LOAD_VIEW) && data[0] != TNY_FORMAT_COMPRESSED;
+	if (keep) {
+		flags |= TNY_LOAD_ARENA;
+	}
+
+	posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+	tny = Tny_loadsEx(data, size, flags);
+	if (tny != NULL && keep) {
+		/* Only the values which are used get faulted in from now on. */
+		posix_madvise(data, size, POSIX_MADV_NORMAL);
+		tny->arena->mapping = data;
+		tny->arena->mappingSize = size;
+	} else {
+		munmap(data, size);
+	}
+#else
+	FILE *file = fopen(path, "rb");
+	long length = 0;
+
+	if (file == NULL) {
+		return NULL;
+	}
+	if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0) {
+		size = length;
+		data = Tny_malloc(NULL, size);
+	}
+	if (data != NULL && fread(data, 1, size, file) == size) {
+		/* Without a mapping a view would point into a buffer which gets free'd. */
+		tny = Tny_loadsEx(data, size, flags & ~TNY_LOAD_VIEW);
+	}
+	Tny_release(NULL, data);
+	fclose(file);
+#endif
+
+	return tny;
+}
+
+static uint32_t* Tny_swapBytes32(uint32_t *dest, const char *src)
+{
+	union {
+		uint32_t num;
+		char c[4];
+	} bytes;
+	char c;
+
+	if (ORDER_LITTLE_ENDIAN != HOST_ORDER) {
+		memcpy(&bytes.num, src, sizeof(uint32_t));
+		c = bytes.c[0]; bytes.c[0] = bytes.c[3]; bytes.c[3] = c;
+		c = bytes.c[1]; bytes.c[1] = bytes.c[2]; bytes.c[2] = c;
+		memcpy(dest, &bytes.num, sizeof(uint32_t));
+	} else {
+		memcpy(dest, src, sizeof(uint32_t));
+	}
+
+	return dest;
+}
+
+static uint64_t* Tny_swapBytes64(uint64_t *dest, const char *src)
+{
+	union {
+		uint64_t num;
+		char c[8];
+	} bytes;
+	char c;
+
+	if (ORDER_LITTLE_ENDIAN != HOST_ORDER) {
+		memcpy(&bytes.num, src, sizeof(uint64_t));
+		c = bytes.c[0]; bytes.c[0] = bytes.c[7]; bytes.c[7] = c;
+		c = bytes.c[1]; bytes.c[1] = bytes.c[6]; bytes.c[6] = c;
+		c = bytes.c[2]; bytes.c[2] = bytes.c[5]; bytes.c[5] = c;
+		c = bytes.c[3]; bytes.c[3] = bytes.c[4]; bytes.c[4] = c;
+		memcpy(dest, &bytes.num, sizeof(uint64_t));
+	} else {
+		memcpy(dest, src, sizeof(uint64_t));
+	}
+
+	return dest;
+}
+
+static size_t Tny_packedWidth(TnyType type)
+{
+	if (type == TNY_PACKED_INT32) {
+		return sizeof(uint32_t);
+	} else if (type == TNY_PACKED_INT64 || type == TNY_PACKED_DOUBLE) {
+		return sizeof(uint64_t);
+	}
+
+	return 0;
+}
+
+static void Tny_swapBulk(char *dest, const char *src, size_t count, size_t width)
+{
+	uint32_t u32 = 0;
+	uint64_t u64 = 0;
+	size_t i = 0;
+
+	if (ORDER_LITTLE_ENDIAN == HOST_ORDER) {
+		if (dest != src) {
+			memcpy(dest, src, count * width);
+		}
+		return;
+	}
+
+	/* Branch free shifts in a tight loop, which compilers turn into vector byte shuffles. */
+	if (width == sizeof(uint32_t)) {
+		for (i = 0; i < count; i++) {
+			memcpy(&u32, src + i * sizeof(uint32_t), sizeof(uint32_t));
+			u32 = (u32 >> 24) | ((u32 >> 8) & 0xFF00u) | ((u32 << 8) & 0xFF0000u) | (u32 << 24);
+			memcpy(dest + i * sizeof(uint32_t), &u32, sizeof(uint32_t));
+		}
+	} else {
+		for (i = 0; i < count; i++) {
+			memcpy(&u64, src + i * sizeof(uint64_t), sizeof(uint64_t));
+			u64 = (u64 >> 56) | ((u64 >> 40) & 0xFF00ull) | ((u64 >> 24) & 0xFF0000ull) | ((u64 >> 8) & 0xFF000000ull)
+				| ((u64 << 8) & 0xFF00000000ull) | ((u64 << 24) & 0xFF0000000000ull)
+				| ((u64 << 40) & 0xFF000000000000ull) | (u64 << 56);
+			memcpy(dest + i * sizeof(uint64_t), &u64, sizeof(uint64_t));
+		}
+	}
+}
+
+int Tny_hasNext(const Tny *tny)
+{
+	return tny->next != NULL;
+}
+
+Tny* Tny_next(const Tny *tny)
+{
+	return tny->next;
+}
+
+static int TnyReader_push(TnyReader *reader)
+{
+	TnyType type = TNY_NULL;
+	uint32_t count = 0;
+	uint64_t indexPos = 0;
+	uint64_t indexSize = 0;
+	size_t start = reader->pos;
+	int compact = 0;
+
+	if (reader->depth >= TNY_READER_MAXDEPTH || reader->pos + 1 > reader->length) {
+		reader->error = 1;
+		return 0;
+	}
+
+	type = (unsigned char)reader->data[reader->pos];
+	compact = (type & TNY_FORMAT_COMPACT) != 0;
+	type &= ~TNY_FORMAT_COMPACT;
+	if ((type & ~TNY_FORMAT_INDEXED) != TNY_ARRAY && (type & ~TNY_FORMAT_INDEXED) != TNY_DICT) {
+		reader->error = 1;
+		return 0;
+	}
+
+	reader->pos++;
+	if (!Tny_readLength(reader->data, reader->length, &reader->pos, compact, &count)) {
+		reader->error = 1;
+		return 0;
+	}
+	if (type & TNY_FORMAT_INDEXED) {
+		type &= ~TNY_FORMAT_INDEXED;
+		if (reader->pos + sizeof(uint64_t) > reader->length) {
+			reader->error = 1;
+			return 0;
+		}
+		Tny_swapBytes64(&indexPos, reader->data + reader->pos);
+		reader->pos += sizeof(uint64_t);
+		indexSize = (uint64_t)count * sizeof(uint64_t) * (type == TNY_DICT ? 2 : 1);
+		if (indexPos < reader->pos - start || indexPos > reader->length - start
+				|| indexSize > reader->length - start - indexPos) {
+			reader->error = 1;
+			return 0;
+		}
+	}
+
+	reader->stack[reader->depth].type = type;
+	reader->stack[reader->depth].remaining = count;
+	reader->stack[reader->depth].count = count;
+	reader->stack[reader->depth].start = start;
+	reader->stack[reader->depth].first = reader->pos;
+	reader->stack[reader->depth].index = indexPos > 0 ? start + indexPos : 0;
+	reader->stack[reader->depth].end = indexPos > 0 ? start + indexPos + indexSize : 0;
+	reader->stack[reader->depth].compact = compact;
+	reader->depth++;
+	reader->pending = 0;
+
+	return 1;
+}
+
+static void TnyReader_pop(TnyReader *reader)
+{
+	reader->depth--;
+	if (reader->stack[reader->depth].end > 0) {
+		reader->pos = reader->stack[reader->depth].end;
+	}
+	reader->pending = 0;
+}
+
+static int TnyReader_rewind(TnyReader *reader, uint32_t index)
+{
+	uint64_t offset = 0;
+	int level = reader->depth - 1;
+
+	if (reader->stack[level].index > 0) {
+		Tny_swapBytes64(&offset, reader->data + reader->stack[level].index + index * sizeof(uint64_t));
+		if (offset < reader->stack[level].first - reader->stack[level].start
+				|| offset >= reader->stack[level].index - reader->stack[level].start) {
+			reader->error = 1;
+			return 0;
+		}
+		reader->pos = reader->stack[level].start + offset;
+		reader->stack[level].remaining = reader->stack[level].count - index;
+		index = 0;
+	} else {
+		reader->pos = reader->stack[level].first;
+		reader->stack[level].remaining = reader->stack[level].count;
+	}
+	reader->pending = 0;
+
+	while (index-- > 0) {
+		if (!TnyReader_next(reader)) {
+			return 0;
+		}
+	}
+
+	return TnyReader_next(reader);
+}
+
+static int TnyReader_advance(TnyReader *reader)
+{
+	TnyType type = TNY_NULL;
+	uint32_t size = 0;
+
+	if (reader->error || reader->depth == 0 || reader->stack[reader->depth - 1].remaining == 0) {
+		return 0;
+	}
+
+	if (reader->pos >= reader->length) {
+		reader->error = 1;
+		return 0;
+	}
+
+	type = (unsigned char)reader->data[reader->pos++];
+	reader->compressed = type == (TNY_BIN | TNY_FORMAT_COMPRESSED);
+	if (reader->compressed) {
+		type = TNY_BIN;
+	}
+	if (type == TNY_ARRAY || type == TNY_DICT || type > TNY_PACKED_DOUBLE) {
+		reader->error = 1;
+		return 0;
+	}
+
+	reader->key = NULL;
+	reader->keyLength = 0;
+	if (reader->stack[reader->depth - 1].type == TNY_DICT) {
+		if (!Tny_readLength(reader->data, reader->length, &reader->pos, reader->stack[reader->depth - 1].compact, &size)) {
+			reader->error = 1;
+			return 0;
+		}
+		if (reader->keys != NULL && size < reader->keyCount) {
+			reader->key = Tny_tableKey(reader->keys, size, &reader->keyLength);
+		} else if (reader->keys != NULL || size == 0 || reader->pos + size > reader->length
+				|| reader->data[reader->pos + size - 1] != '\0') {
+			reader->error = 1;
+			return 0;
+		} else {
+			reader->key = reader->data + reader->pos;
+			reader->keyLength = size - 1;
+			reader->pos += size;
+		}
+	}
+
+	reader->type = type;
+	reader->stack[reader->depth - 1].remaining--;
+	reader->pending = 1;
+
+	return 1;
+}
+
+static int TnyReader_skipScalar(TnyReader *reader)
+{
+	uint32_t size = 0;
+	uint64_t value = 0;
+	int compact = reader->stack[reader->depth - 1].compact;
+
+	if (reader->type == TNY_CHAR) {
+		size = 1;
+	} else if ((reader->type == TNY_INT32 || reader->type == TNY_INT64) && compact) {
+		if (!Tny_readVarint(reader->data, reader->length, &reader->pos, &value)) {
+			reader->error = 1;
+			return 0;
+		}
+	} else if (reader->type == TNY_INT32) {
+		size = sizeof(uint32_t);
+	} else if (reader->type == TNY_INT64 || reader->type == TNY_DOUBLE) {
+		size = sizeof(uint64_t);
+	} else if (reader->type == TNY_BIN) {
+		if (!Tny_readLength(reader->data, reader->length, &reader->pos, compact, &size)
+				|| (reader->compressed && !Tny_readLength(reader->data, reader->length, &reader->pos, compact, &size))) {
+			reader->error = 1;
+			return 0;
+		}
+	} else if (Tny_packedWidth(reader->type) > 0) {
+		if (!Tny_readLength(reader->data, reader->length, &reader->pos, compact, &size)
+				|| size > (reader->length - reader->pos) / Tny_packedWidth(reader->type)) {
+			reader->error = 1;
+			return 0;
+		}
+		reader->pos += size * Tny_packedWidth(reader->type);
+		size = 0;
+	}
+
+	if (reader->pos + size > reader->length) {
+		reader->error = 1;
+		return 0;
+	}
+	reader->pos += size;
+	reader->pending = 0;
+
+	return 1;
+}
+
+int TnyReader_init(TnyReader *reader, const void *data, size_t length)
+{
+	uint32_t size = 0;
+
+	memset(reader, 0, sizeof(TnyReader));
+	reader->data = data;
+	reader->length = length;
+
+	if (length > 0 && (unsigned char)reader->data[0] == TNY_FORMAT_KEYED) {
+		/* The table is checked once, the references only have to be in range. */
+		reader->keys = Tny_readKeyTable(reader->data, length, &reader->pos, &size, &reader->keyCount);
+		if (reader->keys == NULL) {
+			reader->error = 1;
+			return 0;
+		}
+	}
+
+	return TnyReader_push(reader);
+}
+
+int TnyReader_next(TnyReader *reader)
+{
+	if (reader->pending && !TnyReader_skip(reader)) {
+		return 0;
+	}
+
+	return TnyReader_advance(reader);
+}
+
+TnyType TnyReader_type(const TnyReader *reader)
+{
+	return reader->type;
+}
+
+TnyType TnyReader_documentType(const TnyReader *reader)
+{
+	return reader->depth > 0 ? reader->stack[reader->depth - 1].type : TNY_NULL;
+}
+
+const char* TnyReader_key(const TnyReader *reader, uint32_t *length)
+{
+	if (length != NULL) {
+		*length = reader->keyLength;
+	}
+
+	return reader->key;
+}
+
+char TnyReader_char(const TnyReader *reader)
+{
+	char result = 0;
+
+	if (reader->pending && reader->type == TNY_CHAR && reader->pos + 1 <= reader->length) {
+		result = reader->data[reader->pos];
+	}
+
+	return result;
+}
+
+uint32_t TnyReader_int32(const TnyReader *reader)
+{
+	uint32_t result = 0;
+	uint64_t value = 0;
+	size_t pos = reader->pos;
+
+	if (reader->pending && reader->type == TNY_INT32) {
+		if (reader->stack[reader->depth - 1].compact) {
+			if (Tny_readVarint(reader->data, reader->length, &pos, &value)) {
+				result = (uint32_t)TNY_UNZIGZAG(value);
+			}
+		} else if (reader->pos + sizeof(uint32_t) <= reader->length) {
+			Tny_swapBytes32(&result, reader->data + reader->pos);
+		}
+	}
+
+	return result;
+}
+
+uint64_t TnyReader_int64(const TnyReader *reader)
+{
+	uint64_t result = 0;
+	size_t pos = reader->pos;
+
+	if (reader->pending && reader->type == TNY_INT64) {
+		if (reader->stack[reader->depth - 1].compact) {
+			if (Tny_readVarint(reader->data, reader->length, &pos, &result)) {
+				result = TNY_UNZIGZAG(result);
+			}
+		} else if (reader->pos + sizeof(uint64_t) <= reader->length) {
+			Tny_swapBytes64(&result, reader->data + reader->pos);
+		}
+	}
+
+	return result;
+}
+
+double TnyReader_double(const TnyReader *reader)
+{
+	double result = 0.0;
+
+	if (reader->pending && reader->type == TNY_DOUBLE && reader->pos + sizeof(double) <= reader->length) {
+		Tny_swapBytes64((uint64_t*)&result, reader->data + reader->pos);
+	}
+
+	return result;
+}
+
+const void* TnyReader_bin(const TnyReader *reader, uint32_t *size)
+{
+	const void *result = NULL;
+	uint32_t len = 0;
+	size_t pos = reader->pos;
+
+	if (reader->pending && reader->type == TNY_BIN
+			&& Tny_readLength(reader->data, reader->length, &pos, reader->stack[reader->depth - 1].compact, &len)) {
+		if (reader->compressed) {
+			result = NULL;
+		} else if (pos + len <= reader->length) {
+			result = reader->data + pos;
+		} else {
+			len = 0;
+		}
+	}
+
+	if (size != NULL) {
+		*size = len;
+	}
+
+	return result;
+}
+
+int TnyReader_binInto(const TnyReader *reader, void *data, uint32_t capacity)
+{
+	size_t pos = reader->pos;
+	uint32_t len = 0;
+	uint32_t block = 0;
+	int compact = reader->depth > 0 && reader->stack[reader->depth - 1].compact;
+
+	if (!reader->pending || reader->type != TNY_BIN
+			|| !Tny_readLength(reader->data, reader->length, &pos, compact, &len) || len > capacity) {
+		return 0;
+	}
+
+	if (reader->compressed) {
+		return Tny_readLength(reader->data, reader->length, &pos, compact, &block)
+			&& block <= reader->length - pos && TnyLz_decompress(reader->data + pos, block, data, len);
+	}
+
+	if (len > reader->length - pos) {
+		return 0;
+	}
+	memcpy(data, reader->data + pos, len);
+
+	return 1;
+}
+
+uint32_t TnyReader_packed(const TnyReader *reader, void *data, uint32_t capacity)
+{
+	size_t pos = reader->pos;
+	uint32_t count = 0;
+	size_t width = reader->pending ? Tny_packedWidth(reader->type) : 0;
+
+	if (width == 0 || !Tny_readLength(reader->data, reader->length, &pos, reader->stack[reader->depth - 1].compact, &count)
+			|| count > (reader->length - pos) / width) {
+		return 0;
+	}
+	if (data != NULL && count <= capacity) {
+		Tny_swapBulk(data, reader->data + pos, count, width);
+	}
+
+	return count;
+}
+
+int TnyReader_enter(TnyReader *reader)
+{
+	if (!reader->pending || reader->type != TNY_OBJ) {
+		return 0;
+	}
+
+	return TnyReader_push(reader);
+}
+
+int TnyReader_leave(TnyReader *reader)
+{
+	if (reader->depth == 0) {
+		return 0;
+	}
+
+	if (reader->stack[reader->depth - 1].end == 0) {
+		while (TnyReader_next(reader));
+		if (reader->error) {
+			return 0;
+		}
+	}
+	TnyReader_pop(reader);
+
+	return 1;
+}
+
+static int Tny_validateValue(TnyReader *reader, uint64_t maxValueSize)
+{
+	size_t pos = reader->pos;
+	size_t width = reader->type == TNY_BIN ? 1 : Tny_packedWidth(reader->type);
+	uint32_t size = 0;
+	uint32_t block = 0;
+	int compact = reader->stack[reader->depth - 1].compact;
+
+	if (width == 0) {
+		return TnyReader_skipScalar(reader);
+	}
+
+	if (!Tny_readLength(reader->data, reader->length, &pos, compact, &size) || (uint64_t)size * width > maxValueSize) {
+		return 0;
+	}
+	if (reader->compressed) {
+		if (!Tny_readLength(reader->data, reader->length, &pos, compact, &block) || block > reader->length - pos
+				|| size / TNY_LZ_MAXRATIO > block || !TnyLz_decompress(reader->data + pos, block, NULL, size)) {
+			return 0;
+		}
+		pos += block;
+	} else if (size > (reader->length - pos) / width) {
+		return 0;
+	} else {
+		pos += size * width;
+	}
+	reader->pos = pos;
+	reader->pending = 0;
+
+	return 1;
+}
+
+static int Tny_validateIndex(const TnyReader *reader)
+{
+	int level = reader->depth - 1;
+	const char *pairs = reader->data + reader->stack[level].index + reader->stack[level].count * sizeof(uint64_t);
+	uint32_t hash = 0;
+	uint32_t last = 0;
+	uint32_t number = 0;
+	uint32_t i = 0;
+
+	/* The elements have to end where the index starts, dictionaries add sorted pairs of hashes and numbers. */
+	if (reader->pos != reader->stack[level].index) {
+		return 0;
+	}
+	if (reader->stack[level].type == TNY_DICT) {
+		for (i = 0; i < reader->stack[level].count; i++) {
+			Tny_swapBytes32(&hash, pairs + i * 2 * sizeof(uint32_t));
+			Tny_swapBytes32(&number, pairs + i * 2 * sizeof(uint32_t) + sizeof(uint32_t));
+			if ((i > 0 && hash < last) || number >= reader->stack[level].count) {
+				return 0;
+			}
+			last = hash;
+		}
+	}
+
+	return 1;
+}
+
+int Tny_validate(const void *data, size_t length, const TnyLimits *limits)
+{
+	TnyReader reader;
+	uint64_t original = 0;
+	uint64_t block = 0;
+	uint64_t offset = 0;
+	uint64_t elements = 0;
+	uint64_t maxElements = limits != NULL && limits->maxElements > 0 ? limits->maxElements : UINT64_MAX;
+	uint64_t maxValueSize = limits != NULL && limits->maxValueSize > 0 ? limits->maxValueSize : UINT64_MAX;
+	int maxDepth = TNY_READER_MAXDEPTH;
+	int level = 0;
+
+	if (limits != NULL && limits->maxDepth > 0 && limits->maxDepth < TNY_READER_MAXDEPTH) {
+		maxDepth = limits->maxDepth;
+	}
+
+	if (length >= TNY_COMPRESSED_HEADER && *(const char*)data == TNY_FORMAT_COMPRESSED) {
+		Tny_swapBytes64(&original, (const char*)data + 1);
+		Tny_swapBytes64(&block, (const char*)data + 1 + sizeof(uint64_t));
+		return block == length - TNY_COMPRESSED_HEADER && original <= SIZE_MAX && original / TNY_LZ_MAXRATIO <= block
+			&& TnyLz_decompress((const char*)data + TNY_COMPRESSED_HEADER, block, NULL, original);
+	}
+
+	if (!TnyReader_init(&reader, data, length)) {
+		return 0;
+	}
+	elements = reader.stack[0].count;
+
+	/* The reader walks the documents iteratively, its stack keeps track of the nesting. */
+	while (reader.depth > 0 && elements <= maxElements) {
+		level = reader.depth - 1;
+		if (reader.stack[level].remaining == 0) {
+			if (reader.stack[level].index > 0 && !Tny_validateIndex(&reader)) {
+				return 0;
+			}
+			TnyReader_pop(&reader);
+			continue;
+		}
+
+		if (reader.stack[level].index > 0) {
+			Tny_swapBytes64(&offset, reader.data + reader.stack[level].index
+				+ (reader.stack[level].count - reader.stack[level].remaining) * sizeof(uint64_t));
+			if (offset != reader.pos - reader.stack[level].start) {
+				return 0;
+			}
+		}
+		if (!TnyReader_advance(&reader)) {
+			return 0;
+		}
+		if (reader.type == TNY_OBJ) {
+			if (reader.depth >= maxDepth || !TnyReader_push(&reader)) {
+				return 0;
+			}
+			elements += reader.stack[reader.depth - 1].count;
+		} else if (!Tny_validateValue(&reader, maxValueSize)) {
+			return 0;
+		}
+	}
+
+	return reader.depth == 0 && reader.pos == length;
+}
+
+int TnyReader_skip(TnyReader *reader)
+{
+	TnyType type = reader->type;
+	const char *key = reader->key;
+	uint32_t keyLength = reader->keyLength;
+	int depth = reader->depth;
+
+	if (!reader->pending) {
+		return !reader->error;
+	}
+
+	if (type != TNY_OBJ) {
+		return TnyReader_skipScalar(reader);
+	}
+
+	/* Walk the sub documents iteratively, the reader stack keeps track of the nesting. */
+	if (!TnyReader_push(reader)) {
+		return 0;
+	}
+	while (reader->depth > depth) {
+		if (reader->stack[reader->depth - 1].end > 0) {
+			/* Indexed documents know where they end. */
+			TnyReader_pop(reader);
+		} else if (reader->pending) {
+			if (reader->type == TNY_OBJ) {
+				if (!TnyReader_push(reader)) {
+					return 0;
+				}
+			} else if (!TnyReader_skipScalar(reader)) {
+				return 0;
+			}
+		} else if (!TnyReader_advance(reader)) {
+			if (reader->error) {
+				return 0;
+			}
+			TnyReader_pop(reader);
+		}
+	}
+
+	reader->type = type;
+	reader->key = key;
+	reader->keyLength = keyLength;
+	reader->pending = 0;
+
+	return 1;
+}
+
+int TnyReader_seek(TnyReader *reader, uint32_t index)
+{
+	if (reader->error || reader->depth == 0 || index >= reader->stack[reader->depth - 1].count) {
+		return 0;
+	}
+
+	return TnyReader_rewind(reader, index);
+}
+
+int TnyReader_find(TnyReader *reader, const char *key)
+{
+	size_t len = 0;
+
+	if (key == NULL) {
+		return 0;
+	}
+
+	len = strlen(key);
+	return TnyReader_findKey(reader, key, len, reader->depth > 0 && reader->stack[reader->depth - 1].index > 0 ? Tny_hash(key, len) : 0);
+}
+
+static int TnyReader_findKey(TnyReader *reader, const char *key, size_t len, uint32_t hash)
+{
+	int level = reader->depth - 1;
+	size_t pairs = 0;
+	uint32_t current = 0;
+	uint32_t number = 0;
+	uint32_t low = 0;
+	uint32_t high = 0;
+	uint32_t mid = 0;
+
+	if (reader->error || reader->depth == 0 || reader->stack[level].type != TNY_DICT) {
+		return 0;
+	}
+
+	if (reader->stack[level].index > 0) {
+		/* The index holds (hash, element number) pairs sorted by the hash. */
+		pairs = reader->stack[level].index + reader->stack[level].count * sizeof(uint64_t);
+		high = reader->stack[level].count;
+		while (low < high) {
+			mid = low + (high - low) / 2;
+			Tny_swapBytes32(&current, reader->data + pairs + mid * sizeof(uint64_t));
+			if (current < hash) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+
+		for (; low < reader->stack[level].count; low++) {
+			Tny_swapBytes32(&current, reader->data + pairs + low * sizeof(uint64_t));
+			if (current != hash) {
+				break;
+			}
+			Tny_swapBytes32(&number, reader->data + pairs + low * sizeof(uint64_t) + sizeof(uint32_t));
+			if (number >= reader->stack[level].count) {
+				reader->error = 1;
+				return 0;
+			}
+			if (!TnyReader_rewind(reader, number)) {
+				return 0;
+			}
+			if (reader->keyLength == len && memcmp(reader->key, key, len) == 0) {
+				return 1;
+			}
+		}
+
+		reader->pos = reader->stack[level].index;
+		reader->stack[level].remaining = 0;
+		reader->pending = 0;
+	} else {
+		reader->pos = reader->stack[level].first;
+		reader->stack[level].remaining = reader->stack[level].count;
+		reader->pending = 0;
+		while (TnyReader_next(reader)) {
+			if (reader->keyLength == len && memcmp(reader->key, key, len) == 0) {
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+TnyPath* Tny_compilePath(const char *path)
+{
+	TnyPath *compiled = NULL;
+	TnyPathStep *step = NULL;
+	const char *pos = NULL;
+	char *text = NULL;
+	size_t len = 0;
+	size_t i = 0;
+	uint32_t count = 1;
+	uint64_t index = 0;
+	int error = 0;
+
+	if (path == NULL || *path == '\0') {
+		return NULL;
+	}
+
+	len = strlen(path);
+	for (i = 0; i < len; i++) {
+		if (path[i] == '.' || path[i] == '[') {
+			count++;
+		}
+	}
+
+	compiled = Tny_malloc(NULL, sizeof(TnyPath) + count * sizeof(TnyPathStep) + len + 1);
+	if (compiled == NULL) {
+		return NULL;
+	}
+
+	text = (char*)&compiled->steps[count];
+	memcpy(text, path, len + 1);
+	compiled->count = 0;
+	pos = text;
+	while (!error && *pos != '\0') {
+		step = &compiled->steps[compiled->count];
+		if (*pos == '[') {
+			/* An index step: "[" 1*DIGIT "]". */
+			pos++;
+			index = 0;
+			error = *pos < '0' || *pos > '9';
+			while (*pos >= '0' && *pos <= '9' && index <= UINT32_MAX) {
+				index = index * 10 + (uint64_t)(*pos - '0');
+				pos++;
+			}
+			error = error || *pos != ']' || index > UINT32_MAX;
+			pos++;
+			step->key = NULL;
+			step->keyLength = 0;
+			step->keyHash = 0;
+			step->index = (uint32_t)index;
+		} else {
+			/* A key step, every but the first one is introduced by a ".". */
+			if (compiled->count > 0) {
+				error = *pos != '.';
+				pos++;
+			}
+			step->key = pos;
+			while (*pos != '\0' && *pos != '.' && *pos != '[' && *pos != ']') {
+				pos++;
+			}
+			error = error || pos == step->key;
+			step->keyLength = (uint32_t)(pos - step->key);
+			step->keyHash = Tny_hash(step->key, step->keyLength);
+			step->index = 0;
+		}
+		compiled->count++;
+	}
+
+	if (error) {
+		Tny_release(NULL, compiled);
+		compiled = NULL;
+	}
+
+	return compiled;
+}
+
+int TnyPath_evaluate(const TnyPath *path, TnyReader *reader)
+{
+	const TnyPathStep *step = NULL;
+	uint32_t i = 0;
+
+	if (path == NULL || reader == NULL) {
+		return 0;
+	}
+
+	for (i = 0; i < path->count; i++) {
+		step = &path->steps[i];
+		/* Only the matching sub document is entered, its siblings are skipped. */
+		if (i > 0 && !TnyReader_enter(reader)) {
+			return 0;
+		}
+		if (step->key != NULL) {
+			if (!TnyReader_findKey(reader, step->key, step->keyLength, step->keyHash)) {
+				return 0;
+			}
+		} else if (reader->depth == 0 || reader->stack[reader->depth - 1].type != TNY_ARRAY
+			|| !TnyReader_seek(reader, step->index)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+void TnyPath_free(TnyPath *path)
+{
+	Tny_release(NULL, path);
+}
+
+static char* TnyWriter_reserve(TnyWriter *writer, size_t size)
+{
+	size_t capacity = writer->capacity > 0 ? writer->capacity : TNY_WRITER_BUFSIZE;
+	char *data = NULL;
+
+	if (writer->error) {
+		return NULL;
+	}
+
+	if (writer->size + size > writer->capacity) {
+		while (capacity < writer->size + size) {
+			capacity *= 2;
+		}
+		data = Tny_reallocate(writer->data, capacity);
+		if (data == NULL) {
+			writer->error = 1;
+			return NULL;
+		}
+		writer->data = data;
+		writer->capacity = capacity;
+	}
+
+	data = writer->data + writer->size;
+	writer->size += size;
+
+	return data;
+}
+
+static int TnyWriter_element(TnyWriter *writer, TnyType type, const char *key)
+{
+	uint32_t size = 0;
+	char *data = NULL;
+
+	if (writer->error || writer->depth == 0) {
+		writer->error = 1;
+		return 0;
+	}
+
+	if (writer->stack[writer->depth - 1].type == TNY_DICT) {
+		if (key == NULL) {
+			/* Dict must have a key! */
+			writer->error = 1;
+			return 0;
+		}
+		size = strlen(key) + 1;
+	}
+
+	data = TnyWriter_reserve(writer, 1 + (size > 0 ? sizeof(uint32_t) + size : 0));
+	if (data == NULL) {
+		return 0;
+	}
+
+	*data++ = type;
+	if (size > 0) {
+		Tny_swapBytes32((uint32_t*)data, (const char*)&size);
+		memcpy(data + sizeof(uint32_t), key, size);
+	}
+	writer->stack[writer->depth - 1].count++;
+
+	return 1;
+}
+
+static int TnyWriter_flush(TnyWriter *writer, int all)
+{
+	size_t end = writer->flushed + writer->size;
+	int i;
+
+	if (writer->sink == NULL || writer->error) {
+		return !writer->error;
+	}
+
+	if (!all) {
+		/* Nothing behind a count which still has to be patched may leave the buffer. */
+		for (i = 0; i < writer->depth; i++) {
+			if (writer->stack[i].expected == TNY_COUNT_UNKNOWN) {
+				end = writer->stack[i].countPos;
+				break;
+			}
+		}
+	}
+
+	end -= writer->flushed;
+	if (end > 0) {
+		if (!writer->sink(writer->userData, writer->data, end)) {
+			writer->error = 1;
+			return 0;
+		}
+		memmove(writer->data, writer->data + end, writer->size - end);
+		writer->size -= end;
+		writer->flushed += end;
+	}
+
+	return 1;
+}
+
+void TnyWriter_init(TnyWriter *writer, TnySink sink, void *userData)
+{
+	memset(writer, 0, sizeof(TnyWriter));
+	writer->sink = sink;
+	writer->userData = userData;
+}
+
+int TnyWriter_begin(TnyWriter *writer, TnyType type, const char *key, uint32_t count)
+{
+	char *data = NULL;
+
+	if ((type != TNY_ARRAY && type != TNY_DICT) || writer->done || writer->depth >= TNY_WRITER_MAXDEPTH) {
+		writer->error = 1;
+		return 0;
+	}
+
+	if (writer->depth > 0 && !TnyWriter_element(writer, TNY_OBJ, key)) {
+		return 0;
+	}
+
+	data = TnyWriter_reserve(writer, 1 + sizeof(uint32_t));
+	if (data == NULL) {
+		return 0;
+	}
+
+	*data++ = type;
+	Tny_swapBytes32((uint32_t*)data, (const char*)&count);
+	writer->stack[writer->depth].type = type;
+	writer->stack[writer->depth].count = 0;
+	writer->stack[writer->depth].expected = count;
+	writer->stack[writer->depth].countPos = writer->flushed + writer->size - sizeof(uint32_t);
+	writer->depth++;
+
+	return 1;
+}
+
+int TnyWriter_add(TnyWriter *writer, TnyType type, const char *key, const void *value, uint64_t size)
+{
+	uint32_t binSize = size;
+	char *data = NULL;
+
+	if (type == TNY_ARRAY || type == TNY_DICT || type == TNY_OBJ || type > TNY_PACKED_DOUBLE
+		|| (type != TNY_NULL && value == NULL) || size > UINT32_MAX) {
+		writer->error = 1;
+		return 0;
+	}
+
+	if (!TnyWriter_element(writer, type, key)) {
+		return 0;
+	}
+
+	data = TnyWriter_reserve(writer, Tny_valueSize(type, size) - 1);
+	if (data == NULL) {
+		return 0;
+	}
+
+	if (type == TNY_BIN) {
+		Tny_swapBytes32((uint32_t*)data, (const char*)&binSize);
+		memcpy(data + sizeof(uint32_t), value, size);
+	} else if (type == TNY_CHAR) {
+		*data = *(const char*)value;
+	} else if (type == TNY_INT32) {
+		Tny_swapBytes32((uint32_t*)data, value);
+	} else if (type == TNY_INT64 || type == TNY_DOUBLE) {
+		Tny_swapBytes64((uint64_t*)data, value);
+	} else if (Tny_packedWidth(type) > 0) {
+		Tny_swapBytes32((uint32_t*)data, (const char*)&binSize);
+		Tny_swapBulk(data + sizeof(uint32_t), value, size, Tny_packedWidth(type));
+	}
+
+	if (writer->size >= TNY_WRITER_FLUSHSIZE) {
+		return TnyWriter_flush(writer, 0);
+	}
+
+	return 1;
+}
+
+int TnyWriter_end(TnyWriter *writer)
+{
+	size_t countPos = 0;
+	uint32_t count = 0;
+
+	if (writer->error || writer->depth == 0) {
+		writer->error = 1;
+		return 0;
+	}
+
+	writer->depth--;
+	count = writer->stack[writer->depth].count;
+	if (writer->stack[writer->depth].expected == TNY_COUNT_UNKNOWN) {
+		countPos = writer->stack[writer->depth].countPos - writer->flushed;
+		Tny_swapBytes32((uint32_t*)(writer->data + countPos), (const char*)&count);
+	} else if (writer->stack[writer->depth].expected != count) {
+		writer->error = 1;
+		return 0;
+	}
+
+	if (writer->depth == 0) {
+		writer->done = 1;
+		return TnyWriter_flush(writer, 1);
+	} else if (writer->size >= TNY_WRITER_FLUSHSIZE) {
+		return TnyWriter_flush(writer, 0);
+	}
+
+	return 1;
+}
+
+size_t TnyWriter_finish(TnyWriter *writer, void **data)
+{
+	size_t size = 0;
+
+	if (data != NULL) {
+		*data = NULL;
+	}
+
+	if (!writer->error && writer->done) {
+		size = writer->flushed + writer->size;
+		if (writer->sink == NULL && data != NULL) {
+			*data = writer->data;
+			writer->data = NULL;
+		}
+	}
+	TnyWriter_free(writer);
+
+	return size;
+}
+
+void TnyWriter_free(TnyWriter *writer)
+{
+	Tny_release(NULL, writer->data);
+	writer->data = NULL;
+	writer->size = 0;
+	writer->capacity = 0;
+}
+
+static int TnyParser_collect(TnyParser *parser, const char **data, size_t *size, size_t need)
+{
+	size_t count = need - parser->have;
+
+	if (count > *size) {
+		count = *size;
+	}
+	memcpy(parser->scratch + parser->have, *data, count);
+	parser->have += count;
+	*data += count;
+	*size -= count;
+	if (parser->have < need) {
+		return 0;
+	}
+	parser->have = 0;
+
+	return 1;
+}
+
+static int TnyParser_bulk(TnyParser *parser, const char **data, size_t *size, char *dest, uint64_t need)
+{
+	size_t count = need - parser->have;
+
+	if (count > *size) {
+		count = *size;
+	}
+	if (dest != NULL) {
+		memcpy(dest + parser->have, *data, count);
+	}
+	parser->have += count;
+	*data += count;
+	*size -= count;
+	if (parser->have < need) {
+		return 0;
+	}
+	parser->have = 0;
+
+	return 1;
+}
+
+static int TnyParser_number(TnyParser *parser, const char **data, size_t *size, int compact, size_t width, uint64_t *value)
+{
+	uint32_t number = 0;
+	size_t pos = 0;
+
+	if (!compact) {
+		if (!TnyParser_collect(parser, data, size, width)) {
+			return 0;
+		}
+		if (width == sizeof(uint32_t)) {
+			Tny_swapBytes32(&number, parser->scratch);
+			*value = number;
+		} else if (width == sizeof(uint64_t)) {
+			Tny_swapBytes64(value, parser->scratch);
+		} else {
+			*value = (unsigned char)parser->scratch[0];
+		}
+		return 1;
+	}
+
+	while (*size > 0) {
+		parser->scratch[parser->have++] = *(*data)++;
+		(*size)--;
+		if ((unsigned char)parser->scratch[parser->have - 1] < 0x80) {
+			Tny_readVarint(parser->scratch, parser->have, &pos, value);
+			parser->have = 0;
+			return 1;
+		} else if (parser->have == 10) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int TnyParser_reserve(char **buffer, size_t *capacity, uint64_t size)
+{
+	char *tmp = NULL;
+
+	if (size > SIZE_MAX) {
+		return 0;
+	}
+	if (size > *capacity) {
+		tmp = Tny_reallocate(*buffer, size);
+		if (tmp == NULL) {
+			return 0;
+		}
+		*buffer = tmp;
+		*capacity = size;
+	}
+
+	return 1;
+}
+
+static int TnyParser_gather(TnyParser *parser, const char **data, size_t *size, char **buffer, size_t *capacity, uint64_t need)
+{
+	uint64_t want = 0;
+
+	/* The buffer grows to at most twice the bytes which arrived, so a length read from
+	   the data cannot make the parser allocate ahead of the data it was given. */
+	if (need > *capacity) {
+		want = parser->have + (*size < need - parser->have ? *size : need - parser->have);
+		if (want < 2 * (uint64_t)parser->have) {
+			want = 2 * (uint64_t)parser->have;
+		}
+		if (want > need) {
+			want = need;
+		}
+		if (!TnyParser_reserve(buffer, capacity, want)) {
+			return -1;
+		}
+	}
+
+	return TnyParser_bulk(parser, data, size, *buffer, need);
+}
+
+static int TnyParser_add(TnyParser *parser, void *value, uint64_t size, int flags)
+{
+	int level = parser->depth - 1;
+	Tny *tny = NULL;
+	char *key = NULL;
+
+	if (parser->stack[level].remaining == 0) {
+		return 0;
+	}
+	if (parser->flags & TNY_LOAD_TRUSTED) {
+		flags |= TNY_ADD_UNIQUE;
+	}
+	if (parser->stack[level].last->root->type == TNY_DICT && parser->keys != NULL) {
+		key = parser->keys->keys[parser->keyLength];
+		flags |= TNY_ADD_SHARED;
+	} else if (parser->stack[level].last->root->type == TNY_DICT) {
+		key = parser->key;
+	}
+
+	tny = _Tny_add(parser->stack[level].last, parser->type, key, value, size, parser->arena, flags);
+	if (tny == NULL) {
+		return 0;
+	}
+	parser->stack[level].last = tny;
+	parser->stack[level].remaining--;
+	parser->step = TNY_STEP_ELEMENT;
+
+	return 1;
+}
+
+static int TnyParser_open(TnyParser *parser, uint32_t count)
+{
+	TnyType type = parser->header & ~(TNY_FORMAT_INDEXED | TNY_FORMAT_COMPACT);
+	Tny *tny = _Tny_add(NULL, type, NULL, NULL, count, parser->arena, 0);
+	Tny *obj = NULL;
+
+	if (tny == NULL) {
+		return 0;
+	}
+
+	if (parser->depth == 0) {
+		parser->root = tny;
+		tny->keys = parser->keys;
+		if (parser->arena != NULL) {
+			parser->arena->owner = tny;
+		}
+	} else {
+		/* The sub document is hooked into its #TNY_OBJ element before its elements arrive. */
+		parser->type = TNY_OBJ;
+		if (!TnyParser_add(parser, NULL, 0, 0)) {
+			Tny_free(tny);
+			return 0;
+		}
+		obj = parser->stack[parser->depth - 1].last;
+		/* A duplicate key is overwritten in place, which leaves its predecessor as the last element. */
+		if (obj->type != TNY_OBJ || obj->value.tny != NULL) {
+			obj = Tny_get(obj, parser->keys != NULL ? parser->keys->keys[parser->keyLength] : parser->key);
+		}
+		Tny_attach(tny, &obj->root->docSize);
+		obj->value.tny = tny;
+	}
+
+	parser->stack[parser->depth].last = tny;
+	parser->stack[parser->depth].remaining = count;
+	parser->stack[parser->depth].footer = 0;
+	if (parser->header & TNY_FORMAT_INDEXED) {
+		parser->stack[parser->depth].footer = (uint64_t)count * sizeof(uint64_t) * (type == TNY_DICT ? 2 : 1);
+	}
+	parser->stack[parser->depth].compact = (parser->header & TNY_FORMAT_COMPACT) != 0;
+	parser->depth++;
+	parser->step = TNY_STEP_ELEMENT;
+
+	return 1;
+}
+
+static void TnyParser_value(TnyParser *parser)
+{
+	if (parser->type == TNY_NULL) {
+		if (!TnyParser_add(parser, NULL, 0, 0)) {
+			parser->status = TNY_PARSE_ERROR;
+		}
+	} else if (parser->type == TNY_OBJ) {
+		parser->step = TNY_STEP_HEADER;
+	} else if (parser->type == TNY_BIN || Tny_packedWidth(parser->type) > 0) {
+		parser->step = TNY_STEP_BINLENGTH;
+	} else {
+		parser->step = TNY_STEP_VALUE;
+	}
+}
+
+int TnyParser_init(TnyParser *parser, int flags)
+{
+	memset(parser, 0, sizeof(TnyParser));
+	parser->flags = flags & ~TNY_LOAD_VIEW;
+	parser->step = TNY_STEP_HEADER;
+	parser->status = TNY_PARSE_MORE;
+	if (flags & TNY_LOAD_ARENA) {
+		parser->arena = TnyArena_create(0, NULL);
+		if (parser->arena == NULL) {
+			parser->status = TNY_PARSE_ERROR;
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+TnyParseStatus TnyParser_feed(TnyParser *parser, const void *data, size_t size, size_t *consumed)
+{
+	const char *next = data;
+	size_t left = size;
+	size_t used = 0;
+	uint64_t value = 0;
+	uint32_t i32 = 0;
+	double flt = 0.0;
+	char *plain = NULL;
+	size_t width = 1;
+	int level = parser->depth - 1;
+	int result = 1;
+
+	while (parser->status == TNY_PARSE_MORE && result > 0) {
+		level = parser->depth - 1;
+		switch (parser->step) {
+		case TNY_STEP_HEADER:
+			if ((result = TnyParser_collect(parser, &next, &left, 1)) > 0) {
+				parser->header = (unsigned char)parser->scratch[0];
+				value = parser->header & ~(TNY_FORMAT_INDEXED | TNY_FORMAT_COMPACT);
+				if (parser->header == TNY_FORMAT_COMPRESSED && parser->depth == 0 && !parser->unpacked) {
+					parser->step = TNY_STEP_PACKED;
+				} else if (parser->header == TNY_FORMAT_KEYED && parser->depth == 0 && parser->keys == NULL) {
+					parser->step = TNY_STEP_TABLESIZE;
+				} else if ((value == TNY_ARRAY || value == TNY_DICT) && parser->depth < TNY_PARSER_MAXDEPTH) {
+					parser->step = TNY_STEP_COUNT;
+				} else {
+					result = -1;
+				}
+			}
+			break;
+		case TNY_STEP_COUNT:
+			if ((result = TnyParser_number(parser, &next, &left, parser->header & TNY_FORMAT_COMPACT,
+					sizeof(uint32_t), &value)) > 0) {
+				if (value > UINT32_MAX) {
+					result = -1;
+				} else if (parser->header & TNY_FORMAT_INDEXED) {
+					parser->length = value;
+					parser->step = TNY_STEP_INDEX;
+				} else if (!TnyParser_open(parser, value)) {
+					result = -1;
+				}
+			}
+			break;
+		case TNY_STEP_INDEX:
+			if ((result = TnyParser_collect(parser, &next, &left, sizeof(uint64_t))) > 0
+					&& !TnyParser_open(parser, parser->length)) {
+				result = -1;
+			}
+			break;
+		case TNY_STEP_ELEMENT:
+			if (parser->stack[level].remaining == 0) {
+				if (parser->stack[level].footer > 0) {
+					parser->step = TNY_STEP_FOOTER;
+				} else if (--parser->depth == 0) {
+					parser->status = TNY_PARSE_DONE;
+				}
+			} else if ((result = TnyParser_collect(parser, &next, &left, 1)) > 0) {
+				parser->type = (unsigned char)parser->scratch[0];
+				parser->compressed = parser->type == (TNY_BIN | TNY_FORMAT_COMPRESSED);
+				if (parser->compressed) {
+					parser->type = TNY_BIN;
+				}
+				if (parser->type == TNY_ARRAY || parser->type == TNY_DICT || parser->type > TNY_PACKED_DOUBLE) {
+					result = -1;
+				} else if (parser->stack[level].last->root->type == TNY_DICT) {
+					parser->step = TNY_STEP_KEYLENGTH;
+				} else {
+					TnyParser_value(parser);
+				}
+			}
+			break;
+		case TNY_STEP_KEYLENGTH:
+			if ((result = TnyParser_number(parser, &next, &left, parser->stack[level].compact,
+					sizeof(uint32_t), &value)) > 0) {
+				if (parser->keys != NULL && value < parser->keys->count) {
+					/* The key is a reference into the key table. */
+					parser->keyLength = value;
+					TnyParser_value(parser);
+				} else if (parser->keys != NULL || value == 0 || value > UINT32_MAX) {
+					result = -1;
+				} else {
+					parser->keyLength = value;
+					parser->step = TNY_STEP_KEY;
+				}
+			}
+			break;
+		case TNY_STEP_KEY:
+			if ((result = TnyParser_gather(parser, &next, &left, &parser->key, &parser->keySize, parser->keyLength)) > 0) {
+				if (parser->key[parser->keyLength - 1] != '\0') {
+					result = -1;
+				} else {
+					TnyParser_value(parser);
+				}
+			}
+			break;
+		case TNY_STEP_VALUE:
+			if (parser->type == TNY_CHAR) {
+				result = TnyParser_number(parser, &next, &left, 0, 1, &value);
+			} else if (parser->type == TNY_INT32) {
+				result = TnyParser_number(parser, &next, &left, parser->stack[level].compact, sizeof(uint32_t), &value);
+			} else {
+				result = TnyParser_number(parser, &next, &left,
+					parser->type == TNY_INT64 && parser->stack[level].compact, sizeof(uint64_t), &value);
+			}
+			if (result > 0) {
+				if (parser->stack[level].compact && (parser->type == TNY_INT32 || parser->type == TNY_INT64)) {
+					value = TNY_UNZIGZAG(value);
+				}
+				i32 = (uint32_t)value;
+				memcpy(&flt, &value, sizeof(double));
+				if (!TnyParser_add(parser, parser->type == TNY_CHAR ? (void*)&parser->scratch[0]
+						: parser->type == TNY_INT32 ? (void*)&i32 : parser->type == TNY_DOUBLE ? (void*)&flt
+						: (void*)&value, 0, 0)) {
+					result = -1;
+				}
+			}
+			break;
+		case TNY_STEP_BINLENGTH:
+			if ((result = TnyParser_number(parser, &next, &left, parser->stack[level].compact,
+					sizeof(uint32_t), &parser->length)) > 0) {
+				/* Packed values are collected as raw bytes, the length is the number of values. */
+				width = Tny_packedWidth(parser->type) > 0 ? Tny_packedWidth(parser->type) : 1;
+				if (parser->length > UINT32_MAX || parser->length > SIZE_MAX / width) {
+					result = -1;
+				} else if (parser->compressed) {
+					parser->step = TNY_STEP_BLOCKLENGTH;
+				} else if (parser->length * width > TNY_PARSER_PREALLOC) {
+					/* Large values are gathered in the buffer as they arrive. */
+					parser->step = TNY_STEP_BIN;
+				} else if ((parser->value = Tny_malloc(parser->arena, parser->length > 0 ? parser->length * width : 1)) == NULL) {
+					result = -1;
+				} else {
+					parser->step = TNY_STEP_BIN;
+				}
+			}
+			break;
+		case TNY_STEP_BLOCKLENGTH:
+			if ((result = TnyParser_number(parser, &next, &left, parser->stack[level].compact,
+					sizeof(uint32_t), &parser->block)) > 0) {
+				if (parser->length / TNY_LZ_MAXRATIO > parser->block) {
+					result = -1;
+				} else {
+					parser->step = TNY_STEP_BIN;
+				}
+			}
+			break;
+		case TNY_STEP_BIN:
+			width = Tny_packedWidth(parser->type) > 0 ? Tny_packedWidth(parser->type) : 1;
+			if (parser->compressed) {
+				result = TnyParser_gather(parser, &next, &left, &parser->buffer, &parser->bufferSize, parser->block);
+			} else if (parser->value != NULL) {
+				result = TnyParser_bulk(parser, &next, &left, parser->value, parser->length * width);
+			} else {
+				result = TnyParser_gather(parser, &next, &left, &parser->buffer, &parser->bufferSize, parser->length * width);
+			}
+			if (result > 0 && !parser->compressed && parser->value == NULL) {
+				/* Heap documents take the buffer over, arena documents copy it into the arena. */
+				if (parser->arena == NULL) {
+					parser->value = parser->buffer;
+					parser->buffer = NULL;
+					parser->bufferSize = 0;
+				} else if ((parser->value = Tny_malloc(parser->arena, parser->length * width)) == NULL) {
+					result = -1;
+					break;
+				} else if (width > 1) {
+					/* Packed values are swapped on the way into the arena. */
+					Tny_swapBulk(parser->value, parser->buffer, parser->length, width);
+					width = 1;
+				} else {
+					memcpy(parser->value, parser->buffer, parser->length);
+				}
+			}
+			if (result > 0) {
+				if (width > 1) {
+					Tny_swapBulk(parser->value, parser->value, parser->length, width);
+				}
+				if (parser->compressed) {
+					parser->value = Tny_malloc(parser->arena, parser->length > 0 ? parser->length : 1);
+					if (parser->value == NULL
+							|| !TnyLz_decompress(parser->buffer, parser->block, parser->value, parser->length)) {
+						result = -1;
+						break;
+					}
+				}
+				if (!TnyParser_add(parser, parser->value, parser->length, TNY_ADD_TAKE)) {
+					result = -1;
+				} else {
+					parser->value = NULL;
+				}
+			}
+			break;
+		case TNY_STEP_FOOTER:
+			if ((result = TnyParser_bulk(parser, &next, &left, NULL, parser->stack[level].footer)) > 0) {
+				parser->stack[level].footer = 0;
+				parser->step = TNY_STEP_ELEMENT;
+			}
+			break;
+		case TNY_STEP_PACKED:
+			if ((result = TnyParser_collect(parser, &next, &left, 2 * sizeof(uint64_t))) > 0) {
+				Tny_swapBytes64(&parser->length, parser->scratch);
+				Tny_swapBytes64(&parser->block, parser->scratch + sizeof(uint64_t));
+				if (parser->length / TNY_LZ_MAXRATIO > parser->block || parser->length > SIZE_MAX) {
+					result = -1;
+				} else {
+					parser->step = TNY_STEP_BLOCK;
+				}
+			}
+			break;
+		case TNY_STEP_BLOCK:
+			if ((result = TnyParser_gather(parser, &next, &left, &parser->buffer, &parser->bufferSize, parser->block)) > 0) {
+				/* The content of a compressed document is parsed like a document of its own. */
+				value = parser->length;
+				plain = Tny_malloc(NULL, value);
+				result = -1;
+				if (plain != NULL && TnyLz_decompress(parser->buffer, parser->block, plain, value)) {
+					parser->unpacked = 1;
+					parser->step = TNY_STEP_HEADER;
+					if (TnyParser_feed(parser, plain, value, &used) == TNY_PARSE_DONE && used == value) {
+						result = 1;
+					}
+				}
+				Tny_release(NULL, plain);
+				if (result > 0) {
+					parser->status = TNY_PARSE_DONE;
+				}
+			}
+			break;
+		case TNY_STEP_TABLESIZE:
+			if ((result = TnyParser_collect(parser, &next, &left, sizeof(uint32_t))) > 0) {
+				Tny_swapBytes32(&i32, parser->scratch);
+				parser->length = i32;
+				parser->step = TNY_STEP_TABLE;
+			}
+			break;
+		case TNY_STEP_TABLE:
+			if ((result = TnyParser_gather(parser, &next, &left, &parser->buffer, &parser->bufferSize, parser->length)) > 0) {
+				if (!Tny_checkKeyTable(parser->buffer, parser->length, &i32)
+						|| (parser->keys = Tny_internKeys(parser->buffer, parser->length, i32, parser->arena, 0)) == NULL) {
+					result = -1;
+				} else {
+					parser->step = TNY_STEP_HEADER;
+				}
+			}
+			break;
+		}
+
+		if (result < 0) {
+			parser->status = TNY_PARSE_ERROR;
+		}
+	}
+
+	if (consumed != NULL) {
+		*consumed = next - (const char*)data;
+	}
+	TNY_COUNT(parsedBytes, next - (const char*)data);
+
+	return parser->status;
+}
+
+Tny* TnyParser_finish(TnyParser *parser)
+{
+	Tny *tny = NULL;
+
+	if (parser->value != NULL) {
+		Tny_release(parser->arena, parser->value);
+	}
+	if (parser->status == TNY_PARSE_DONE) {
+		tny = parser->root;
+		TNY_COUNT(loads, 1);
+	} else if (parser->root != NULL) {
+		Tny_free(parser->root);
+	} else {
+		Tny_release(parser->arena, parser->keys);
+		TnyArena_free(parser->arena);
+	}
+	Tny_release(NULL, parser->buffer);
+	Tny_release(NULL, parser->key);
+	memset(parser, 0, sizeof(TnyParser));
+	parser->status = TNY_PARSE_ERROR;
+
+	return tny;
+}
+
+TnyCodec* TnyCodec_create(const TnyField *fields, uint32_t count)
+{
+	TnyCodec *codec = NULL;
+	TnyCodecField *field = NULL;
+	size_t capacity = 16;
+	size_t slot = 0;
+	uint32_t i = 0;
+
+	while (capacity < (size_t)count * 2) {
+		capacity *= 2;
+	}
+	codec = Tny_malloc(NULL, sizeof(TnyCodec) + count * sizeof(TnyCodecField) + capacity * sizeof(uint32_t));
+	if (codec == NULL) {
+		return NULL;
+	}
+	codec->count = count;
+	codec->capacity = capacity;
+	codec->slots = (uint32_t*)(codec->fields + count);
+	memset(codec->slots, 0, capacity * sizeof(uint32_t));
+
+	for (i = 0; i < count; i++) {
+		field = &codec->fields[i];
+		field->field = fields[i];
+		if (field->field.key == NULL || field->field.type < TNY_BIN || field->field.type > TNY_PACKED_DOUBLE
+				|| (field->field.type == TNY_BIN && (field->field.size == 0 || field->field.size > UINT32_MAX))
+				|| (Tny_packedWidth(field->field.type) > 0 && field->field.size > UINT32_MAX)) {
+			Tny_release(NULL, codec);
+			return NULL;
+		}
+		field->keyLength = strlen(field->field.key);
+		field->keyHash = Tny_hash(field->field.key, field->keyLength);
+		if (TnyCodec_match(codec, field->field.key, field->keyLength, NULL) != NULL) {
+			Tny_release(NULL, codec);
+			return NULL;
+		}
+		for (slot = field->keyHash & (capacity - 1); codec->slots[slot] != 0; slot = (slot + 1) & (capacity - 1));
+		codec->slots[slot] = i + 1;
+	}
+
+	return codec;
+}
+
+static size_t TnyCodec_size(const TnyCodec *codec, const void *object, int compact)
+{
+	const TnyCodecField *field = NULL;
+	const char *member = NULL;
+	size_t size = 1 + (compact ? Tny_varintSize(codec->count) : sizeof(uint32_t));
+	size_t length = 0;
+	uint32_t i32 = 0;
+	uint64_t i64 = 0;
+	uint32_t i = 0;
+
+	for (i = 0; i < codec->count; i++) {
+		field = &codec->fields[i];
+		member = (const char*)object + field->field.offset;
+		size += 1 + (compact ? Tny_varintSize(field->keyLength + 1) : sizeof(uint32_t)) + field->keyLength + 1;
+		if (field->field.type == TNY_CHAR) {
+			size += 1;
+		} else if (field->field.type == TNY_INT32 && compact) {
+			memcpy(&i32, member, sizeof(uint32_t));
+			size += Tny_varintSize(TNY_ZIGZAG32(i32));
+		} else if (field->field.type == TNY_INT64 && compact) {
+			memcpy(&i64, member, sizeof(uint64_t));
+			size += Tny_varintSize(TNY_ZIGZAG64(i64));
+		} else if (field->field.type == TNY_BIN) {
+			length = TnyCodec_length(member, field->field.size);
+			size += (compact ? Tny_varintSize(length) : sizeof(uint32_t)) + length;
+		} else if (Tny_packedWidth(field->field.type) > 0) {
+			size += (compact ? Tny_varintSize(field->field.size) : sizeof(uint32_t))
+				+ field->field.size * Tny_packedWidth(field->field.type);
+		} else if (field->field.type == TNY_INT32) {
+			size += sizeof(uint32_t);
+		} else {
+			size += sizeof(uint64_t);
+		}
+	}
+
+	return size;
+}
+
+static uint32_t TnyCodec_length(const char *member, size_t size)
+{
+	const char *end = memchr(member, '\0', size);
+
+	return end != NULL ? (size_t)(end - member) : size;
+}
+
+static size_t TnyCodec_write(const TnyCodec *codec, const void *object, char *data, int compact)
+{
+	const TnyCodecField *field = NULL;
+	const char *member = NULL;
+	size_t pos = 0;
+	uint32_t i32 = 0;
+	uint64_t i64 = 0;
+	uint32_t i = 0;
+
+	data[pos++] = TNY_DICT | (compact ? TNY_FORMAT_COMPACT : 0);
+	if (compact) {
+		pos += Tny_writeVarint(data + pos, codec->count);
+	} else {
+		Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&codec->count);
+		pos += sizeof(uint32_t);
+	}
+
+	for (i = 0; i < codec->count; i++) {
+		field = &codec->fields[i];
+		member = (const char*)object + field->field.offset;
+		data[pos++] = field->field.type;
+		i32 = field->keyLength + 1;
+		if (compact) {
+			pos += Tny_writeVarint(data + pos, i32);
+		} else {
+			Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&i32);
+			pos += sizeof(uint32_t);
+		}
+		memcpy(data + pos, field->field.key, i32);
+		pos += i32;
+
+		if (field->field.type == TNY_CHAR) {
+			data[pos++] = *member;
+		} else if (field->field.type == TNY_INT32) {
+			memcpy(&i32, member, sizeof(uint32_t));
+			if (compact) {
+				pos += Tny_writeVarint(data + pos, TNY_ZIGZAG32(i32));
+			} else {
+				Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&i32);
+				pos += sizeof(uint32_t);
+			}
+		} else if (field->field.type == TNY_INT64 && compact) {
+			memcpy(&i64, member, sizeof(uint64_t));
+			pos += Tny_writeVarint(data + pos, TNY_ZIGZAG64(i64));
+		} else if (field->field.type == TNY_INT64 || field->field.type == TNY_DOUBLE) {
+			Tny_swapBytes64((uint64_t*)(data + pos), member);
+			pos += sizeof(uint64_t);
+		} else {
+			/* Strings are written without their terminator, packed values with their count. */
+			if (field->field.type == TNY_BIN) {
+				i32 = TnyCodec_length(member, field->field.size);
+			} else {
+				i32 = field->field.size;
+			}
+			if (compact) {
+				pos += Tny_writeVarint(data + pos, i32);
+			} else {
+				Tny_swapBytes32((uint32_t*)(data + pos), (const char*)&i32);
+				pos += sizeof(uint32_t);
+			}
+			if (field->field.type == TNY_BIN) {
+				memcpy(data + pos, member, i32);
+				pos += i32;
+			} else {
+				Tny_swapBulk(data + pos, member, i32, Tny_packedWidth(field->field.type));
+				pos += i32 * Tny_packedWidth(field->field.type);
+			}
+		}
+	}
+
+	return pos;
+}
+
+size_t TnyCodec_encode(const TnyCodec *codec, const void *object, void **data, int flags)
+{
+	size_t size = 0;
+
+	*data = NULL;
+	if ((flags & ~TNY_DUMP_COMPACT) != 0) {
+		return 0;
+	}
+
+	size = TnyCodec_size(codec, object, flags & TNY_DUMP_COMPACT);
+	*data = Tny_malloc(NULL, size);
+	if (*data == NULL) {
+		return 0;
+	}
+
+	return TnyCodec_write(codec, object, *data, flags & TNY_DUMP_COMPACT);
+}
+
+size_t TnyCodec_encodeInto(const TnyCodec *codec, const void *object, void *data, size_t capacity, int flags)
+{
+	size_t size = 0;
+
+	if ((flags & ~TNY_DUMP_COMPACT) != 0) {
+		return 0;
+	}
+
+	size = TnyCodec_size(codec, object, flags & TNY_DUMP_COMPACT);
+	if (size <= capacity) {
+		size = TnyCodec_write(codec, object, data, flags & TNY_DUMP_COMPACT);
+	}
+
+	return size;
+}
+
+static const TnyCodecField* TnyCodec_match(const TnyCodec *codec, const char *key, uint32_t length, uint32_t *next)
+{
+	const TnyCodecField *field = NULL;
+	uint32_t hash = 0;
+	size_t slot = 0;
+
+	/* The elements usually arrive in the order of the fields, then a single comparison is enough. */
+	if (next != NULL && *next < codec->count) {
+		field = &codec->fields[*next];
+		if (field->keyLength == length && memcmp(field->field.key, key, length) == 0) {
+			(*next)++;
+			return field;
+		}
+	}
+
+	hash = Tny_hash(key, length);
+	for (slot = hash & (codec->capacity - 1); codec->slots[slot] != 0; slot = (slot + 1) & (codec->capacity - 1)) {
+		field = &codec->fields[codec->slots[slot] - 1];
+		if (field->keyHash == hash && field->keyLength == length && memcmp(field->field.key, key, length) == 0) {
+			if (next != NULL) {
+				*next = codec->slots[slot];
+			}
+			return field;
+		}
+	}
+
+	return NULL;
+}
+
+static int TnyCodec_read(const TnyReader *reader, const TnyCodecField *field, char *member)
+{
+	const void *value = NULL;
+	uint32_t i32 = 0;
+	uint64_t i64 = 0;
+	double flt = 0.0;
+
+	if (reader->type != field->field.type) {
+		return 0;
+	}
+
+	if (field->field.type == TNY_CHAR) {
+		*member = TnyReader_char(reader);
+	} else if (field->field.type == TNY_INT32) {
+		i32 = TnyReader_int32(reader);
+		memcpy(member, &i32, sizeof(uint32_t));
+	} else if (field->field.type == TNY_INT64) {
+		i64 = TnyReader_int64(reader);
+		memcpy(member, &i64, sizeof(uint64_t));
+	} else if (field->field.type == TNY_DOUBLE) {
+		flt = TnyReader_double(reader);
+		memcpy(member, &flt, sizeof(double));
+	} else if (field->field.type == TNY_BIN) {
+		/* The string needs room for its terminator. */
+		value = TnyReader_bin(reader, &i32);
+		if (i32 >= field->field.size) {
+			return 0;
+		}
+		if (value != NULL) {
+			memcpy(member, value, i32);
+		} else if (!TnyReader_binInto(reader, member, i32)) {
+			return 0;
+		}
+		member[i32] = '\0';
+	} else {
+		i32 = TnyReader_packed(reader, NULL, 0);
+		if (i32 > field->field.size) {
+			return 0;
+		}
+		TnyReader_packed(reader, member, i32);
+	}
+
+	return 1;
+}
+
+int TnyCodec_decode(const TnyCodec *codec, const void *data, size_t length, void *object)
+{
+	TnyReader reader;
+	const TnyCodecField *field = NULL;
+	const char *key = NULL;
+	uint32_t keyLength = 0;
+	uint32_t next = 0;
+
+	if (!TnyReader_init(&reader, data, length) || reader.stack[0].type != TNY_DICT) {
+		return 0;
+	}
+
+	/* Values which are not read are skipped by the next call, which also detects truncated data. */
+	while (TnyReader_next(&reader)) {
+		key = TnyReader_key(&reader, &keyLength);
+		field = TnyCodec_match(codec, key, keyLength, &next);
+		if (field != NULL && !TnyCodec_read(&reader, field, (char*)object + field->field.offset)) {
+			return 0;
+		}
+	}
+
+	return !reader.error;
+}
+
+void TnyCodec_free(TnyCodec *codec)
+{
+	Tny_release(NULL, codec);
+}
+
+TnyFrozen* Tny_freeze(const Tny *tny)
+{
+	TnyFreezeState state;
+	TnyKeyTable keys;
+	TnyFrozen *frozen = NULL;
+	char *block = NULL;
+	size_t nodes = 0;
+	size_t blobs = 0;
+	size_t pairs = 0;
+	size_t keyBytes = 0;
+	size_t size = TNY_ALIGN(sizeof(TnyFrozen));
+	uint32_t i = 0;
+
+	if (tny == NULL) {
+		return NULL;
+	}
+
+	tny = tny->root;
+	memset(&keys, 0, sizeof(TnyKeyTable));
+	if (!TnyKeyTable_collect(&keys, tny, 0)) {
+		TnyKeyTable_free(&keys);
+		return NULL;
+	}
+	for (i = 0; i < keys.count; i++) {
+		keyBytes += keys.keys[i]->keyLength + 1;
+	}
+	Tny_freezeCount(tny, &nodes, &blobs, &pairs);
+
+	/* The arrays are laid out by decreasing alignment, so no padding is needed in between. */
+	size += (nodes + pairs) * sizeof(uint64_t) + blobs;
+	size += (2 * nodes + 2 * (size_t)keys.count + 1 + keys.capacity) * sizeof(uint32_t);
+	size += nodes + keyBytes;
+	if (nodes >= UINT32_MAX || keyBytes > UINT32_MAX) {
+		TnyKeyTable_free(&keys);
+		return NULL;
+	}
+
+	block = Tny_malloc(NULL, size);
+	if (block != NULL) {
+		frozen = (TnyFrozen*)block;
+		frozen->count = (uint32_t)nodes;
+		frozen->keyCount = keys.count;
+		frozen->capacity = keys.capacity;
+		frozen->bytes = size;
+		frozen->values = (uint64_t*)(block + TNY_ALIGN(sizeof(TnyFrozen)));
+		frozen->pairs = frozen->values + nodes;
+		frozen->blobs = (char*)(frozen->pairs + pairs);
+		frozen->sizes = (uint32_t*)(frozen->blobs + blobs);
+		frozen->keys = frozen->sizes + nodes;
+		frozen->keyOffsets = frozen->keys + nodes;
+		frozen->keyHashes = frozen->keyOffsets + keys.count + 1;
+		frozen->slots = frozen->keyHashes + keys.count;
+		frozen->types = (unsigned char*)(frozen->slots + keys.capacity);
+		frozen->keyData = (char*)frozen->types + nodes;
+
+		frozen->keyOffsets[0] = 0;
+		for (i = 0; i < keys.count; i++) {
+			memcpy(frozen->keyData + frozen->keyOffsets[i], keys.keys[i]->key, keys.keys[i]->keyLength);
+			frozen->keyData[frozen->keyOffsets[i] + keys.keys[i]->keyLength] = '\0';
+			frozen->keyOffsets[i + 1] = frozen->keyOffsets[i] + keys.keys[i]->keyLength + 1;
+			frozen->keyHashes[i] = keys.keys[i]->keyHash;
+		}
+		if (keys.capacity > 0) {
+			memcpy(frozen->slots, keys.slots, keys.capacity * sizeof(uint32_t));
+		}
+
+		state.frozen = frozen;
+		state.keys = &keys;
+		state.next = 1 + tny->size;
+		state.blobs = 0;
+		state.pairs = 0;
+		Tny_freezeDocument(&state, tny, 0);
+	}
+	TnyKeyTable_free(&keys);
+
+	return frozen;
+}
+
+static void Tny_freezeCount(const Tny *doc, size_t *nodes, size_t *blobs, size_t *pairs)
+{
+	const Tny *next = NULL;
+	uint32_t count = 0;
+
+	*nodes += 1 + doc->size;
+	if (doc->type == TNY_DICT) {
+		*pairs += doc->size;
+	}
+	for (next = doc->next; next != NULL && count < doc->size; next = next->next, count++) {
+		if (next->type == TNY_BIN) {
+			*blobs += TNY_ALIGN(next->size);
+		} else if (Tny_packedWidth(next->type) > 0) {
+			*blobs += TNY_ALIGN(next->size * Tny_packedWidth(next->type));
+		} else if (next->type == TNY_OBJ && next->value.tny != NULL) {
+			Tny_freezeCount(next->value.tny, nodes, blobs, pairs);
+		}
+	}
+}
+
+static void Tny_freezeDocument(TnyFreezeState *state, const Tny *doc, uint32_t node)
+{
+	TnyFrozen *frozen = state->frozen;
+	const Tny *next = NULL;
+	uint64_t *pairs = frozen->pairs + state->pairs;
+	uint32_t element = 0;
+	size_t bytes = 0;
+
+	frozen->types[node] = (unsigned char)doc->type;
+	frozen->sizes[node] = doc->size;
+	frozen->keys[node] = TNY_FROZEN_NONE;
+	frozen->values[node] = state->pairs;
+	if (doc->type == TNY_DICT) {
+		state->pairs += doc->size;
+	}
+
+	/* The elements of a document are consecutive nodes behind it, sub documents are placed
+	   behind all elements of their parent. */
+	element = node + 1;
+	for (next = doc->next; next != NULL && element <= node + doc->size; next = next->next, element++) {
+		frozen->types[element] = (unsigned char)next->type;
+		frozen->sizes[element] = next->size;
+		frozen->keys[element] = TNY_FROZEN_NONE;
+		frozen->values[element] = 0;
+		if (doc->type == TNY_DICT) {
+			frozen->keys[element] = *TnyKeyTable_find(state->keys, next) - 1;
+			pairs[element - node - 1] = ((uint64_t)frozen->keys[element] << 32) | element;
+		}
+
+		if (next->type == TNY_BIN || Tny_packedWidth(next->type) > 0) {
+			bytes = next->type == TNY_BIN ? next->size : next->size * Tny_packedWidth(next->type);
+			if (bytes > 0) {
+				memcpy(frozen->blobs + state->blobs, next->value.ptr, bytes);
+			}
+			frozen->values[element] = state->blobs;
+			state->blobs += TNY_ALIGN(bytes);
+		} else if (next->type == TNY_OBJ && next->value.tny != NULL) {
+			frozen->values[element] = state->next;
+			state->next += 1 + next->value.tny->size;
+		} else if (next->type == TNY_DOUBLE) {
+			memcpy(&frozen->values[element], &next->value.flt, sizeof(double));
+		} else if (next->type == TNY_CHAR) {
+			frozen->values[element] = (unsigned char)next->value.chr;
+		} else if (next->type == TNY_INT32 || next->type == TNY_INT64) {
+			frozen->values[element] = next->value.num;
+		}
+	}
+
+	if (doc->type == TNY_DICT) {
+		qsort(pairs, doc->size, sizeof(uint64_t), Tny_compareOffsets);
+	}
+
+	element = node + 1;
+	for (next = doc->next; next != NULL && element <= node + doc->size; next = next->next, element++) {
+		if (next->type == TNY_OBJ && next->value.tny != NULL) {
+			Tny_freezeDocument(state, next->value.tny, (uint32_t)frozen->values[element]);
+		}
+	}
+}
+
+static uint32_t TnyFrozen_document(const TnyFrozen *frozen, uint32_t node)
+{
+	if (node < frozen->count && frozen->types[node] == TNY_OBJ) {
+		node = frozen->values[node] > 0 ? (uint32_t)frozen->values[node] : TNY_FROZEN_NONE;
+	}
+
+	if (node < frozen->count && (frozen->types[node] == TNY_ARRAY || frozen->types[node] == TNY_DICT)) {
+		return node;
+	}
+
+	return TNY_FROZEN_NONE;
+}
+
+uint32_t TnyFrozen_at(const TnyFrozen *frozen, uint32_t node, uint32_t index)
+{
+	node = TnyFrozen_document(frozen, node);
+
+	if (node == TNY_FROZEN_NONE || index >= frozen->sizes[node]) {
+		return TNY_FROZEN_NONE;
+	}
+
+	return node + 1 + index;
+}
+
+uint32_t TnyFrozen_get(const TnyFrozen *frozen, uint32_t node, const char *key)
+{
+	const uint64_t *pairs = NULL;
+	size_t mask = frozen->capacity - 1;
+	size_t len = 0;
+	size_t i = 0;
+	uint32_t hash = 0;
+	uint32_t number = 0;
+	uint32_t low = 0;
+	uint32_t high = 0;
+	uint32_t mid = 0;
+
+	node = TnyFrozen_document(frozen, node);
+	if (key == NULL || node == TNY_FROZEN_NONE || frozen->types[node] != TNY_DICT || frozen->capacity == 0) {
+		return TNY_FROZEN_NONE;
+	}
+
+	/* The key is looked up once among the distinct keys, the dictionary is searched by its number. */
+	len = strlen(key);
+	hash = Tny_hash(key, len);
+	for (i = hash & mask; frozen->slots[i] != 0; i = (i + 1) & mask) {
+		number = frozen->slots[i] - 1;
+		if (frozen->keyHashes[number] == hash && frozen->keyOffsets[number + 1] - frozen->keyOffsets[number] == len + 1
+				&& memcmp(frozen->keyData + frozen->keyOffsets[number], key, len) == 0) {
+			break;
+		}
+	}
+	if (frozen->slots[i] == 0) {
+		return TNY_FROZEN_NONE;
+	}
+
+	pairs = frozen->pairs + frozen->values[node];
+	high = frozen->sizes[node];
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if ((uint32_t)(pairs[mid] >> 32) < number) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	if (low < frozen->sizes[node] && (uint32_t)(pairs[low] >> 32) == number) {
+		return (uint32_t)pairs[low];
+	}
+
+	return TNY_FROZEN_NONE;
+}
+
+TnyType TnyFrozen_type(const TnyFrozen *frozen, uint32_t node)
+{
+	return node < frozen->count ? (TnyType)frozen->types[node] : TNY_NULL;
+}
+
+uint32_t TnyFrozen_size(const TnyFrozen *frozen, uint32_t node)
+{
+	if (node < frozen->count && frozen->types[node] == TNY_OBJ) {
+		node = TnyFrozen_document(frozen, node);
+	}
+
+	return node < frozen->count ? frozen->sizes[node] : 0;
+}
+
+const char* TnyFrozen_key(const TnyFrozen *frozen, uint32_t node, uint32_t *length)
+{
+	uint32_t number = node < frozen->count ? frozen->keys[node] : TNY_FROZEN_NONE;
+
+	if (number == TNY_FROZEN_NONE) {
+		return NULL;
+	}
+
+	if (length != NULL) {
+		*length = frozen->keyOffsets[number + 1] - frozen->keyOffsets[number] - 1;
+	}
+
+	return frozen->keyData + frozen->keyOffsets[number];
+}
+
+char TnyFrozen_char(const TnyFrozen *frozen, uint32_t node)
+{
+	return TnyFrozen_type(frozen, node) == TNY_CHAR ? (char)frozen->values[node] : 0;
+}
+
+uint32_t TnyFrozen_int32(const TnyFrozen *frozen, uint32_t node)
+{
+	return TnyFrozen_type(frozen, node) == TNY_INT32 ? (uint32_t)frozen->values[node] : 0;
+}
+
+uint64_t TnyFrozen_int64(const TnyFrozen *frozen, uint32_t node)
+{
+	return TnyFrozen_type(frozen, node) == TNY_INT64 ? frozen->values[node] : 0;
+}
+
+double TnyFrozen_double(const TnyFrozen *frozen, uint32_t node)
+{
+	double value = 0.0;
+
+	if (TnyFrozen_type(frozen, node) == TNY_DOUBLE) {
+		memcpy(&value, &frozen->values[node], sizeof(double));
+	}
+
+	return value;
+}
+
+const void* TnyFrozen_bin(const TnyFrozen *frozen, uint32_t node, uint32_t *size)
+{
+	TnyType type = TnyFrozen_type(frozen, node);
+
+	if (type != TNY_BIN && Tny_packedWidth(type) == 0) {
+		return NULL;
+	}
+
+	if (size != NULL) {
+		*size = frozen->sizes[node];
+	}
+
+	return frozen->blobs + frozen->values[node];
+}
+
+size_t TnyFrozen_bytes(const TnyFrozen *frozen)
+{
+	return frozen->bytes;
+}
+
+void TnyFrozen_free(TnyFrozen *frozen)
+{
+	Tny_release(NULL, frozen);
+}
+
+static void Tny_countMemory(const Tny *tny, TnyMemory *memory)
+{
+	const Tny *next = NULL;
+	const Tny *root = tny->root;
+
+	if (root->index != NULL) {
+		memory->otherBytes += sizeof(struct _TnyIndex) + root->index->capacity * sizeof(Tny*);
+	}
+	if (root->cache != NULL) {
+		memory->otherBytes += sizeof(struct _TnyCache) + root->cache->size;
+	}
+	if (root->keys != NULL) {
+		memory->keyBytes += sizeof(struct _TnyKeys) + root->keys->count * sizeof(char*) + root->keys->size;
+	}
+
+	for (next = root; next != NULL; next = next->next) {
+		memory->nodes++;
+		memory->nodeBytes += sizeof(Tny);
+		if (next->key != NULL && !(next->flags & TNY_BORROWED_KEY)) {
+			memory->keyBytes += next->keyLength + 1;
+		}
+		if (next->type == TNY_BIN && !(next->flags & TNY_BORROWED_VALUE)) {
+			memory->binBytes += next->size;
+		} else if (Tny_packedWidth(next->type) > 0) {
+			memory->binBytes += next->size * Tny_packedWidth(next->type);
+		} else if (next->type == TNY_OBJ && next->value.tny != NULL) {
+			Tny_countMemory(next->value.tny, memory);
+		}
+	}
+}
+
+void Tny_memory(const Tny *tny, TnyMemory *memory)
+{
+	memset(memory, 0, sizeof(TnyMemory));
+	Tny_countMemory(tny, memory);
+}
 
 void Tny_freeValue(Tny *tny)
 {
 	if (tny != NULL) {
 		Tny_subSize(tny, Tny_valueSize(tny->type, tny->size));
-		if (tny->type == TNY_BIN) {
-			free(tny->value.ptr);
+		if ((tny->type == TNY_BIN || Tny_packedWidth(tny->type) > 0) && !(tny->flags & TNY_BORROWED_VALUE)) {
+			Tny_release(tny->root->arena, tny->value.ptr);
 		} else if (tny->type == TNY_OBJ) {
 			Tny_free(tny->value.tny);
 		}
 		tny->value.ptr = NULL;
+		tny->flags &= ~TNY_BORROWED_VALUE;
 	}
 }
 
@@ -549,28 +5613,41 @@ void Tny_free(Tny *tny)
 {
 	Tny *tmp = NULL;
 	Tny *next = NULL;
+	TnyArena *arena = NULL;
 	TnyType type = TNY_NULL;
+	struct _TnyKeys *keys = NULL;
+	int owner = 0;
 
 	if (tny != NULL) {
 		type = tny->root->type;
+		arena = tny->root->arena;
+		keys = tny->root->keys;
+		owner = arena != NULL && arena->owner == tny->root;
 
-		/* Get the last element.
-		   The linked list has to be free'd from back to front because of tny->docSizePtr
-		   which points to the root element. */
-		for (next = tny; next != NULL; next = next->next) {
-			tny = next;
+		/* The document owns its arena, so everything can be released at once. */
+		if (owner && arena->chunkSize > 0) {
+			Tny_detach(tny->root);
+			TnyArena_free(arena);
+			return;
 		}
 
-		next = tny;
+		/* The linked list has to be free'd from back to front because of tny->docSizePtr
+		   which points to the root element. */
+		next = tny->root->tail;
 		while (next != NULL) {
 			tmp = next->prev;
 			Tny_freeValue(next);
 			if (type == TNY_DICT && next->key != NULL) {
-				Tny_subSize(next, sizeof(uint32_t) + strlen(next->key) + 1);
+				Tny_subSize(next, sizeof(uint32_t) + next->keyLength + 1);
 			}
-			free(next->key);
-			free(next);
+			TnyIndex_free(next);
+			Tny_releaseNode(arena, next);
 			next = tmp;
 		}
+		/* The elements only referenced the shared keys. */
+		Tny_release(arena, keys);
+		if (owner) {
+			TnyArena_free(arena);
+		}
 	}
 }
@@ -4,9 +4,41 @@
  *
  * \code{.txt}
  * 	Document            =  (ArrayHeader *ArrayElement) / (DictionaryHeader *DictionaryElement)
+ *	Document            =/ (IndexedArrayHeader *ArrayElement ArrayIndex)
+ *	Document            =/ (IndexedDictionaryHeader *DictionaryElement DictionaryIndex)
  *	ArrayHeader         =  ArrayType NumberOfElements
  *	DictionaryHeader    =  DictionaryType NumberOfElements
  *	NumberOfElements    =  int32
+ *	; Indexed documents (written with TNY_DUMP_INDEX)
+ *	IndexedArrayHeader      =  %x11 NumberOfElements IndexPosition
+ *	IndexedDictionaryHeader =  %x12 NumberOfElements IndexPosition
+ *	IndexPosition       =  int64    ; offset of the index from the header
+ *	ArrayIndex          =  *ElementOffset
+ *	DictionaryIndex     =  *ElementOffset *(KeyHash ElementNumber)
+ *	ElementOffset       =  int64    ; offset of the element from the header
+ *	KeyHash             =  int32    ; FNV-1a hash of the key, sorted ascending
+ *	ElementNumber       =  int32
+ *	; Compact documents (written with TNY_DUMP_COMPACT)
+ *	; The header types are or'ed with %x20 (%x21, %x22, %x31, %x32). Inside such a
+ *	; document NumberOfElements, the Key length and the BinaryValue length are
+ *	; varints, Int32Value and Int64Value are zigzag encoded varints.
+ *	varint              =  *(%x80-FF) %x00-7F   ; LEB128, least significant group first
+ *	; Compressed data (written with TNY_DUMP_COMPRESS and TNY_DUMP_COMPRESS_BIN)
+ *	CompressedDocument  =  %x40 int64 int64 LZBlock   ; size of the Document, size of the block
+ *	DictionaryElement   =/ CompressedBinaryType Key CompressedBinaryValue
+ *	ArrayElement        =/ CompressedBinaryType CompressedBinaryValue
+ *	CompressedBinaryType  = %x44
+ *	CompressedBinaryValue = int32 int32 LZBlock   ; size of the value, size of the block
+ *	; LZBlock is a sequence of LZ77 tokens: a byte with the literal count in the high and
+ *	; the match length - 4 in the low nibble (15 continues with 255-terminated bytes), the
+ *	; literals, and an int16 little-endian match offset. The last token has no match.
+ *	; Documents with a key table (written with TNY_DUMP_KEYS)
+ *	KeyedDocument       =  %x80 KeyTableSize NumberOfKeys *KeyOffset *Key Document
+ *	KeyTableSize        =  int32    ; size of NumberOfKeys, the offsets and the keys
+ *	NumberOfKeys        =  int32
+ *	KeyOffset           =  int32    ; offset of the Key from NumberOfKeys
+ *	; Inside a KeyedDocument the Key of every DictionaryElement is replaced by a KeyReference.
+ *	KeyReference        =  int32    ; number of the key in the table, a varint in compact documents
  *	; Dictionary element
  *	DictionaryElement   =  NullType   Key
  *	DictionaryElement   =/ ObjectType Key ObjectValue
@@ -15,6 +47,7 @@
  *	DictionaryElement   =/ Int32Type  Key Int32Value
  *	DictionaryElement   =/ Int64Type  Key Int64Value
  *	DictionaryElement   =/ DoubleType Key DoubleValue
+ *	DictionaryElement   =/ PackedType Key PackedValue
  *	Key                 =  int32 1*(%x01-FF) %x00
  *	; Array element
  *	ArrayElement        =  NullType
@@ -24,6 +57,7 @@
  *	ArrayElement        =/ Int32Type 	Int32Value
  *	ArrayElement        =/ Int64Type 	Int64Value
  *	ArrayElement        =/ DoubleType 	DoubleValue
+ *	ArrayElement        =/ PackedType 	PackedValue
  *	; Types
  *	NullType            =  %x00
  *	ArrayType           =  %x01
@@ -34,6 +68,7 @@
  *	Int32Type           =  %x06
  *	Int64Type           =  %x07
  *	DoubleType          =  %x08
+ *	PackedType          =  %x09 / %x0A / %x0B   ; int32, int64 or double values
  *	; Values
  *	ObjectValue         =  Document
  *	BinaryValue         =  int32 *CharValue
@@ -41,6 +76,8 @@
  *	Int32Value          =  int32
  *	Int64Value          =  int64
  *	DoubleValue         =  int64
+ *	PackedValue         =  NumberOfValues *(int32 / int64)   ; the count is a varint in compact documents
+ *	NumberOfValues      =  int32
  *	int32               =  4(%x00-FF)
  *	int64               =  8(%x00-FF)
  *	\endcode
@@ -51,6 +88,22 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#if !defined(TNY_NO_POSIX) && (defined(__unix__) || defined(__APPLE__))
+#define TNY_POSIX 1
+#endif
+
+#ifdef TNY_POSIX
+#include <sys/uio.h>
+/** \brief TnyIovec describes one piece of a scattered serialization (struct iovec on POSIX systems). */
+typedef struct iovec TnyIovec;
+#else
+/** \brief TnyIovec describes one piece of a scattered serialization (struct iovec on POSIX systems). */
+typedef struct {
+	void *iov_base;				/**< Points to the data of the piece. */
+	size_t iov_len;				/**< Contains the size in bytes of the piece. */
+} TnyIovec;
+#endif
+
 typedef enum {
     ORDER_LITTLE_ENDIAN = 0x03020100ul,
     ORDER_BIG_ENDIAN = 0x00010203ul
@@ -78,9 +131,145 @@ typedef enum {
 	TNY_CHAR,		/**< Character type: Used for storing a single character. */
 	TNY_INT32,		/**< 32 bit integer type. */
 	TNY_INT64,		/**< 64 bit integer type. */
-	TNY_DOUBLE		/**< Double-precision floating-point number. */
+	TNY_DOUBLE,		/**< Double-precision floating-point number. */
+	TNY_PACKED_INT32,	/**< Packed array of 32 bit integers, stored in one buffer (the number of values has to be specified). */
+	TNY_PACKED_INT64,	/**< Packed array of 64 bit integers, stored in one buffer (the number of values has to be specified). */
+	TNY_PACKED_DOUBLE	/**< Packed array of doubles, stored in one buffer (the number of values has to be specified). */
 } TnyType;
 
+/** \brief TnyLoadFlag contains the options which can be passed to \link Tny_loadsEx \endlink.
+ *
+ *  \enum TnyLoadFlag
+ */
+typedef enum {
+	TNY_LOAD_DEFAULT = 0x00,	/**< Every element is allocated on the heap. */
+	TNY_LOAD_ARENA = 0x01,		/**< The document and all sub documents are allocated from one arena. */
+	TNY_LOAD_TRUSTED = 0x02,	/**< The input is trusted to contain no duplicate keys, so
+									 dictionaries are loaded without checking for them. */
+	TNY_LOAD_VIEW = 0x04,		/**< Keys and binary values point into the serialized data instead of
+									 being copied. The data must outlive the document. */
+	TNY_LOAD_VALIDATE = 0x08	/**< The data is checked with \link Tny_validate \endlink before anything
+									 is allocated for the document. Only the structure is checked,
+									 \link Tny_loadsLimited \endlink also applies #TnyLimits. */
+} TnyLoadFlag;
+
+/** \brief TnyLimits restricts the documents \link Tny_validate \endlink accepts.
+ *
+ *	A member which is 0 does not restrict anything.
+ */
+typedef struct {
+	uint32_t maxDepth;			/**< Contains the maximum nesting depth, the root document has depth 1.
+									 More than #TNY_READER_MAXDEPTH levels are never accepted. */
+	uint64_t maxElements;		/**< Contains the maximum number of elements of all documents together. */
+	uint64_t maxValueSize;		/**< Contains the maximum size in bytes of a binary or packed value,
+									 after decompression. */
+} TnyLimits;
+
+/** \brief Maximum number of threads \link Tny_loadsParallel \endlink starts. */
+#define TNY_LOAD_MAXTHREADS 64
+
+#ifndef TNY_LOAD_SLICESIZE
+/** \brief Minimum number of bytes \link Tny_loadsParallel \endlink hands to one thread. */
+#define TNY_LOAD_SLICESIZE (64 * 1024)
+#endif
+
+/** \brief TnyDumpFlag contains the options which can be passed to \link Tny_dumpsEx \endlink.
+ *
+ *  \enum TnyDumpFlag
+ */
+typedef enum {
+	TNY_DUMP_DEFAULT = 0x00,	/**< The plain format without an index. */
+	TNY_DUMP_INDEX = 0x01,		/**< Every array and dictionary is followed by an offset index, so
+									 \link TnyReader_seek \endlink and \link TnyReader_find \endlink
+									 can jump to an element without parsing its predecessors. */
+	TNY_DUMP_COMPACT = 0x02,	/**< Counts, lengths and integers are written as LEB128 varints,
+									 integers zigzag encoded. Small values take a single byte. */
+	TNY_DUMP_COMPRESS = 0x04,	/**< The whole serialized document is LZ compressed. */
+	TNY_DUMP_COMPRESS_BIN = 0x08, /**< Binary values of at least #TNY_COMPRESS_THRESHOLD bytes are
+									 LZ compressed one by one. */
+	TNY_DUMP_KEYS = 0x10,		/**< Every distinct dictionary key is written once into a table in front
+									 of the document, the elements refer to it by number. A loaded
+									 document shares one copy of every key between its elements. */
+	TNY_DUMP_CACHE = 0x20		/**< The serialized form of every document is kept and copied by the next
+									 dump as long as the document and its sub documents are unchanged.
+									 Works with #TNY_DUMP_COMPACT and #TNY_DUMP_COMPRESS. Together with
+									 #TNY_DUMP_INDEX, #TNY_DUMP_COMPRESS_BIN or #TNY_DUMP_KEYS nothing is
+									 cached or copied. The dump changes the document, see \link Tny_dumpsEx \endlink. */
+} TnyDumpFlag;
+
+/** \brief Maximum number of threads \link Tny_dumpsParallel \endlink starts. */
+#define TNY_DUMP_MAXTHREADS 64
+
+#ifndef TNY_DUMP_SLICESIZE
+/** \brief Minimum number of bytes \link Tny_dumpsParallel \endlink hands to one thread. */
+#define TNY_DUMP_SLICESIZE (256 * 1024)
+#endif
+
+#ifndef TNY_COMPRESS_THRESHOLD
+/** \brief Minimum size in bytes of a binary value which gets compressed with #TNY_DUMP_COMPRESS_BIN. */
+#define TNY_COMPRESS_THRESHOLD 1024
+#endif
+
+/** \brief TnyElementFlag marks the parts of an element which are not owned by the document.
+ *
+ *  \enum TnyElementFlag
+ */
+typedef enum {
+	TNY_BORROWED_KEY = 0x01,	/**< The key points into memory owned by somebody else. */
+	TNY_BORROWED_VALUE = 0x02	/**< The binary value points into memory owned by somebody else. */
+} TnyElementFlag;
+
+/** \brief TnyArena is a chunk allocator a document can be created on.
+ *
+ *	Every element, key and binary value of an arena document is taken from
+ *	large chunks which are released all at once when the document is free'd.
+ */
+typedef struct _TnyArena TnyArena;
+
+/** \brief TnyAllocator routes the memory the library needs to the application.
+ *
+ *	It is set for the whole library with \link Tny_setAllocator \endlink, or for
+ *	one document with \link Tny_newWithAllocator \endlink.
+ */
+typedef struct {
+	void* (*allocate)(void *context, size_t size);	/**< Works like malloc(). */
+	void* (*reallocate)(void *context, void *ptr, size_t size); /**< Works like realloc(), \p ptr can be NULL. */
+	void (*release)(void *context, void *ptr);		/**< Works like free(), \p ptr is never NULL. */
+	void *context;				/**< Is passed to every function. */
+} TnyAllocator;
+
+/** \brief TnyMemory contains the memory held by a document, see \link Tny_memory \endlink. */
+typedef struct {
+	size_t nodes;				/**< Contains the number of elements, including the root elements. */
+	size_t nodeBytes;			/**< Contains the size in bytes of the elements. */
+	size_t keyBytes;			/**< Contains the size in bytes of the keys and the shared key tables. */
+	size_t binBytes;			/**< Contains the size in bytes of the binary and packed values. */
+	size_t otherBytes;			/**< Contains the size in bytes of the element indexes and the dump caches. */
+} TnyMemory;
+
+/** \brief TnyStats contains the counters of the library, see \link Tny_stats \endlink.
+ *
+ *	The counters are only maintained if the library is compiled with TNY_STATS defined.
+ *	Except for \p nodes they count from the last \link Tny_resetStats \endlink on.
+ */
+typedef struct {
+	uint64_t nodes;				/**< Contains the number of elements which are allocated right now.
+									 Elements of an arena are counted until the arena is free'd. */
+	uint64_t elements;			/**< Contains the number of elements which were created. */
+	uint64_t allocations;		/**< Contains the number of allocate and reallocate calls. */
+	uint64_t releases;			/**< Contains the number of release calls. */
+	uint64_t allocatedBytes;	/**< Contains the number of bytes which were requested. */
+	uint64_t copies;			/**< Contains the number of copied documents, sub documents included. */
+	uint64_t loads;				/**< Contains the number of loaded documents. */
+	uint64_t dumps;				/**< Contains the number of dumped documents. */
+	uint64_t parsedBytes;		/**< Contains the number of bytes which were loaded. */
+	uint64_t emittedBytes;		/**< Contains the number of bytes which were dumped. */
+} TnyStats;
+
+struct _TnyIndex;
+struct _TnyKeys;
+struct _TnyCache;
+
 /** \brief Tny is the main type. Every Tny-document
  * 		   consists of chained Tny-elements.
  */
@@ -91,11 +280,17 @@ typedef struct _Tny {
 	TnyType type;				/**< Contains the type of the element.
 									 If the element is the root element, it contains the document type. */
 	size_t docSize;				/**< Contains the size in bytes of the value.
-	 	 	 	 	 	 	 	 	 If this is the root element, it contains the size of the document. */
-	size_t *docSizePtr;			/**< Points to the docSize element of the root element where the document size is stored. */
+	 	 	 	 	 	 	 	 	 If this is the root element, it contains the size of the document
+	 	 	 	 	 	 	 	 	 including all of its sub documents. */
+	size_t *docSizePtr;			/**< Points to the docSize element of the root element. If this is the root
+									 element of a sub document, it points to the docSize element of the
+									 root element of the parent document. */
 	uint32_t size;				/**< Contains the size of the value. If this is the root element, it
 	 	 	 	 	 	 	 	 	 contains the number of elements stored in the document. */
 	char *key;					/**< Contains the key of the element if the document is of type TNY_DICT. */
+	uint32_t keyLength;			/**< Contains the length of the key without the terminating NUL. */
+	uint32_t keyHash;			/**< Contains the hash of the key. */
+	uint32_t flags;				/**< Contains #TnyElementFlag values. Borrowed memory is not free'd. */
 	union {
 		struct _Tny *tny;
 		void *ptr;
@@ -103,8 +298,199 @@ typedef struct _Tny {
 		double flt;
 		char chr;
 	} value;					/**< Union to access the value depending on the type. */
+	TnyArena *arena;			/**< Points to the arena the document is allocated from, otherwise NULL.
+									 Only used in the root element. */
+	struct _Tny *tail;			/**< Points to the last element of the document. Only used in the root element. */
+	struct _TnyIndex *index;	/**< Index over the elements, built by the change which lets the document grow
+									 large and kept up to date by later changes, lookups only read it. A TNY_ARRAY
+									 stores the positions, a TNY_DICT a hash table of the keys.
+									 Only used in the root element. */
+	struct _TnyKeys *keys;		/**< Keys shared by the elements of a document loaded from data written with
+									 #TNY_DUMP_KEYS, otherwise NULL. Only used in the root element. */
+	struct _TnyCache *cache;	/**< Serialized form of the document kept by #TNY_DUMP_CACHE, otherwise NULL.
+									 Dropped by every change of the document or its sub documents.
+									 Only used in the root element. */
 } Tny;
 
+/** \brief Maximum nesting depth a \link TnyReader \endlink can follow. */
+#define TNY_READER_MAXDEPTH 64
+
+/** \brief TnyReader is a cursor which walks a serialized document in place.
+ *
+ *	The reader never allocates memory. Its state has a constant size and can
+ *	live on the stack. All members are internal, use the TnyReader_* functions.
+ */
+typedef struct {
+	const char *data;			/**< Points to the serialized document. */
+	size_t length;				/**< Contains the size in bytes of the serialized document. */
+	size_t pos;					/**< Contains the read position. */
+	int depth;					/**< Contains the number of entered documents. */
+	int pending;				/**< Is 1 if the value of the current element has not been read past. */
+	int error;					/**< Is 1 if the data turned out to be corrupted. */
+	TnyType type;				/**< Contains the type of the current element. */
+	int compressed;				/**< Is 1 if the current binary value is compressed. */
+	const char *key;			/**< Points to the key of the current element, or NULL. */
+	uint32_t keyLength;			/**< Contains the length of the key without the terminating NUL. */
+	const char *keys;			/**< Points to the key table of data written with #TNY_DUMP_KEYS, or NULL. */
+	uint32_t keyCount;			/**< Contains the number of keys in the key table. */
+	struct {
+		TnyType type;			/**< Contains the document type. */
+		uint32_t remaining;		/**< Contains the number of elements which have not been visited yet. */
+		uint32_t count;			/**< Contains the number of elements of the document. */
+		size_t start;			/**< Contains the position of the document header. */
+		size_t first;			/**< Contains the position of the first element. */
+		size_t index;			/**< Contains the position of the offset index, or 0 if there is none. */
+		size_t end;				/**< Contains the position behind the offset index, or 0 if there is none. */
+		int compact;			/**< Is 1 if the document uses the compact encoding. */
+	} stack[TNY_READER_MAXDEPTH]; /**< Contains the entered documents. */
+} TnyReader;
+
+/** \brief Maximum nesting depth a \link TnyWriter \endlink can produce. */
+#define TNY_WRITER_MAXDEPTH 64
+
+/** \brief Passed as count to \link TnyWriter_begin \endlink if the number of elements is not known in advance. */
+#define TNY_COUNT_UNKNOWN 0xFFFFFFFFu
+
+/** \brief TnySink receives serialized data.
+ *
+ *	\param[in] userData
+ *				is the pointer which was registered together with the sink.
+ *	\param[in] data
+ *				contains the next bytes of the serialized document.
+ *	\param[in] size
+ *				is the number of bytes in \p data.
+ *	\returns
+ *				1 if all bytes were consumed, 0 to abort.
+ */
+typedef int (*TnySink)(void *userData, const void *data, size_t size);
+
+/** \brief TnyWriter serializes a document directly without building a Tny list.
+ *
+ *	All members are internal, use the TnyWriter_* functions.
+ */
+typedef struct {
+	char *data;					/**< Contains the bytes which were not handed to the sink yet. */
+	size_t size;				/**< Contains the number of bytes in \p data. */
+	size_t capacity;			/**< Contains the allocated size of \p data. */
+	size_t flushed;				/**< Contains the number of bytes handed to the sink. */
+	TnySink sink;				/**< Receives the serialized data, or NULL to keep everything in \p data. */
+	void *userData;				/**< Is passed to \p sink. */
+	int depth;					/**< Contains the number of open documents. */
+	int done;					/**< Is 1 if the root document has been closed. */
+	int error;					/**< Is 1 if the writer failed. */
+	struct {
+		TnyType type;			/**< Contains the document type. */
+		uint32_t count;			/**< Contains the number of elements written so far. */
+		uint32_t expected;		/**< Contains the announced number of elements or #TNY_COUNT_UNKNOWN. */
+		size_t countPos;		/**< Contains the stream position of the number of elements field. */
+	} stack[TNY_WRITER_MAXDEPTH]; /**< Contains the open documents. */
+} TnyWriter;
+
+/** \brief Maximum nesting depth a \link TnyParser \endlink can follow. */
+#define TNY_PARSER_MAXDEPTH 64
+
+/** \brief TnyParseStatus is returned by \link TnyParser_feed \endlink.
+ *
+ *  \enum TnyParseStatus
+ */
+typedef enum {
+	TNY_PARSE_ERROR = -1,		/**< The data is corrupted or memory ran out. */
+	TNY_PARSE_MORE = 0,			/**< All bytes were consumed, the document is not complete yet. */
+	TNY_PARSE_DONE = 1			/**< The document is complete. */
+} TnyParseStatus;
+
+/** \brief TnyParser builds a document from serialized data which arrives in pieces.
+ *
+ *	Every byte is looked at once, the parser keeps its position in the nested
+ *	documents between the calls. All members are internal, use the TnyParser_* functions.
+ */
+typedef struct {
+	int flags;					/**< Contains the #TnyLoadFlag values. */
+	int step;					/**< Contains what the parser expects next. */
+	TnyParseStatus status;		/**< Contains the result of the last call. */
+	TnyArena *arena;			/**< Contains the arena of the document, or NULL. */
+	Tny *root;					/**< Contains the document which is built. */
+	int header;					/**< Contains the type byte of the document header being read. */
+	TnyType type;				/**< Contains the type of the element being read. */
+	int compressed;				/**< Is 1 if the binary value being read is compressed. */
+	int unpacked;				/**< Is 1 if the data is the content of a compressed document. */
+	char scratch[16];			/**< Collects fixed size fields and varints. */
+	size_t have;				/**< Contains the number of bytes collected for the current field. */
+	uint64_t length;			/**< Contains the length of the value being read. */
+	uint64_t block;				/**< Contains the length of the compressed block being read. */
+	char *value;				/**< Receives the binary value or compressed block being read. */
+	char *buffer;				/**< Contains compressed blocks. */
+	size_t bufferSize;			/**< Contains the allocated size of \p buffer. */
+	char *key;					/**< Contains the key of the element being read. */
+	size_t keySize;				/**< Contains the allocated size of \p key. */
+	uint32_t keyLength;			/**< Contains the length of the key including the terminating NUL,
+									 or the number of the key in \p keys. */
+	struct _TnyKeys *keys;		/**< Contains the key table of data written with #TNY_DUMP_KEYS, or NULL.
+									 The document takes it over once it is created. */
+	int depth;					/**< Contains the number of open documents. */
+	struct {
+		Tny *last;				/**< Contains the last element of the document. */
+		uint32_t remaining;		/**< Contains the number of elements which have not been read yet. */
+		uint64_t footer;		/**< Contains the size of the offset index behind the elements. */
+		int compact;			/**< Is 1 if the document uses the compact encoding. */
+	} stack[TNY_PARSER_MAXDEPTH]; /**< Contains the open documents. */
+} TnyParser;
+
+/** \brief TnyField binds a dictionary element to a member of a C struct.
+ *
+ *	An array of fields describes a struct for \link TnyCodec_create \endlink, e.g.
+ *	{"Nr", TNY_INT32, offsetof(Address, nr), 0}.
+ */
+typedef struct {
+	const char *key;			/**< Contains the key of the element. It has to outlive the codec. */
+	TnyType type;				/**< Contains the type of the element: #TNY_CHAR, #TNY_INT32, #TNY_INT64,
+									 #TNY_DOUBLE, #TNY_BIN or one of the packed types. */
+	size_t offset;				/**< Contains the offset of the member in the struct, use offsetof(). */
+	size_t size;				/**< A #TNY_BIN member is a char array of \p size bytes which holds a NUL
+									 terminated string, a packed member an array of \p size values.
+									 Ignored for the other types. */
+} TnyField;
+
+/** \brief TnyCodec encodes and decodes a C struct without building a Tny list.
+ *
+ *	The keys of the fields are measured and hashed once when the codec is created.
+ *	A codec is never changed afterwards, so it can be shared between threads.
+ */
+typedef struct _TnyCodec TnyCodec;
+
+/** \brief TnyFrozen is an immutable copy of a document in one block of memory.
+ *
+ *	The elements are numbered nodes, node #TNY_FROZEN_ROOT is the root document and the
+ *	elements of every document are consecutive nodes. Types, values, keys and sizes are
+ *	stored in separate arrays, every distinct key is stored once. A frozen document is
+ *	never changed and its functions do not allocate, so it can be shared between threads.
+ */
+typedef struct _TnyFrozen TnyFrozen;
+
+/** \brief Node of the root document of a \link TnyFrozen \endlink. */
+#define TNY_FROZEN_ROOT 0
+
+/** \brief Returned by the \link TnyFrozen \endlink lookups if there is no such element. */
+#define TNY_FROZEN_NONE UINT32_MAX
+
+/** \brief TnyPatchOp is the first element of every operation of a patch created by \link Tny_diff \endlink.
+ *
+ *  \enum TnyPatchOp
+ */
+typedef enum {
+	TNY_PATCH_INSERT = 'i',		/**< Inserts the value at the path. */
+	TNY_PATCH_REMOVE = 'd',		/**< Removes the element at the path. */
+	TNY_PATCH_REPLACE = 'r',	/**< Replaces the value of the element at the path. */
+	TNY_PATCH_MOVE = 'm'		/**< Moves the element of a dictionary at the path behind another key. */
+} TnyPatchOp;
+
+/** \brief TnyPath is a compiled path expression like "a.b[3].c".
+ *
+ *	The keys are measured and hashed once when the path is compiled.
+ *	A path is never changed afterwards, so it can be shared between threads.
+ */
+typedef struct _TnyPath TnyPath;
+
 /** \brief Adds a new element after the \p prev element.
  *
  *	\param[in] prev
@@ -117,18 +503,95 @@ typedef struct _Tny {
  *				Otherwise \p key can be NULL.
  *	\param[in] value
  *				is the value of the new element. If the type is #TNY_OBJ a deep copy of \p value
- *				will be performed.
+ *				will be performed. The packed types expect an array of \p size values which is copied.
  *	\param[in] size
- *				needs only to be set if the element is of type #TNY_BIN. Otherwise it can be 0.
+ *				needs only to be set if the element is of type #TNY_BIN or a packed type, it contains
+ *				the size in bytes or the number of values. Otherwise it can be 0.
  *	\return
  *				If the function succeeds it returns the new created element, otherwise NULL.
  */
 Tny* Tny_add(Tny *prev, TnyType type, char *key, void *value, uint64_t size);
 
+/** \brief Creates a new document which is allocated from an arena.
+ *
+ *	Every element added to the returned document, including the keys, binary values
+ *	and sub documents, is allocated from the same arena. Removed elements are not
+ *	given back until the document is free'd, then all chunks are released at once.
+ *
+ *	\param[in] type
+ *				is the document type and must be either #TNY_ARRAY or #TNY_DICT.
+ *	\param[in] chunkSize
+ *				is the size in bytes of one arena chunk. If \p chunkSize is 0 a default size is used.
+ *	\return
+ *				If the function succeeds it returns the new document, otherwise NULL.
+ */
+Tny* Tny_newArena(TnyType type, size_t chunkSize);
+
+/** \brief Creates a new document which is allocated with an allocator of its own.
+ *
+ *	Every element added to the returned document, including the keys, binary values,
+ *	sub documents, indexes and dump caches, is allocated with \p allocator instead of
+ *	the allocator of the library. Sub documents which are taken over with
+ *	\link Tny_addOwned \endlink are copied.
+ *
+ *	\param[in] type
+ *				is the document type and must be either #TNY_ARRAY or #TNY_DICT.
+ *	\param[in] allocator
+ *				is the allocator of the document. It is copied, but its context has to stay
+ *				valid until the document is free'd.
+ *	\return
+ *				If the function succeeds it returns the new document, otherwise NULL.
+ */
+Tny* Tny_newWithAllocator(TnyType type, const TnyAllocator *allocator);
+
+/** \brief Adds a new element at the end of the document.
+ *
+ *	Works like \link Tny_add \endlink with the last element of the document as \p prev,
+ *	but does not need to walk through the document.
+ *
+ *	\param[in] tny
+ *				is the document or an element somewhere in the document.
+ *	\param[in] type
+ *				is the type of the new element.
+ *	\param[in] key
+ *				If the document is of type #TNY_DICT, the \p key must be set in every element.
+ *				Otherwise \p key can be NULL.
+ *	\param[in] value
+ *				is the value of the new element.
+ *	\param[in] size
+ *				needs only to be set if the element is of type #TNY_BIN. Otherwise it can be 0.
+ *	\return
+ *				If the function succeeds it returns the new created element, otherwise NULL.
+ */
+Tny* Tny_append(Tny *tny, TnyType type, char *key, void *value, uint64_t size);
+
+/** \brief Adds an existing document as sub document after the \p prev element.
+ *
+ *	Unlike \link Tny_add \endlink with #TNY_OBJ, no copy is made. The document \p value
+ *	becomes part of the document of \p prev and is free'd together with it, so the
+ *	caller must not free \p value anymore. If the document of \p prev is allocated from
+ *	an arena or with an allocator of its own, \p value gets copied and free'd instead.
+ *
+ *	\param[in] prev
+ *				is the previous element.
+ *	\param[in] key
+ *				If the document is of type #TNY_DICT, the \p key must be set.
+ *				Otherwise \p key can be NULL.
+ *	\param[in] value
+ *				is the document or an element somewhere in the document which is taken over.
+ *				It must not be a sub document itself.
+ *	\return
+ *				If the function succeeds it returns the new created element, otherwise NULL.
+ *				On failure \p value is left untouched.
+ */
+Tny* Tny_addOwned(Tny *prev, char *key, Tny *value);
+
 /** \brief Performs a deep copy of the \p src object.
  *
  *	\param[in] docSizePtr
  *				is only needed for internal use of Tny and can be NULL.
+ *				Otherwise it points to the docSize element of the root element of the
+ *				document the copy is going to be part of.
  *	\param[in] src
  *				is the source document which will be copied.
  *	\returns
@@ -147,7 +610,8 @@ void Tny_remove(Tny *tny);
 
 /** \brief Returns the element at position \p index.
  *
- *	Works in a TNY_ARRAY and a TNY_DICT.
+ *	Works in a TNY_ARRAY and a TNY_DICT. Large arrays are accessed through an index
+ *	of the positions, everything else is walked through.
  *
  *	\param[in] tny
  *				is the document or an element somewhere in the document.
@@ -160,7 +624,8 @@ Tny* Tny_at(const Tny* tny, size_t index);
 
 /** \brief Returns the element with the specified key.
  *
- *	Works in a TNY_ARRAY and a TNY_DICT.
+ *	Works in a TNY_ARRAY and a TNY_DICT. Large dictionaries are looked up
+ *	through a hash index, small ones are scanned.
  *
  *	\param[in] tny
  *				is the document or an element somewhere in the document.
@@ -171,6 +636,44 @@ Tny* Tny_at(const Tny* tny, size_t index);
  */
 Tny* Tny_get(const Tny* tny, const char *key);
 
+/** \brief Computes the changes between two versions of a document.
+ *
+ *	The patch is a #TNY_ARRAY of operations, so it can be serialized and loaded like any
+ *	other document. Every operation is a #TNY_ARRAY of a #TNY_CHAR holding a #TnyPatchOp,
+ *	a #TNY_ARRAY with the path to the element and, unless the element is removed, the new
+ *	value. A step of the path is a #TNY_BIN key including its terminating NUL inside a
+ *	dictionary or a #TNY_INT32 position inside an array. Positions refer to the document
+ *	as it is after the preceding operations. Inserts into a dictionary end with the key of
+ *	the element they are placed behind, a #TNY_NULL places them first. A #TNY_PATCH_MOVE
+ *	has this key instead of a value. The patched document has the keys in the order of \p to.
+ *
+ *	Sub documents which did not change are skipped after comparing them once. Elements
+ *	are matched by key in dictionaries and by position in arrays, equal elements at
+ *	the start and the end of an array are kept. Neither document is changed, so shared
+ *	documents can be diffed by several threads at once.
+ *
+ *	\param[in] from
+ *				is the old version of the document.
+ *	\param[in] to
+ *				is the new version of the document.
+ *	\returns
+ *				the patch which turns \p from into \p to, an empty #TNY_ARRAY if both are equal.
+ *				NULL is returned if memory runs out or the documents are of different types.
+ */
+Tny* Tny_diff(const Tny *from, const Tny *to);
+
+/** \brief Applies a patch created by \link Tny_diff \endlink in place.
+ *
+ *	\param[in] doc
+ *				is the document, it must be equal to the old version the patch was created from.
+ *	\param[in] patch
+ *				is the patch.
+ *	\returns
+ *				1 if the patch was applied, otherwise 0. If an operation does not fit the
+ *				document the operations in front of it remain applied.
+ */
+int Tny_patch(Tny *doc, const Tny *patch);
+
 /** \brief Serializes a document.
  *
  *	Serializes the document and stores the result in \p data.
@@ -186,6 +689,89 @@ Tny* Tny_get(const Tny* tny, const char *key);
  */
 size_t Tny_dumps(const Tny *tny, void **data);
 
+/** \brief Serializes a document with extra options.
+ *
+ *	With #TNY_DUMP_CACHE the serialized form of every document is stored in its root element.
+ *	Changes through the Tny functions drop the stored form of the changed document and of all
+ *	documents above it, values written directly into an element are not noticed. Because the
+ *	document is changed, it must not be serialized by several threads at once with this flag.
+ *	Every nesting level keeps a full copy of its own serialized form, so a sub document at
+ *	depth n is held up to n times in addition to the document. The forms of arena documents
+ *	are not taken from the arena chunks and are given back when they are dropped.
+ *	The output of #TNY_DUMP_INDEX, #TNY_DUMP_COMPRESS_BIN and #TNY_DUMP_KEYS depends on more
+ *	than a single document, with any of them the flag is ignored and the document written anew.
+ *
+ *	\param[in] tny
+ *				is the document which shall be serialized.
+ *	\param[out] data
+ *				is the position where the serialized document is copied to.
+ *	\param[in] flags
+ *				is a combination of #TnyDumpFlag values.
+ *	\returns
+ *				the size in bytes of the serialized document. If the function fails,
+ *				0 is returned.
+ */
+size_t Tny_dumpsEx(const Tny *tny, void **data, int flags);
+
+/** \brief Serializes a large document on several threads.
+ *
+ *	The size of every element is known from the document sizes, so the position of each
+ *	top-level element in the output is computed up front. The top-level elements are
+ *	split into ranges of about the same size and every range is written by a thread of
+ *	its own. Only the top level is split, a document with few but large elements does
+ *	not profit. #TNY_DUMP_COMPRESS compresses the result on the calling thread, any other
+ *	#TnyDumpFlag is handled by \link Tny_dumpsEx \endlink. Without POSIX threads the
+ *	document is written by the calling thread.
+ *
+ *	\param[in] tny
+ *				is the document which should be serialized.
+ *	\param[out] data
+ *				receives the serialized data, the caller has to free() it.
+ *	\param[in] flags
+ *				is a combination of #TnyDumpFlag values.
+ *	\param[in] threads
+ *				is the maximum number of threads, at most #TNY_DUMP_MAXTHREADS are used.
+ *	\returns
+ *				the size in bytes of the serialized data, or 0 if the function fails.
+ */
+size_t Tny_dumpsParallel(const Tny *tny, void **data, int flags, int threads);
+
+/** \brief Serializes a document into a buffer provided by the caller.
+ *
+ *	\param[in] tny
+ *				is the document which shall be serialized.
+ *	\param[out] data
+ *				is the buffer the serialized document is written to.
+ *	\param[in] capacity
+ *				is the size in bytes of \p data.
+ *	\returns
+ *				the size in bytes of the serialized document. If it is larger than \p capacity
+ *				nothing is written and the caller has to retry with a buffer of the returned size.
+ *				If the function fails, 0 is returned.
+ */
+size_t Tny_dumpsInto(const Tny *tny, void *data, size_t capacity);
+
+/** \brief Serializes a document into a list of pieces suitable for writev or sendmsg.
+ *
+ *	Binary values of at least \p threshold bytes are not copied, their pieces point
+ *	to the memory of the elements. Everything else is serialized into a buffer which is
+ *	allocated together with the pieces. The pieces are only valid as long as the
+ *	document is not changed or free'd.
+ *
+ *	\param[in] tny
+ *				is the document which shall be serialized.
+ *	\param[in] threshold
+ *				is the minimal size in bytes of a binary value which is referenced instead of copied.
+ *	\param[out] iov
+ *				receives the pieces. The memory has to be free'd by the caller with one call of free().
+ *	\param[out] count
+ *				receives the number of pieces in \p iov.
+ *	\returns
+ *				the size in bytes of the serialized document. If the function fails,
+ *				0 is returned.
+ */
+size_t Tny_dumpsIov(const Tny *tny, size_t threshold, TnyIovec **iov, size_t *count);
+
 /** \brief Deserializes a serialized document.
  *
  *	\param[in] data
@@ -197,6 +783,118 @@ size_t Tny_dumps(const Tny *tny, void **data);
  */
 Tny* Tny_loads(void *data, size_t length);
 
+/** \brief Deserializes a serialized document without copying keys and binary values.
+ *
+ *	The keys and the #TNY_BIN values of the returned document point directly into \p data,
+ *	so \p data must not be changed or free'd as long as the document is used.
+ *	Overwriting a borrowed value with \link Tny_add \endlink stores a copy as usual.
+ *
+ *	\param[in] data
+ *				contains the serialized document.
+ *	\param[in] length
+ *				is the size in bytes of the serialized document.
+ *	\returns
+ *				the deserialized document. If the function fails, NULL is returned.
+ */
+Tny* Tny_loadsView(void *data, size_t length);
+
+/** \brief Deserializes a serialized document using the given options.
+ *
+ *	\param[in] data
+ *				contains the serialized document.
+ *	\param[in] length
+ *				is the size in bytes of the serialized document.
+ *	\param[in] flags
+ *				is a combination of #TnyLoadFlag values. Views of documents compressed
+ *				with #TNY_DUMP_COMPRESS are always loaded into an arena, which keeps the
+ *				decompressed data.
+ *	\returns
+ *				the deserialized document. If the function fails, NULL is returned.
+ */
+Tny* Tny_loadsEx(void *data, size_t length, int flags);
+
+/** \brief Deserializes untrusted data which has to stay within limits.
+ *
+ *	The data is checked with \link Tny_validate \endlink and the given limits before
+ *	anything is allocated for the document, as if #TNY_LOAD_VALIDATE was set. The
+ *	limits of a compressed document are applied to its decompressed content.
+ *
+ *	\param[in] data
+ *				contains the serialized document.
+ *	\param[in] length
+ *				is the size in bytes of the serialized document.
+ *	\param[in] flags
+ *				is a combination of #TnyLoadFlag values.
+ *	\param[in] limits
+ *				restricts the nesting depth, the number of elements and the value sizes.
+ *				Can be NULL, then only the structure is checked.
+ *	\returns
+ *				the deserialized document. If the data is not well-formed, exceeds the
+ *				limits or the function fails, NULL is returned.
+ */
+Tny* Tny_loadsLimited(void *data, size_t length, int flags, const TnyLimits *limits);
+
+/** \brief Checks if data is a well-formed serialized document.
+ *
+ *	The check walks the data once, iteratively and without allocating memory. It
+ *	verifies the types, the element counts, the key terminators, the value lengths,
+ *	the offset indexes and compressed blocks, and that the document ends exactly at
+ *	\p length. Of a compressed document only the compressed block is checked, its
+ *	content can not be looked at without decompressing it. Duplicate keys are not detected.
+ *
+ *	\param[in] data
+ *				contains the serialized document.
+ *	\param[in] length
+ *				is the size of \p data in bytes.
+ *	\param[in] limits
+ *				restricts the nesting depth, the number of elements and the value sizes.
+ *				Can be NULL.
+ *	\returns
+ *				1 if the document is well-formed and within the limits, otherwise 0.
+ */
+int Tny_validate(const void *data, size_t length, const TnyLimits *limits);
+
+/** \brief Deserializes a large top-level array on several threads.
+ *
+ *	The elements of the array are split into byte ranges of about the same size,
+ *	using the offset index if the document has one and a scan with a
+ *	\link TnyReader \endlink otherwise. Every range is loaded by a thread of its own,
+ *	with an arena of its own if #TNY_LOAD_ARENA is set, and the ranges are chained
+ *	into one document. The result is the same as the one of \link Tny_loadsEx \endlink,
+ *	which is used whenever the document is small, not an array or not well-formed.
+ *	Without POSIX threads the document is always loaded by the calling thread.
+ *
+ *	\param[in] data
+ *				contains the serialized document.
+ *	\param[in] length
+ *				is the size of \p data in bytes.
+ *	\param[in] flags
+ *				is a combination of #TnyLoadFlag values.
+ *	\param[in] threads
+ *				is the maximum number of threads, at most #TNY_LOAD_MAXTHREADS are used.
+ *	\returns
+ *				the deserialized document. If the function fails, NULL is returned.
+ */
+Tny* Tny_loadsParallel(void *data, size_t length, int flags, int threads);
+
+/** \brief Deserializes a document from a file.
+ *
+ *	On POSIX systems the file is mapped into memory and parsed from the mapping,
+ *	so it is never copied into a buffer. With #TNY_LOAD_VIEW keys and binary values
+ *	point into the read-only mapping and are only read from disk when they are used.
+ *	The mapping is then owned by the arena of the document and unmapped by \link Tny_free \endlink.
+ *
+ *	\param[in] path
+ *				is the path of the file containing the serialized document.
+ *	\param[in] flags
+ *				is a combination of #TnyLoadFlag values. #TNY_LOAD_VIEW implies
+ *				#TNY_LOAD_ARENA. Without POSIX support the file is read into a
+ *				temporary buffer and #TNY_LOAD_VIEW is ignored.
+ *	\returns
+ *				the deserialized document. If the function fails, NULL is returned.
+ */
+Tny* Tny_loadFile(const char *path, int flags);
+
 /** \brief Checks if there are more elements to fetch.
  *
  *	Simple iterator function which makes it easy to walk through an Tny document.
@@ -217,6 +915,603 @@ int Tny_hasNext(const Tny *tny);
  */
 Tny* Tny_next(const Tny *tny);
 
+/** \brief Initializes a reader on a serialized document.
+ *
+ *	After the initialization the reader is positioned in front of the first element
+ *	of the root document. Use \link TnyReader_next \endlink to visit it.
+ *
+ *	\param[out] reader
+ *				is the reader which gets initialized.
+ *	\param[in] data
+ *				contains the serialized document. It is not copied and must stay valid.
+ *	\param[in] length
+ *				is the size in bytes of the serialized document.
+ *	\returns
+ *				1 if \p data starts with a valid document header, otherwise 0. Documents
+ *				compressed with #TNY_DUMP_COMPRESS can not be read in place.
+ */
+int TnyReader_init(TnyReader *reader, const void *data, size_t length);
+
+/** \brief Moves the reader to the next element of the current document.
+ *
+ *	If the current element is a sub document which was not entered, it gets skipped.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\returns
+ *				1 if the reader points to a new element, 0 at the end of the document
+ *				or if the data is corrupted.
+ */
+int TnyReader_next(TnyReader *reader);
+
+/** \brief Returns the type of the current element.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\returns
+ *				the type of the current element.
+ */
+TnyType TnyReader_type(const TnyReader *reader);
+
+/** \brief Returns the type of the document the reader is currently in.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\returns
+ *				#TNY_ARRAY or #TNY_DICT, or #TNY_NULL if the reader is not in a document.
+ */
+TnyType TnyReader_documentType(const TnyReader *reader);
+
+/** \brief Returns the key of the current element.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\param[out] length
+ *				receives the length of the key without the terminating NUL. Can be NULL.
+ *	\returns
+ *				the NUL terminated key inside the serialized data, or NULL if the
+ *				current document is an array.
+ */
+const char* TnyReader_key(const TnyReader *reader, uint32_t *length);
+
+/** \brief Returns the value of the current #TNY_CHAR element.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\returns
+ *				the value, or 0 if the current element has another type.
+ */
+char TnyReader_char(const TnyReader *reader);
+
+/** \brief Returns the value of the current #TNY_INT32 element.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\returns
+ *				the value, or 0 if the current element has another type.
+ */
+uint32_t TnyReader_int32(const TnyReader *reader);
+
+/** \brief Returns the value of the current #TNY_INT64 element.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\returns
+ *				the value, or 0 if the current element has another type.
+ */
+uint64_t TnyReader_int64(const TnyReader *reader);
+
+/** \brief Returns the value of the current #TNY_DOUBLE element.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\returns
+ *				the value, or 0.0 if the current element has another type.
+ */
+double TnyReader_double(const TnyReader *reader);
+
+/** \brief Returns the value of the current #TNY_BIN element.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\param[out] size
+ *				receives the size in bytes of the value. Can be NULL.
+ *	\returns
+ *				a pointer to the value inside the serialized data, or NULL if the
+ *				current element has another type or the value is compressed. Use
+ *				\link TnyReader_binInto \endlink for compressed values.
+ */
+const void* TnyReader_bin(const TnyReader *reader, uint32_t *size);
+
+/** \brief Copies the value of the current #TNY_BIN element into a buffer.
+ *
+ *	Compressed values are decompressed into the buffer.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\param[out] data
+ *				receives the value.
+ *	\param[in] capacity
+ *				is the size in bytes of \p data. It must be at least the size
+ *				returned by \link TnyReader_bin \endlink.
+ *	\returns
+ *				1 if the value was copied, otherwise 0.
+ */
+int TnyReader_binInto(const TnyReader *reader, void *data, uint32_t capacity);
+
+/** \brief Copies the values of the current #TNY_PACKED_INT32, #TNY_PACKED_INT64 or #TNY_PACKED_DOUBLE element.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\param[out] data
+ *				receives the values in host byte order if they fit. Can be NULL.
+ *	\param[in] capacity
+ *				is the number of values \p data can hold.
+ *	\returns
+ *				the number of values of the element, or 0 if the current element has another
+ *				type. Nothing is copied if the number exceeds \p capacity.
+ */
+uint32_t TnyReader_packed(const TnyReader *reader, void *data, uint32_t capacity);
+
+/** \brief Enters the sub document of the current #TNY_OBJ element.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\returns
+ *				1 if the reader is now positioned in front of the first element of the
+ *				sub document, otherwise 0.
+ */
+int TnyReader_enter(TnyReader *reader);
+
+/** \brief Leaves the current sub document.
+ *
+ *	Elements of the sub document which have not been visited are skipped.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\returns
+ *				1 if the reader is back in the parent document, otherwise 0.
+ */
+int TnyReader_leave(TnyReader *reader);
+
+/** \brief Skips the value of the current element including all of its sub documents.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\returns
+ *				1 if the function succeeds, 0 if the data is corrupted.
+ */
+int TnyReader_skip(TnyReader *reader);
+
+/** \brief Moves the reader to an element of the current document by its position.
+ *
+ *	If the document was serialized with #TNY_DUMP_INDEX the element is reached
+ *	in constant time, otherwise the document is walked from its first element.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\param[in] index
+ *				is the position of the element inside the current document.
+ *	\returns
+ *				1 if the reader points to the element, otherwise 0.
+ */
+int TnyReader_seek(TnyReader *reader, uint32_t index);
+
+/** \brief Moves the reader to an element of the current dictionary by its key.
+ *
+ *	If the dictionary was serialized with #TNY_DUMP_INDEX the key is looked up
+ *	by a binary search over the key hashes, otherwise the dictionary is walked
+ *	from its first element.
+ *
+ *	\param[in] reader
+ *				is the reader.
+ *	\param[in] key
+ *				is the key of the element.
+ *	\returns
+ *				1 if the reader points to the element, otherwise 0 and the reader is
+ *				positioned behind the last element of the dictionary.
+ */
+int TnyReader_find(TnyReader *reader, const char *key);
+
+/** \brief Compiles a path expression for \link TnyPath_evaluate \endlink.
+ *
+ *	A path is a sequence of steps. A key step selects an element of a dictionary and
+ *	is separated from the previous step by a ".", an index step "[n]" selects an
+ *	element of an array, e.g. "a.b[3].c" or "[7].name". Keys must not contain
+ *	".", "[" or "]".
+ *
+ *	\param[in] path
+ *				is the path expression.
+ *	\returns
+ *				the compiled path which has to be released with \link TnyPath_free \endlink,
+ *				or NULL if \p path is malformed.
+ */
+TnyPath* Tny_compilePath(const char *path);
+
+/** \brief Moves a reader to the element selected by a compiled path.
+ *
+ *	The path is followed from the current document of the reader, usually right after
+ *	\link TnyReader_init \endlink. Only the sub documents on the path are entered,
+ *	all other elements are skipped over by their sizes, so nothing is parsed or allocated.
+ *	Indexed documents are searched by their index, documents with a key table by the
+ *	key references. On success the value is read with the getters of the reader.
+ *
+ *	\param[in] path
+ *				is the compiled path.
+ *	\param[in] reader
+ *				is the reader.
+ *	\returns
+ *				1 if the reader points to the selected element, otherwise 0. The position
+ *				of the reader is undefined then.
+ */
+int TnyPath_evaluate(const TnyPath *path, TnyReader *reader);
+
+/** \brief Releases a compiled path.
+ *
+ *	\param[in] path
+ *				is the path to release. Can be NULL.
+ */
+void TnyPath_free(TnyPath *path);
+
+/** \brief Initializes a writer.
+ *
+ *	\param[out] writer
+ *				is the writer which gets initialized.
+ *	\param[in] sink
+ *				receives the serialized data in pieces. If \p sink is NULL the document
+ *				is collected in a growing buffer which is returned by \link TnyWriter_finish \endlink.
+ *	\param[in] userData
+ *				is passed to every call of \p sink.
+ */
+void TnyWriter_init(TnyWriter *writer, TnySink sink, void *userData);
+
+/** \brief Opens a new document.
+ *
+ *	The first call creates the root document. Every further call adds a #TNY_OBJ
+ *	element to the open document and makes the sub document the open one.
+ *
+ *	\param[in] writer
+ *				is the writer.
+ *	\param[in] type
+ *				is either #TNY_ARRAY or #TNY_DICT.
+ *	\param[in] key
+ *				is the key of the #TNY_OBJ element if the open document is a #TNY_DICT.
+ *	\param[in] count
+ *				is the number of elements the document will contain, or #TNY_COUNT_UNKNOWN.
+ *				An unknown count gets filled in by \link TnyWriter_end \endlink, but a
+ *				sink only receives data written in front of it after that.
+ *	\returns
+ *				1 if the function succeeds, otherwise 0.
+ */
+int TnyWriter_begin(TnyWriter *writer, TnyType type, const char *key, uint32_t count);
+
+/** \brief Adds a value to the open document.
+ *
+ *	The parameters are used like in \link Tny_add \endlink. Sub documents are
+ *	written with \link TnyWriter_begin \endlink instead of #TNY_OBJ.
+ *
+ *	\param[in] writer
+ *				is the writer.
+ *	\param[in] type
+ *				is the type of the value.
+ *	\param[in] key
+ *				must be set if the open document is a #TNY_DICT.
+ *	\param[in] value
+ *				points to the value.
+ *	\param[in] size
+ *				needs only to be set if the element is of type #TNY_BIN or a packed type.
+ *	\returns
+ *				1 if the function succeeds, otherwise 0.
+ */
+int TnyWriter_add(TnyWriter *writer, TnyType type, const char *key, const void *value, uint64_t size);
+
+/** \brief Closes the open document.
+ *
+ *	\param[in] writer
+ *				is the writer.
+ *	\returns
+ *				1 if the function succeeds, 0 if the number of written elements does not
+ *				match the announced count or the writer failed.
+ */
+int TnyWriter_end(TnyWriter *writer);
+
+/** \brief Finishes the serialization.
+ *
+ *	Must be called after the root document is closed. The writer can not be used afterwards.
+ *
+ *	\param[in] writer
+ *				is the writer.
+ *	\param[out] data
+ *				receives the serialized document if the writer has no sink. The memory has to
+ *				be free'd by the caller. Can be NULL if a sink is used.
+ *	\returns
+ *				the size in bytes of the serialized document. If the writer failed, 0 is returned.
+ */
+size_t TnyWriter_finish(TnyWriter *writer, void **data);
+
+/** \brief Frees the writer without finishing it.
+ *
+ *	\param[in] writer
+ *				is the writer.
+ */
+void TnyWriter_free(TnyWriter *writer);
+
+/** \brief Initializes a parser.
+ *
+ *	\param[out] parser
+ *				is the parser which gets initialized.
+ *	\param[in] flags
+ *				is a combination of #TnyLoadFlag values. #TNY_LOAD_VIEW is ignored because
+ *				the pieces of data do not outlive the calls.
+ *	\returns
+ *				1 if the function succeeds, otherwise 0.
+ */
+int TnyParser_init(TnyParser *parser, int flags);
+
+/** \brief Parses the next piece of a serialized document.
+ *
+ *	Buffers for values, keys and compressed blocks hold at most twice the bytes of
+ *	them which arrived, so a length read from the data cannot make the parser
+ *	allocate ahead of the data.
+ *
+ *	\param[in] parser
+ *				is the parser.
+ *	\param[in] data
+ *				contains the next bytes of the serialized document.
+ *	\param[in] size
+ *				is the number of bytes in \p data.
+ *	\param[out] consumed
+ *				receives the number of bytes which belong to the document. It is less than
+ *				\p size if the document ended inside \p data. Can be NULL.
+ *	\returns
+ *				#TNY_PARSE_MORE if more data is needed, #TNY_PARSE_DONE if the document is
+ *				complete or #TNY_PARSE_ERROR. Once the document is complete or an error
+ *				occurred, the same status is returned for every further call.
+ */
+TnyParseStatus TnyParser_feed(TnyParser *parser, const void *data, size_t size, size_t *consumed);
+
+/** \brief Returns the parsed document and releases the parser.
+ *
+ *	The parser can not be used afterwards. If the document is not complete it is free'd.
+ *
+ *	\param[in] parser
+ *				is the parser.
+ *	\returns
+ *				the document if \link TnyParser_feed \endlink returned #TNY_PARSE_DONE,
+ *				otherwise NULL.
+ */
+Tny* TnyParser_finish(TnyParser *parser);
+
+/** \brief Creates a codec for a C struct.
+ *
+ *	\param[in] fields
+ *				describes the members of the struct, it is copied.
+ *	\param[in] count
+ *				is the number of fields.
+ *	\returns
+ *				the codec, or NULL if a field has an unsupported type, a #TNY_BIN field has
+ *				a size of 0, a key is used twice or memory ran out.
+ */
+TnyCodec* TnyCodec_create(const TnyField *fields, uint32_t count);
+
+/** \brief Serializes a struct as a dictionary.
+ *
+ *	The elements are written in the order of the fields, directly from the members.
+ *
+ *	\param[in] codec
+ *				describes the struct.
+ *	\param[in] object
+ *				points to the struct.
+ *	\param[out] data
+ *				receives the serialized data, the caller has to free() it.
+ *	\param[in] flags
+ *				is #TNY_DUMP_DEFAULT or #TNY_DUMP_COMPACT.
+ *	\returns
+ *				the size in bytes of the serialized data, or 0 if the function fails.
+ */
+size_t TnyCodec_encode(const TnyCodec *codec, const void *object, void **data, int flags);
+
+/** \brief Serializes a struct into a buffer provided by the caller.
+ *
+ *	\param[in] codec
+ *				describes the struct.
+ *	\param[in] object
+ *				points to the struct.
+ *	\param[out] data
+ *				is the buffer the serialized data is written to.
+ *	\param[in] capacity
+ *				is the size in bytes of \p data.
+ *	\param[in] flags
+ *				is #TNY_DUMP_DEFAULT or #TNY_DUMP_COMPACT.
+ *	\returns
+ *				the size in bytes of the serialized data. If it is larger than \p capacity
+ *				nothing is written and the caller has to retry with a buffer of the returned size.
+ *				If the function fails, 0 is returned.
+ */
+size_t TnyCodec_encodeInto(const TnyCodec *codec, const void *object, void *data, size_t capacity, int flags);
+
+/** \brief Deserializes a dictionary into a struct.
+ *
+ *	The data is walked with a \link TnyReader \endlink, so it may use every encoding except
+ *	#TNY_DUMP_COMPRESS. If the keys arrive in the order of the fields every key is compared
+ *	once, otherwise it is looked up by its hash. Elements without a field are skipped and
+ *	members without an element are left unchanged. A packed member with fewer values keeps
+ *	its remaining values.
+ *
+ *	\param[in] codec
+ *				describes the struct.
+ *	\param[in] data
+ *				contains the serialized dictionary.
+ *	\param[in] length
+ *				is the size in bytes of \p data.
+ *	\param[out] object
+ *				points to the struct which receives the values.
+ *	\returns
+ *				1 if the function succeeds. 0 if the data is corrupted, an element has another type
+ *				than its field or a value does not fit into its member, the struct may be partly
+ *				written then.
+ */
+int TnyCodec_decode(const TnyCodec *codec, const void *data, size_t length, void *object);
+
+/** \brief Frees a codec.
+ *
+ *	\param[in] codec
+ *				is the codec which shall be free'd.
+ */
+void TnyCodec_free(TnyCodec *codec);
+
+/** \brief Packs a document into a \link TnyFrozen \endlink.
+ *
+ *	\param[in] tny
+ *				is the document or an element somewhere in the document.
+ *	\returns
+ *				the frozen document which has to be free'd with \link TnyFrozen_free \endlink,
+ *				or NULL if memory runs out.
+ */
+TnyFrozen* Tny_freeze(const Tny *tny);
+
+/** \brief Returns an element of a frozen document by its position.
+ *
+ *	The position is looked up in constant time, so iterating over a document from position 0
+ *	to \link TnyFrozen_size \endlink is a linear scan.
+ *
+ *	\param[in] frozen
+ *				is the frozen document.
+ *	\param[in] node
+ *				is a document, #TNY_FROZEN_ROOT or a #TNY_OBJ element.
+ *	\param[in] index
+ *				is the position of the element.
+ *	\returns
+ *				the node of the element, or #TNY_FROZEN_NONE.
+ */
+uint32_t TnyFrozen_at(const TnyFrozen *frozen, uint32_t node, uint32_t index);
+
+/** \brief Returns an element of a frozen dictionary by its key.
+ *
+ *	\param[in] frozen
+ *				is the frozen document.
+ *	\param[in] node
+ *				is a dictionary, #TNY_FROZEN_ROOT or a #TNY_OBJ element.
+ *	\param[in] key
+ *				is the key of the element.
+ *	\returns
+ *				the node of the element, or #TNY_FROZEN_NONE. Passing #TNY_FROZEN_NONE as
+ *				\p node returns #TNY_FROZEN_NONE, so lookups can be chained.
+ */
+uint32_t TnyFrozen_get(const TnyFrozen *frozen, uint32_t node, const char *key);
+
+/** \brief Returns the type of a node.
+ *
+ *	\param[in] frozen
+ *				is the frozen document.
+ *	\param[in] node
+ *				is the node.
+ *	\returns
+ *				the type of the element, or the document type if \p node is a document.
+ */
+TnyType TnyFrozen_type(const TnyFrozen *frozen, uint32_t node);
+
+/** \brief Returns the size of a node.
+ *
+ *	\param[in] frozen
+ *				is the frozen document.
+ *	\param[in] node
+ *				is the node.
+ *	\returns
+ *				the number of elements of a document or #TNY_OBJ element, the size in bytes of
+ *				a #TNY_BIN value or the number of values of a packed value.
+ */
+uint32_t TnyFrozen_size(const TnyFrozen *frozen, uint32_t node);
+
+/** \brief Returns the key of an element of a dictionary.
+ *
+ *	\param[in] frozen
+ *				is the frozen document.
+ *	\param[in] node
+ *				is the node.
+ *	\param[out] length
+ *				receives the length of the key. Can be NULL.
+ *	\returns
+ *				the NUL terminated key, or NULL if the node is not an element of a dictionary.
+ */
+const char* TnyFrozen_key(const TnyFrozen *frozen, uint32_t node, uint32_t *length);
+
+/** \brief Returns the value of a #TNY_CHAR node, otherwise 0. */
+char TnyFrozen_char(const TnyFrozen *frozen, uint32_t node);
+
+/** \brief Returns the value of a #TNY_INT32 node, otherwise 0. */
+uint32_t TnyFrozen_int32(const TnyFrozen *frozen, uint32_t node);
+
+/** \brief Returns the value of a #TNY_INT64 node, otherwise 0. */
+uint64_t TnyFrozen_int64(const TnyFrozen *frozen, uint32_t node);
+
+/** \brief Returns the value of a #TNY_DOUBLE node, otherwise 0.0. */
+double TnyFrozen_double(const TnyFrozen *frozen, uint32_t node);
+
+/** \brief Returns the value of a #TNY_BIN or packed node.
+ *
+ *	\param[in] frozen
+ *				is the frozen document.
+ *	\param[in] node
+ *				is the node.
+ *	\param[out] size
+ *				receives the size in bytes of a #TNY_BIN value or the number of values of a
+ *				packed value. Can be NULL.
+ *	\returns
+ *				the value inside the frozen document, packed values are aligned and in host byte
+ *				order. NULL is returned for other types.
+ */
+const void* TnyFrozen_bin(const TnyFrozen *frozen, uint32_t node, uint32_t *size);
+
+/** \brief Returns the size in bytes of the memory block of a frozen document. */
+size_t TnyFrozen_bytes(const TnyFrozen *frozen);
+
+/** \brief Frees a frozen document.
+ *
+ *	\param[in] frozen
+ *				is the frozen document which shall be free'd.
+ */
+void TnyFrozen_free(TnyFrozen *frozen);
+
+/** \brief Sets the allocator of the library.
+ *
+ *	Everything the library allocates is taken from this allocator, except for the
+ *	documents created with \link Tny_newWithAllocator \endlink. This includes the
+ *	data returned by the dump functions, which then has to be given back to the
+ *	allocator instead of free(). The allocator must only be changed while nothing
+ *	allocated by the library is left and no other thread uses the library.
+ *
+ *	\param[in] allocator
+ *				is the allocator which is copied, or NULL for malloc(), realloc() and free().
+ */
+void Tny_setAllocator(const TnyAllocator *allocator);
+
+/** \brief Counts the memory held by a document.
+ *
+ *	Borrowed keys and values are not counted, neither is the unused space of arena chunks.
+ *
+ *	\param[in] tny
+ *				is the document or an element somewhere in the document.
+ *	\param[out] memory
+ *				receives the memory held by the document and its sub documents.
+ */
+void Tny_memory(const Tny *tny, TnyMemory *memory);
+
+/** \brief Returns the counters of the library.
+ *
+ *	The counters are updated with relaxed atomic operations, they only cost something
+ *	if the library is compiled with TNY_STATS defined.
+ *
+ *	\param[out] stats
+ *				receives the counters, all of them are 0 without TNY_STATS.
+ *	\return
+ *				Returns 1 if the library maintains the counters, otherwise 0.
+ */
+int Tny_stats(TnyStats *stats);
+
+/** \brief Sets all counters of the library to 0, except for the number of allocated elements. */
+void Tny_resetStats(void);
+
 /** \brief Frees the document.
  *
  * 	\param[in] tny